@@ -1,8 +1,13 @@
 #version 330
 
+//Признаки варианта (определяются программой, см. ShaderFeatures):
+//KLEIN_VEINS - прожилки из diffuseTex поверх змеиной кожи; без них одна выборка из текстуры
+//KLEIN_TWO_SIDED - освещать обе стороны поверхности, разворачивая нормаль к камере
+
+#ifdef KLEIN_VEINS
 uniform sampler2D diffuseTex;
+#endif
 uniform sampler2D snakeSkinTex;
-uniform float alphaScaler; // для анимации
 
 struct LightInfo
 {
@@ -11,7 +16,25 @@ struct LightInfo
 	vec3 Ld; //цвет и интенсивность диффузного света
 	vec3 Ls; //цвет и интенсивность бликового света
 };
-uniform LightInfo light;
+
+const int MAX_LIGHTS = 4;
+
+//общий блок кадра (см. UniformBlocks.hpp)
+layout(std140) uniform LightsBlock
+{
+	LightInfo lights[MAX_LIGHTS];
+	int lightsCount;
+};
+
+//данные отрисовки: пишутся в кольцевой буфер и привязываются перед каждой отрисовкой
+layout(std140) uniform ObjectBlock
+{
+	mat4 modelMatrix; //из локальной в мировую
+	mat3 normalToCameraMatrix; //для преобразования нормалей из локальной системы координат в систему координат камеры
+	vec4 color;
+	float morphismAlpha; // для анимации
+	float alphaScaler; // для анимации
+};
 
 in vec3 normalCamSpace; //нормаль в системе координат камеры (интерполирована между вершинами треугольника)
 in vec4 posCamSpace; //координаты вершины в системе координат камеры (интерполированы между вершинами треугольника)
@@ -24,32 +47,41 @@ const float shininess = 128.0;
 
 void main()
 {
+	vec3 snakeSkinColor = texture(snakeSkinTex, texCoord).rgb;
+
+#ifdef KLEIN_VEINS
 	float alpha = texture(diffuseTex, texCoord).a * alphaScaler; // прозрачность вены
     vec3 veinColor = vec3(1.0, 0.0, 0.0);
-	vec3 snakeSkinColor = texture(snakeSkinTex, texCoord).rgb;
 
 	vec3 diffuseColor = alpha * veinColor + (1.0 - alpha) * snakeSkinColor; // хардкодим красный цвет
-
-	vec3 lightDirCamSpace = light.pos - posCamSpace.xyz; //направление на источник света
-	float distance = length(lightDirCamSpace);
-	lightDirCamSpace = normalize(lightDirCamSpace); //направление на источник света
+#else
+	vec3 diffuseColor = snakeSkinColor;
+#endif
 
 	vec3 normal = normalize(normalCamSpace); //нормализуем нормаль после интерполяции
 	vec3 viewDirection = normalize(-posCamSpace.xyz); //направление на виртуальную камеру (она находится в точке (0.0, 0.0, 0.0))
+#ifdef KLEIN_TWO_SIDED
 	if (dot(normal, viewDirection) <= 0.0) {
 		normal = -normal; // можем предположить, что мы видим поверхность (иначе она просто не отрисуется, и все хорошо)
 	}
+#endif
+
+	vec3 color = vec3(0.0);
+	for (int i = 0; i < lightsCount; i++)
+	{
+		vec3 lightDirCamSpace = normalize(lights[i].pos - posCamSpace.xyz); //направление на источник света
 
-	float NdotL = max(dot(normal, lightDirCamSpace.xyz), 0.0); //скалярное произведение (косинус)
-	vec3 color = diffuseColor * (light.La + light.Ld * NdotL);
-	if (NdotL > 0.0)
-	{			
-		vec3 halfVector = normalize(lightDirCamSpace.xyz + viewDirection); //биссектриса между направлениями на камеру и на источник света
+		float NdotL = max(dot(normal, lightDirCamSpace.xyz), 0.0); //скалярное произведение (косинус)
+		color += diffuseColor * (lights[i].La + lights[i].Ld * NdotL);
+		if (NdotL > 0.0)
+		{
+			vec3 halfVector = normalize(lightDirCamSpace.xyz + viewDirection); //биссектриса между направлениями на камеру и на источник света
 
-		float blinnTerm = max(dot(normal, halfVector), 0.0); //интенсивность бликового освещения по Блинну				
-		blinnTerm = pow(blinnTerm, shininess); //регулируем размер блика
+			float blinnTerm = max(dot(normal, halfVector), 0.0); //интенсивность бликового освещения по Блинну
+			blinnTerm = pow(blinnTerm, shininess); //регулируем размер блика
 
-		color += light.Ls * Ks * blinnTerm;
+			color += lights[i].Ls * Ks * blinnTerm;
+		}
 	}
 
 	fragColor = vec4(color, 1.0f);
@@ -1,13 +1,25 @@
 #version 330
 
-//стандартные матрицы для преобразования координат
-uniform mat4 modelMatrix; //из локальной в мировую
-uniform mat4 viewMatrix; //из мировой в систему координат камеры
-uniform mat4 projectionMatrix; //из системы координат камеры в усеченные координаты
-uniform float morphismAlpha; // для анимации
+//Признаки варианта (определяются программой, см. ShaderFeatures):
+//KLEIN_MORPH - смешивать поверхность 1 с поверхностью 2; без него рисуется только поверхность 1
 
-//матрица для преобразования нормалей из локальной системы координат в систему координат камеры
-uniform mat3 normalToCameraMatrix;
+//общие блоки кадра (см. UniformBlocks.hpp)
+layout(std140) uniform CameraBlock
+{
+	mat4 viewMatrix; //из мировой в систему координат камеры
+	mat4 projectionMatrix; //из системы координат камеры в усеченные координаты
+	vec4 cameraPosition; //положение камеры в мировой системе координат
+};
+
+//данные отрисовки: пишутся в кольцевой буфер и привязываются перед каждой отрисовкой
+layout(std140) uniform ObjectBlock
+{
+	mat4 modelMatrix; //из локальной в мировую
+	mat3 normalToCameraMatrix; //для преобразования нормалей из локальной системы координат в систему координат камеры
+	vec4 color;
+	float morphismAlpha; // для анимации
+	float alphaScaler; // для анимации
+};
 
 layout(location = 0) in vec3 vertex1Position; //координаты вершины в локальной системе координат
 layout(location = 1) in vec3 vertex1Normal; //нормаль в локальной системе координат
@@ -23,9 +35,14 @@ void main()
 {
 	texCoord = vertexTexCoord;
 
+#ifdef KLEIN_MORPH
 	// Преобразуем поверхность 1 в поверхность 2.
 	vec3 vertexPosition = morphismAlpha * vertex1Position + (1.0 - morphismAlpha) * vertex2Position;
     vec3 vertexNormal = morphismAlpha * vertex1Normal + (1.0 - morphismAlpha) * vertex2Normal;
+#else
+	vec3 vertexPosition = vertex1Position;
+	vec3 vertexNormal = vertex1Normal;
+#endif
 
 	posCamSpace = viewMatrix * modelMatrix * vec4(vertexPosition, 1.0); //преобразование координат вершины в систему координат камеры
 	normalCamSpace = normalize(normalToCameraMatrix * vertexNormal); //преобразование нормали в систему координат камеры
@@ -0,0 +1,58 @@
+/**
+Поле бутылок Клейна, нарисованное одной командой из общей GeometryArena.
+Матрицы каждой бутылки - атрибуты экземпляра, выбираемые через baseInstance отрисовки.
+Выходы совпадают с klein.vert, поэтому используется тот же фрагментный шейдер klein.frag.
+Признак KLEIN_MORPH такой же, как в klein.vert.
+*/
+
+#version 330
+
+//общие блоки кадра (см. UniformBlocks.hpp)
+layout(std140) uniform CameraBlock
+{
+	mat4 viewMatrix; //из мировой в систему координат камеры
+	mat4 projectionMatrix; //из системы координат камеры в усеченные координаты
+	vec4 cameraPosition; //положение камеры в мировой системе координат
+};
+
+//данные отрисовки; матрицы бутылок поля приходят атрибутами экземпляров, а не из блока
+layout(std140) uniform ObjectBlock
+{
+	mat4 modelMatrix; //из локальной в мировую
+	mat3 normalToCameraMatrix; //для преобразования нормалей из локальной системы координат в систему координат камеры
+	vec4 color;
+	float morphismAlpha; // для анимации
+	float alphaScaler; // для анимации
+};
+
+layout(location = 0) in vec3 vertex1Position; //координаты вершины в локальной системе координат
+layout(location = 1) in vec3 vertex1Normal; //нормаль в локальной системе координат
+layout(location = 2) in vec3 vertex2Position; //координаты вершины в локальной системе координат
+layout(location = 3) in vec3 vertex2Normal; //нормаль в локальной системе координат
+layout(location = 4) in vec2 vertexTexCoord; //текстурные координаты вершины
+
+layout(location = 5) in mat4 instanceModelMatrix; //из локальной (квантованной) в мировую, занимает атрибуты 5-8
+layout(location = 9) in mat3 instanceNormalMatrix; //нормали из локальной в мировую, занимает атрибуты 9-11
+
+out vec3 normalCamSpace; //нормаль в системе координат камеры
+out vec4 posCamSpace; //координаты вершины в системе координат камеры
+out vec2 texCoord; //текстурные координаты
+
+void main()
+{
+	texCoord = vertexTexCoord;
+
+#ifdef KLEIN_MORPH
+	// Преобразуем поверхность 1 в поверхность 2.
+	vec3 vertexPosition = morphismAlpha * vertex1Position + (1.0 - morphismAlpha) * vertex2Position;
+	vec3 vertexNormal = morphismAlpha * vertex1Normal + (1.0 - morphismAlpha) * vertex2Normal;
+#else
+	vec3 vertexPosition = vertex1Position;
+	vec3 vertexNormal = vertex1Normal;
+#endif
+
+	posCamSpace = viewMatrix * instanceModelMatrix * vec4(vertexPosition, 1.0); //преобразование координат вершины в систему координат камеры
+	normalCamSpace = normalize(mat3(viewMatrix) * instanceNormalMatrix * vertexNormal); //преобразование нормали в систему координат камеры
+
+	gl_Position = projectionMatrix * posCamSpace;
+}
@@ -0,0 +1,103 @@
+/**
+Бутылка Клейна, морфирующая в ленту Мебиуса, без вершинных атрибутов.
+Обе поверхности и их аналитические нормали вычисляются по gl_VertexID:
+вершины идут по 6 на ячейку равномерной сетки gridSize.x x gridSize.y (как индексы SurfaceTessellator).
+Выходы совпадают с klein.vert, поэтому используется тот же фрагментный шейдер klein.frag.
+Без признака KLEIN_MORPH лента Мебиуса не вычисляется, рисуется только бутылка.
+*/
+
+#version 330
+
+//общие блоки кадра (см. UniformBlocks.hpp)
+layout(std140) uniform CameraBlock
+{
+	mat4 viewMatrix; //из мировой в систему координат камеры
+	mat4 projectionMatrix; //из системы координат камеры в усеченные координаты
+	vec4 cameraPosition; //положение камеры в мировой системе координат
+};
+
+//данные отрисовки: пишутся в кольцевой буфер и привязываются перед каждой отрисовкой
+layout(std140) uniform ObjectBlock
+{
+	mat4 modelMatrix; //из локальной в мировую
+	mat3 normalToCameraMatrix; //для преобразования нормалей из локальной системы координат в систему координат камеры
+	vec4 color;
+	float morphismAlpha; // для анимации
+	float alphaScaler; // для анимации
+};
+
+uniform ivec2 gridSize; //количество ячеек сетки по u и по v
+uniform vec4 kleinDomain; //umin, umax, vmin, vmax бутылки Клейна
+uniform vec4 moebiusDomain; //umin, umax, vmin, vmax ленты Мебиуса
+uniform float aa; //параметр aa обеих поверхностей
+uniform float scaler; //масштаб обеих поверхностей
+
+out vec3 normalCamSpace; //нормаль в системе координат камеры
+out vec4 posCamSpace; //координаты вершины в системе координат камеры
+out vec2 texCoord; //текстурные координаты
+
+//смещения углов ячейки для 6 вершин двух треугольников: (0,0) (0,1) (1,0) и (1,1) (1,0) (0,1)
+const ivec2 cornerOffsets[6] = ivec2[6](ivec2(0, 0), ivec2(0, 1), ivec2(1, 0), ivec2(1, 1), ivec2(1, 0), ivec2(0, 1));
+
+//точка бутылки Клейна и частные производные по u и по v
+void klein(float u, float v, out vec3 position, out vec3 du, out vec3 dv)
+{
+	float su = sin(u), cu = cos(u);
+	float s2u = sin(2.0 * u), c2u = cos(2.0 * u);
+	float sv = sin(v), cv = cos(v);
+	float sh = sin(0.5 * v), ch = cos(0.5 * v);
+
+	float r = aa + ch * su - sh * s2u;
+	float z = sh * su + ch * s2u;
+	float ru = ch * cu - 2.0 * sh * c2u;
+	float rv = -0.5 * z;
+
+	position = scaler * vec3(r * cv, r * sv, z);
+	du = scaler * vec3(ru * cv, ru * sv, sh * cu + 2.0 * ch * c2u);
+	dv = scaler * vec3(rv * cv - r * sv, rv * sv + r * cv, 0.5 * (ch * su - sh * s2u));
+}
+
+//точка ленты Мебиуса и частные производные по u и по v
+void moebius(float u, float v, out vec3 position, out vec3 du, out vec3 dv)
+{
+	float sv = sin(v), cv = cos(v);
+	float sh = sin(0.5 * v), ch = cos(0.5 * v);
+
+	float k = aa * scaler;
+	float r = 1.0 + u * ch;
+	float rv = -0.5 * u * sh;
+
+	position = k * vec3(r * cv, r * sv, u * sh);
+	du = k * vec3(ch * cv, ch * sv, sh);
+	dv = k * vec3(rv * cv - r * sv, rv * sv + r * cv, 0.5 * u * ch);
+}
+
+void main()
+{
+	int cell = gl_VertexID / 6;
+	ivec2 node = ivec2(cell / gridSize.y, cell % gridSize.y) + cornerOffsets[gl_VertexID % 6];
+
+	vec2 st = vec2(node) / vec2(gridSize); //нормированные параметры в [0, 1]
+	texCoord = st;
+
+	vec3 position1, du1, dv1;
+	klein(mix(kleinDomain.x, kleinDomain.y, st.x), mix(kleinDomain.z, kleinDomain.w, st.y), position1, du1, dv1);
+
+#ifdef KLEIN_MORPH
+	vec3 position2, du2, dv2;
+	moebius(mix(moebiusDomain.x, moebiusDomain.y, st.x), mix(moebiusDomain.z, moebiusDomain.w, st.y), position2, du2, dv2);
+
+	// Преобразуем поверхность 1 в поверхность 2.
+	vec3 vertexPosition = morphismAlpha * position1 + (1.0 - morphismAlpha) * position2;
+	vec3 vertexNormal = morphismAlpha * normalize(cross(du1, dv1)) + (1.0 - morphismAlpha) * normalize(cross(du2, dv2));
+#else
+	//лента Мебиуса не нужна: вершина вычисляется только для бутылки
+	vec3 vertexPosition = position1;
+	vec3 vertexNormal = normalize(cross(du1, dv1));
+#endif
+
+	posCamSpace = viewMatrix * modelMatrix * vec4(vertexPosition, 1.0); //преобразование координат вершины в систему координат камеры
+	normalCamSpace = normalize(normalToCameraMatrix * vertexNormal); //преобразование нормали в систему координат камеры
+
+	gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(vertexPosition, 1.0);
+}
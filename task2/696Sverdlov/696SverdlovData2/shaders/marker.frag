@@ -4,7 +4,15 @@
 
 #version 330
 
-uniform vec4 color;
+//данные отрисовки: пишутся в кольцевой буфер и привязываются перед каждой отрисовкой
+layout(std140) uniform ObjectBlock
+{
+	mat4 modelMatrix; //из локальной в мировую
+	mat3 normalToCameraMatrix; //для преобразования нормалей из локальной системы координат в систему координат камеры
+	vec4 color;
+	float morphismAlpha; // для анимации
+	float alphaScaler; // для анимации
+};
 
 out vec4 fragColor; //выходной цвет фрагмента
 
@@ -4,11 +4,27 @@
 
 #version 330
 
-uniform mat4 mvpMatrix; //произведение матриц projectionMatrix * viewMatrix * modelMatrix
+//общие блоки кадра (см. UniformBlocks.hpp)
+layout(std140) uniform CameraBlock
+{
+	mat4 viewMatrix; //из мировой в систему координат камеры
+	mat4 projectionMatrix; //из системы координат камеры в усеченные координаты
+	vec4 cameraPosition; //положение камеры в мировой системе координат
+};
+
+//данные отрисовки: пишутся в кольцевой буфер и привязываются перед каждой отрисовкой
+layout(std140) uniform ObjectBlock
+{
+	mat4 modelMatrix; //из локальной в мировую
+	mat3 normalToCameraMatrix; //для преобразования нормалей из локальной системы координат в систему координат камеры
+	vec4 color;
+	float morphismAlpha; // для анимации
+	float alphaScaler; // для анимации
+};
 
 layout(location = 0) in vec3 vertexPosition; //координаты вершины в локальной системе координат
 
 void main()
 {	
-	gl_Position = mvpMatrix * vec4(vertexPosition, 1.0);
+	gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(vertexPosition, 1.0);
 }
@@ -0,0 +1,66 @@
+/**
+Освещаемые меши, загруженные из файлов: цвет задается в блоке отрисовки
+*/
+
+#version 330
+
+struct LightInfo
+{
+	vec3 pos; //положение источника света в системе координат ВИРТУАЛЬНОЙ КАМЕРЫ!
+	vec3 La; //цвет и интенсивность окружающего света
+	vec3 Ld; //цвет и интенсивность диффузного света
+	vec3 Ls; //цвет и интенсивность бликового света
+};
+
+const int MAX_LIGHTS = 4;
+
+//общий блок кадра (см. UniformBlocks.hpp)
+layout(std140) uniform LightsBlock
+{
+	LightInfo lights[MAX_LIGHTS];
+	int lightsCount;
+};
+
+//данные отрисовки: пишутся в кольцевой буфер и привязываются перед каждой отрисовкой
+layout(std140) uniform ObjectBlock
+{
+	mat4 modelMatrix; //из локальной в мировую (вместе с деквантованием позиций)
+	mat3 normalToCameraMatrix; //для преобразования нормалей из локальной системы координат в систему координат камеры
+	vec4 color;
+	float morphismAlpha; // для анимации
+	float alphaScaler; // для анимации
+};
+
+in vec3 normalCamSpace; //нормаль в системе координат камеры (интерполирована между вершинами треугольника)
+in vec4 posCamSpace; //координаты вершины в системе координат камеры (интерполированы между вершинами треугольника)
+
+out vec4 fragColor; //выходной цвет фрагмента
+
+const vec3 Ks = vec3(0.5, 0.5, 0.5); //Коэффициент бликового отражения
+const float shininess = 64.0;
+
+void main()
+{
+	vec3 normal = normalize(normalCamSpace); //нормализуем нормаль после интерполяции
+	vec3 viewDirection = normalize(-posCamSpace.xyz); //направление на виртуальную камеру (она находится в точке (0.0, 0.0, 0.0))
+
+	vec3 litColor = vec3(0.0);
+	for (int i = 0; i < lightsCount; i++)
+	{
+		vec3 lightDirCamSpace = normalize(lights[i].pos - posCamSpace.xyz); //направление на источник света
+
+		float NdotL = max(dot(normal, lightDirCamSpace.xyz), 0.0); //скалярное произведение (косинус)
+		litColor += color.rgb * (lights[i].La + lights[i].Ld * NdotL);
+		if (NdotL > 0.0)
+		{
+			vec3 halfVector = normalize(lightDirCamSpace.xyz + viewDirection); //биссектриса между направлениями на камеру и на источник света
+
+			float blinnTerm = max(dot(normal, halfVector), 0.0); //интенсивность бликового освещения по Блинну
+			blinnTerm = pow(blinnTerm, shininess); //регулируем размер блика
+
+			litColor += lights[i].Ls * Ks * blinnTerm;
+		}
+	}
+
+	fragColor = vec4(litColor, color.a);
+}
@@ -0,0 +1,37 @@
+/**
+Освещаемые меши, загруженные из файлов: цвет задается в блоке отрисовки
+*/
+
+#version 330
+
+//общие блоки кадра (см. UniformBlocks.hpp)
+layout(std140) uniform CameraBlock
+{
+	mat4 viewMatrix; //из мировой в систему координат камеры
+	mat4 projectionMatrix; //из системы координат камеры в усеченные координаты
+	vec4 cameraPosition; //положение камеры в мировой системе координат
+};
+
+//данные отрисовки: пишутся в кольцевой буфер и привязываются перед каждой отрисовкой
+layout(std140) uniform ObjectBlock
+{
+	mat4 modelMatrix; //из локальной в мировую (вместе с деквантованием позиций)
+	mat3 normalToCameraMatrix; //для преобразования нормалей из локальной системы координат в систему координат камеры
+	vec4 color;
+	float morphismAlpha; // для анимации
+	float alphaScaler; // для анимации
+};
+
+layout(location = 0) in vec3 vertexPosition; //координаты вершины в локальной системе координат
+layout(location = 1) in vec3 vertexNormal; //нормаль в локальной системе координат
+
+out vec3 normalCamSpace; //нормаль в системе координат камеры
+out vec4 posCamSpace; //координаты вершины в системе координат камеры
+
+void main()
+{
+	posCamSpace = viewMatrix * modelMatrix * vec4(vertexPosition, 1.0); //преобразование координат вершины в систему координат камеры
+	normalCamSpace = normalize(normalToCameraMatrix * vertexNormal); //преобразование нормали в систему координат камеры
+
+	gl_Position = projectionMatrix * posCamSpace;
+}
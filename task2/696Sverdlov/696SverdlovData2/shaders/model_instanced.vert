@@ -0,0 +1,32 @@
+/**
+Меши сцены, загруженной в общую GeometryArena (см. loadScene), нарисованные одной командой.
+Матрицы каждого экземпляра - атрибуты экземпляра, выбираемые через baseInstance отрисовки.
+Выходы совпадают с model.vert, поэтому используется тот же фрагментный шейдер model.frag.
+*/
+
+#version 330
+
+//общие блоки кадра (см. UniformBlocks.hpp)
+layout(std140) uniform CameraBlock
+{
+	mat4 viewMatrix; //из мировой в систему координат камеры
+	mat4 projectionMatrix; //из системы координат камеры в усеченные координаты
+	vec4 cameraPosition; //положение камеры в мировой системе координат
+};
+
+layout(location = 0) in vec3 vertexPosition; //координаты вершины в локальной системе координат
+layout(location = 1) in vec3 vertexNormal; //нормаль в локальной системе координат
+
+layout(location = 5) in mat4 instanceModelMatrix; //из локальной (квантованной) в мировую, занимает атрибуты 5-8
+layout(location = 9) in mat3 instanceNormalMatrix; //нормали из локальной в мировую, занимает атрибуты 9-11
+
+out vec3 normalCamSpace; //нормаль в системе координат камеры
+out vec4 posCamSpace; //координаты вершины в системе координат камеры
+
+void main()
+{
+	posCamSpace = viewMatrix * instanceModelMatrix * vec4(vertexPosition, 1.0); //преобразование координат вершины в систему координат камеры
+	normalCamSpace = normalize(mat3(viewMatrix) * instanceNormalMatrix * vertexNormal); //преобразование нормали в систему координат камеры
+
+	gl_Position = projectionMatrix * posCamSpace;
+}
@@ -1,8 +1,12 @@
 #version 330
 
-uniform vec3 cameraPos; //положение виртуальной камеры в мировой системе координат
-uniform mat4 viewMatrix; //из мировой в систему координат камеры
-uniform mat4 projectionMatrix; //из системы координат камеры в усеченные координаты
+//общие блоки кадра (см. UniformBlocks.hpp)
+layout(std140) uniform CameraBlock
+{
+	mat4 viewMatrix; //из мировой в систему координат камеры
+	mat4 projectionMatrix; //из системы координат камеры в усеченные координаты
+	vec4 cameraPosition; //положение камеры в мировой системе координат
+};
 
 uniform mat3 textureMatrix; //матрица для превращения координат из локальной системы кординат в текстурные координаты
 
@@ -14,5 +18,5 @@ void main()
 {
 	texCoord = textureMatrix * vertexPosition;
 	
-	gl_Position = projectionMatrix * viewMatrix * vec4(vertexPosition + cameraPos, 1.0);
+	gl_Position = projectionMatrix * viewMatrix * vec4(vertexPosition + cameraPosition.xyz, 1.0);
 }
@@ -1,79 +1,60 @@
+#include <AdaptiveTessellator.hpp>
 #include <Application.hpp>
+#include <GeometryArena.hpp>
+#include <GpuCuller.hpp>
+#include <IndexOptimizer.hpp>
 #include <LightInfo.hpp>
+#include <LodChain.hpp>
 #include <Mesh.hpp>
+#include <MeshCache.hpp>
+#include <MeshLoader.hpp>
+#include <MeshletCuller.hpp>
+#include <ParametricSurfaces.hpp>
+#include <ProgramBatch.hpp>
+#include <ProgramCache.hpp>
+#include <RenderQueue.hpp>
+#include <SceneBvh.hpp>
+#include <SceneImport.hpp>
 #include <ShaderProgram.hpp>
+#include <ShaderVariants.hpp>
+#include <StreamingBuffer.hpp>
+#include <SurfaceTessellator.hpp>
 #include <Texture.hpp>
+#include <UniformBlocks.hpp>
+#include <VertexQuantization.hpp>
 
+#include <algorithm>
+#include <cassert>
 #include <iostream>
 #include <sstream>
+#include <unordered_map>
 #include <vector>
 
-// http://virtualmathmuseum.org/Surface/klein_bottle/klein_bottle.html
-//
-//  x = (aa + cos(v / 2) * sin(u) - sin(v / 2) * sin(2 * u)) * cos(v)
-//  y = (aa + cos(v / 2) * sin(u) - sin(v / 2) * sin(2 * u)) * sin(v)
-//  z = sin(v / 2) * sin(u) + cos(v / 2) * sin(2 * u)
-//
-//   0.0 < u < 2 * π,  0 < v < 2 * π,  aa = 3
-//
-glm::vec3 kleinPosition(float u, float v, float aa, float scaler = 0.2f) {
-    double x = (aa + glm::cos(v * 0.5f) * glm::sin(u) - glm::sin(v * 0.5f) * glm::sin(2 * u)) * glm::cos(v);
-    double y = (aa + glm::cos(v * 0.5f) * glm::sin(u) - glm::sin(v * 0.5f) * glm::sin(2 * u)) * glm::sin(v);
-    double z = glm::sin(0.5f * v) * glm::sin(u) + glm::cos(0.5f * v) * glm::sin(2 * u);
-
-    return glm::vec3(x * scaler, y * scaler, z * scaler);
-}
-
-// http://virtualmathmuseum.org/Surface/moebius_strip/moebius_strip.html
-//
-//  x = aa * (cos(v) + u * cos(v / 2) * cos(v))
-//  y = aa * (sin(v) + u * cos(v / 2) * sin(v))
-//  z = aa * u * sin(v / 2)
-//
-//
-glm::vec3 moebiusPosition(float u, float v, float aa, float scaler = 0.2f) {
-    double x = aa * (glm::cos(v) + u * glm::cos(v * 0.5f) * glm::cos(v));
-    double y = aa * (glm::sin(v) + u * glm::cos(v * 0.5f) * glm::sin(v));
-    double z = aa * u * sin(v * 0.5f);
-    return glm::vec3(x * scaler, y * scaler, z * scaler);
-}
-
-struct SurfaceFillinParams {
-    std::function<glm::vec3(float u, float v, float aa, float scaler)> f;
-
-    float aa;
-    float umin;
-    float umax;
-    float vmin;
-    float vmax;
-};
-
+/**
+Заполняет атрибуты сетки без общих вершин: 6 отдельных вершин на каждую ячейку, нормали граней.
+Узлы сетки вычисляются один раз пакетной функцией поверхности (params.batchF) и затем копируются в вершины ячеек
+*/
 void fillInSurfaceAttributes(std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<glm::vec2>& texcoords, SurfaceFillinParams params) {
-    const float ucnt = 1000;
-    const float vcnt = 1000;
+    const unsigned int ucnt = 1000;
+    const unsigned int vcnt = 1000;
 
-    const float aa = params.aa;
-    const float umin = params.umin;
-    const float umax = params.umax;
-    const float vmin = params.vmin;
-    const float vmax = params.vmax;
+    std::vector<glm::vec3> points;
+    std::vector<glm::vec3> pointNormals;
+    SurfaceTessellator grid(ucnt, vcnt);
+    grid.fillInSurface(points, pointNormals, params);
 
-    const float udelta = (umax - umin) / ucnt;
-    const float vdelta = (vmax - vmin) / vcnt;
+    const size_t rowSize = vcnt + 1;
 
     const float txdelta = 1.0f / ucnt;
     const float tydelta = 1.0f / vcnt;
 
-    for (int ustep = 0; ustep < ucnt; ++ustep) {
-        for (int vstep = 0; vstep < vcnt; ++vstep) {
-            float u = umin + ustep * udelta;
-            float v = vmin + vstep * vdelta;
-
+    for (unsigned int ustep = 0; ustep < ucnt; ++ustep) {
+        for (unsigned int vstep = 0; vstep < vcnt; ++vstep) {
             // square with (u, v) in upper-left angle
-            auto aaPoint = params.f(u, v, aa, 0.5f);
-            auto abPoint = params.f(u, v + vdelta, aa, 0.5f);
-            auto baPoint = params.f(u + udelta, v, aa, 0.5f);
-            auto bbPoint = params.f(u + udelta, v + vdelta, aa, 0.5f);
+            const glm::vec3& aaPoint = points[ustep * rowSize + vstep];
+            const glm::vec3& abPoint = points[ustep * rowSize + vstep + 1];
+            const glm::vec3& baPoint = points[(ustep + 1) * rowSize + vstep];
+            const glm::vec3& bbPoint = points[(ustep + 1) * rowSize + vstep + 1];
 
             float tx = txdelta * ustep;
             float ty = tydelta * vstep;
@@ -107,66 +88,284 @@ void fillInSurfaceAttributes(std::vector<glm::vec3>& vertices, std::vector<glm::
     }
 }
 
-MeshPtr makeKleinBottle(float size)
-{
-    std::vector<glm::vec3> vertices1;
-    std::vector<glm::vec3> normals1;
-    std::vector<glm::vec3> vertices2;
-    std::vector<glm::vec3> normals2;
-    std::vector<glm::vec2> texcoords;
-
-    auto kleinParams = SurfaceFillinParams{
+SurfaceFillinParams kleinSurfaceParams() {
+    return SurfaceFillinParams{
         kleinPosition,
+        kleinPositions,
         3.0f,                       // aa
         0.0f,                     // umin
         2.0f * glm::pi<float>(),  // umax
         0.0f,                     // vmin
         2.0f * glm::pi<float>(),  // vmax
     };
+}
 
-    auto moebiusParams = SurfaceFillinParams{
+SurfaceFillinParams moebiusSurfaceParams() {
+    return SurfaceFillinParams{
             moebiusPosition,
+            moebiusPositions,
             3.0f,                        // aa
             -0.4f,                     // umin
             0.4f,                     // umax
             0.0f,                     // vmin
             2.0f * glm::pi<float>(), // vmax
     };
+}
 
-    fillInSurfaceAttributes(vertices1, normals1, texcoords, kleinParams);
-    fillInSurfaceAttributes(vertices2, normals2, texcoords, moebiusParams);
+/**
+Вершина бутылки Клейна: обе цели морфинга и общие текстурные координаты (атрибуты klein.vert)
+*/
+struct KleinVertex
+{
+    glm::vec3 position1;
+    glm::vec3 normal1;
+    glm::vec3 position2;
+    glm::vec3 normal2;
+    glm::vec2 texcoord;
+};
 
-    //----------------------------------------
+template <>
+struct VertexLayout<KleinVertex>
+{
+    template <class Visitor>
+    static void visit(Visitor& visitor)
+    {
+        visitor(0, &KleinVertex::position1);
+        visitor(1, &KleinVertex::normal1);
+        visitor(2, &KleinVertex::position2);
+        visitor(3, &KleinVertex::normal2);
+        visitor(4, &KleinVertex::texcoord);
+    }
+};
 
-    DataBufferPtr buf0 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-    buf0->setData(vertices1.size() * sizeof(float) * 3, vertices1.data());
+struct QuantizedKleinVertex
+{
+    PackedPosition position1;
+    PackedNormal normal1;
+    PackedPosition position2;
+    PackedNormal normal2;
+    PackedTexcoord texcoord;
+};
 
-    DataBufferPtr buf1 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-    buf1->setData(normals1.size() * sizeof(float) * 3, normals1.data());
+template <>
+struct VertexLayout<QuantizedKleinVertex>
+{
+    template <class Visitor>
+    static void visit(Visitor& visitor)
+    {
+        visitor(0, &QuantizedKleinVertex::position1);
+        visitor(1, &QuantizedKleinVertex::normal1);
+        visitor(2, &QuantizedKleinVertex::position2);
+        visitor(3, &QuantizedKleinVertex::normal2);
+        visitor(4, &QuantizedKleinVertex::texcoord);
+    }
+};
 
-    DataBufferPtr buf2 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-    buf2->setData(vertices2.size() * sizeof(float) * 3, vertices2.data());
+/**
+Способ разбиения области параметров (u, v) на треугольники
+*/
+enum class SurfaceTessellation {
+    Unindexed,   ///< 6 отдельных вершин на каждую ячейку равномерной сетки
+    UniformGrid, ///< общие вершины равномерной сетки и индексный буфер
+    Adaptive,    ///< адаптивное разбиение по хордовой ошибке (AdaptiveTessellator), индексный буфер
+};
 
-    DataBufferPtr buf3 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-    buf3->setData(normals2.size() * sizeof(float) * 3, normals2.data());
+/**
+Создает модель бутылки Клейна, морфирующей в ленту Мебиуса
+\param mode способ разбиения области параметров
+\param threadsCount количество потоков для построения равномерной сетки (0 - по числу ядер, 1 - последовательно)
+\param gridSize количество ячеек равномерной сетки по u и по v. Нормали в этом режиме аналитические,
+поэтому затенение остается гладким и на более грубой сетке. В адаптивном режиме - размер эталонной сетки для оценки ошибки
+\param tolerance допустимая хордовая ошибка адаптивного разбиения
+\param format формат атрибутов. В сжатом формате обе цели морфинга квантуются в общем параллелепипеде,
+поэтому смешивание в klein.vert остается линейным и деквантование выполняется одной матрицей
+\param streams один буфер с чередующимися атрибутами или отдельный буфер на атрибут
+\param cache если задан, меш с такими же параметрами берется из кеша, а построенный меш сохраняется в него
+*/
+MeshPtr makeKleinBottle(float size, SurfaceTessellation mode = SurfaceTessellation::UniformGrid, unsigned int threadsCount = 0,
+                        unsigned int gridSize = 1000, float tolerance = 1e-4f, VertexFormat format = VertexFormat::Float,
+                        VertexStreams streams = VertexStreams::Interleaved, const MeshCache* cache = nullptr)
+{
+    // Количество потоков не влияет на результат и в ключ не входит.
+    std::ostringstream cacheKey;
+    cacheKey << "klein:size=" << size << ",mode=" << static_cast<int>(mode) << ",grid=" << gridSize << ",tolerance=" << tolerance
+             << ",format=" << static_cast<int>(format) << ",streams=" << static_cast<int>(streams);
+    if (cache) {
+        if (MeshPtr cached = cache->load(cacheKey.str())) {
+            return cached;
+        }
+    }
+
+    const bool indexed = mode != SurfaceTessellation::Unindexed;
+
+    const unsigned int ucnt = gridSize;
+    const unsigned int vcnt = gridSize;
+
+    std::vector<glm::vec3> vertices1;
+    std::vector<glm::vec3> normals1;
+    std::vector<glm::vec3> vertices2;
+    std::vector<glm::vec3> normals2;
+    std::vector<glm::vec2> texcoords;
+    std::vector<GLuint> indices;
+
+    const SurfaceFillinParams kleinParams = kleinSurfaceParams();
+    const SurfaceFillinParams moebiusParams = moebiusSurfaceParams();
+
+    if (mode == SurfaceTessellation::Adaptive) {
+        const SurfaceDomain kleinDomain = surfaceDomain(kleinParams);
+        const SurfaceDomain moebiusDomain = surfaceDomain(moebiusParams);
+        const KleinSurface klein(kleinParams.aa, 0.5f);
+        const MoebiusSurface moebius(moebiusParams.aa, 0.5f);
+
+        // Обе поверхности замкнуты по v с отражением u -> -u, бутылка Клейна замкнута и по u.
+        AdaptiveTessellator::Settings settings;
+        settings.tolerance = tolerance;
+        settings.periodicS = true;
+        settings.periodicT = true;
+        settings.flipSAcrossT = true;
+
+        // Обе поверхности рисуются на одной топологии, поэтому ячейка делится, если неточна хотя бы одна из них.
+        // Промежуточные кадры морфинга - линейная смесь двух поверхностей, их ошибка не больше максимальной.
+        AdaptiveTessellator tessellator(settings);
+        tessellator.refine([&](float s0, float t0, float s1, float t1) {
+            return std::max(AdaptiveTessellator::chordalError(klein, kleinDomain, s0, t0, s1, t1),
+                            AdaptiveTessellator::chordalError(moebius, moebiusDomain, s0, t0, s1, t1));
+        });
+        tessellator.fillInTopology(texcoords, indices);
+        tessellator.fillInSurface(vertices1, normals1, klein, kleinDomain);
+        tessellator.fillInSurface(vertices2, normals2, moebius, moebiusDomain);
+
+        const AdaptiveTessellator::Stats& stats = tessellator.getStats();
+        std::cout << "Adaptive tessellation: " << stats.trianglesCount << " triangles (uniform " << gridSize << "x" << gridSize
+                  << " grid: " << 2 * ucnt * vcnt << "), " << stats.verticesCount << " vertices, built in " << stats.seconds * 1000.0 << " ms\n";
+        std::cout << "Max error against the uniform grid: klein " << tessellator.maxErrorAgainstGrid(vertices1, klein, kleinDomain, gridSize)
+                  << ", moebius " << tessellator.maxErrorAgainstGrid(vertices2, moebius, moebiusDomain, gridSize)
+                  << " (tolerance " << tolerance << ")\n";
+    }
+    else if (mode == SurfaceTessellation::UniformGrid) {
+        SurfaceTessellator tessellator(ucnt, vcnt, threadsCount);
+        tessellator.fillInTopology(texcoords, indices);
+        tessellator.fillInSurface(vertices1, normals1, KleinSurface(kleinParams.aa, 0.5f), surfaceDomain(kleinParams));
+        tessellator.fillInSurface(vertices2, normals2, MoebiusSurface(moebiusParams.aa, 0.5f), surfaceDomain(moebiusParams));
+
+        const SurfaceTessellator::Stats& stats = tessellator.getStats();
+        std::cout << "Tessellated " << stats.surfacesCount << " surfaces (" << stats.verticesCount << " vertices, "
+                  << stats.indicesCount << " indices) in " << stats.seconds * 1000.0 << " ms on "
+                  << tessellator.threadsCount() << " threads\n";
+    }
+    else {
+        fillInSurfaceAttributes(vertices1, normals1, texcoords, kleinParams);
+        fillInSurfaceAttributes(vertices2, normals2, texcoords, moebiusParams);
+    }
+
+    if (indexed) {
+        // Бутылка полупрозрачная и рисуется без сортировки треугольников, поэтому порядок кластеров не меняется.
+        IndexOptimizationSettings settings;
+        settings.overdraw = false;
 
-    DataBufferPtr buf4 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-    buf4->setData(texcoords.size() * sizeof(float) * 2, texcoords.data());
+        IndexOptimizationReport report = optimizeIndexedMesh(indices, vertices1, settings, normals1, vertices2, normals2, texcoords);
+        std::cout << "Klein bottle indices: " << report << "\n";
+    }
+
+    //----------------------------------------
 
     MeshPtr mesh = std::make_shared<Mesh>();
-    mesh->setAttribute(0, 3, GL_FLOAT, GL_FALSE, 0, 0, buf0);
-    mesh->setAttribute(1, 3, GL_FLOAT, GL_FALSE, 0, 0, buf1);
-    mesh->setAttribute(2, 3, GL_FLOAT, GL_FALSE, 0, 0, buf2);
-    mesh->setAttribute(3, 3, GL_FLOAT, GL_FALSE, 0, 0, buf3);
-    mesh->setAttribute(4, 2, GL_FLOAT, GL_FALSE, 0, 0, buf4);
+
+    if (format == VertexFormat::Quantized) {
+        const PositionQuantization quantization = PositionQuantization::fit({ &vertices1, &vertices2 });
+
+        VertexQuantizationReport report;
+        std::vector<QuantizedKleinVertex> packed(vertices1.size());
+        for (size_t i = 0; i < packed.size(); i++) {
+            packed[i].position1 = quantizePosition(vertices1[i], quantization, report);
+            packed[i].normal1 = packNormal(normals1[i], report);
+            packed[i].position2 = quantizePosition(vertices2[i], quantization, report);
+            packed[i].normal2 = packNormal(normals2[i], report);
+            packed[i].texcoord = packTexcoord(texcoords[i], report);
+        }
+
+        setVertexBuffer(*mesh, packed, streams);
+        mesh->setDequantizationMatrix(quantization.dequantizationMatrix());
+        mesh->setQuantizationReport(report);
+
+        std::cout << "Klein bottle: " << report << "\n";
+    }
+    else {
+        std::vector<KleinVertex> interleaved(vertices1.size());
+        for (size_t i = 0; i < interleaved.size(); i++) {
+            interleaved[i] = KleinVertex{ vertices1[i], normals1[i], vertices2[i], normals2[i], texcoords[i] };
+        }
+
+        setVertexBuffer(*mesh, interleaved, streams);
+    }
+
+    // Точка морфинга - выпуклая комбинация точек двух поверхностей, поэтому общие параллелепипед и сфера ограничивают все кадры.
+    computeBounds(*mesh, { &vertices1, &vertices2 });
+
     mesh->setPrimitiveType(GL_TRIANGLES);
     mesh->setVertexCount(vertices1.size());
 
-    std::cout << "Klein bottle is created with " << vertices1.size() << " vertices\n";
+    if (indexed) {
+        DataBufferPtr indexBuf = std::make_shared<DataBuffer>(GL_ELEMENT_ARRAY_BUFFER);
+        indexBuf->setData(indices.size() * sizeof(GLuint), indices.data());
+        mesh->setIndices(indices.size(), indexBuf);
+    }
+
+    std::cout << "Klein bottle is created with " << vertices1.size() << " vertices";
+    if (indexed) {
+        std::cout << " and " << indices.size() << " indices";
+    }
+    std::cout << "\n";
+
+    if (cache) {
+        cache->store(cacheKey.str(), *mesh);
+    }
 
     return mesh;
 }
 
+/**
+Радиус сферы с центром в начале координат, содержащей обе поверхности при любом кадре морфинга
+(точка морфинга - выпуклая комбинация точек поверхностей, поэтому достаточно максимума по обеим)
+*/
+float kleinBoundingRadius(float size, unsigned int samplesPerAxis = 64)
+{
+    const SurfaceFillinParams kleinParams = kleinSurfaceParams();
+    const SurfaceFillinParams moebiusParams = moebiusSurfaceParams();
+    const SurfaceDomain kleinDomain = surfaceDomain(kleinParams);
+    const SurfaceDomain moebiusDomain = surfaceDomain(moebiusParams);
+    const KleinSurface klein(kleinParams.aa, size);
+    const MoebiusSurface moebius(moebiusParams.aa, size);
+
+    float radius = 0.0f;
+    for (unsigned int i = 0; i <= samplesPerAxis; i++) {
+        for (unsigned int j = 0; j <= samplesPerAxis; j++) {
+            float s = (float)i / samplesPerAxis;
+            float t = (float)j / samplesPerAxis;
+
+            radius = std::max(radius, glm::length(klein.position(kleinDomain.umin + s * (kleinDomain.umax - kleinDomain.umin),
+                                                                 kleinDomain.vmin + t * (kleinDomain.vmax - kleinDomain.vmin))));
+            radius = std::max(radius, glm::length(moebius.position(moebiusDomain.umin + s * (moebiusDomain.umax - moebiusDomain.umin),
+                                                                   moebiusDomain.vmin + t * (moebiusDomain.vmax - moebiusDomain.vmin))));
+        }
+    }
+
+    // Запас на расстояние между узлами выборки.
+    return radius * 1.05f;
+}
+
+/**
+Цепочка уровней детализации бутылки Клейна: равномерные сетки от finestGridSize, каждая следующая вдвое грубее
+*/
+LodChainPtr makeKleinBottleLods(float size, VertexFormat format = VertexFormat::Float, VertexStreams streams = VertexStreams::Interleaved,
+                                const MeshCache* cache = nullptr, unsigned int finestGridSize = 1000, unsigned int coarsestGridSize = 32)
+{
+    LodChainPtr lods = std::make_shared<LodChain>(glm::vec3(0.0f), kleinBoundingRadius(size));
+    for (unsigned int gridSize = finestGridSize; gridSize >= coarsestGridSize; gridSize /= 2) {
+        lods->addLevel(makeKleinBottle(size, SurfaceTessellation::UniformGrid, 0, gridSize, 1e-4f, format, streams, cache), gridSize);
+    }
+    return lods;
+}
 
 class SampleApplication : public Application
 {
@@ -176,15 +375,114 @@ public:
 
     uint64_t frames;
 
+    ///Признаки шейдеров бутылки; выключенные части в вариант программы не компилируются (см. ShaderVariants)
+    bool morphism = true;
+    bool veins = true;
+    bool twoSidedLighting = true;
+
+    ///Вычислять поверхности в вершинном шейдере по gl_VertexID вместо вершинных буферов
+    bool gpuEvaluation = false;
+    int gpuGridSize = 1000;
+
+    ///Выбирать разрешение сетки по размеру бутылки на экране
+    bool distanceLod = true;
+
+    ///Формат вершин бутылки: сжатые атрибуты занимают 28 байт на вершину вместо 56 (см. VertexQuantization.hpp)
+    VertexFormat kleinVertexFormat = VertexFormat::Float;
+
+    ///Разбиение основной бутылки. Адаптивное дает меньше треугольников при той же хордовой ошибке
+    SurfaceTessellation kleinTessellation = SurfaceTessellation::UniformGrid;
+
+    ///Раскладка атрибутов бутылки в буферах (для сравнения производительности чередующихся и раздельных потоков)
+    VertexStreams kleinVertexStreams = VertexStreams::Interleaved;
+
+    ///Количество бутылок поля вокруг основной по каждой стороне (0 - поле не рисуется)
+    int fieldSize = 0;
+    static const int MAX_FIELD_SIZE = 16;
+
+    ///Отсекать бутылки поля и выбирать их уровни детализации вычислительным шейдером (см. GpuCuller)
+    bool gpuCulling = true;
+
+    ///Не рисовать объекты вне пирамиды видимости (отсечение на процессоре по _sceneBvh)
+    bool frustumCulling = true;
+
+    ///Рисовать загруженную из файла модель
+    bool showModel = true;
+
+    ///Выбирать упрощенный уровень модели по ее размеру на экране; иначе всегда рисуется исходный меш
+    bool modelLod = true;
+
+    ///Номера объектов в _sceneBvh: основная бутылка, маркер источника света, затем бутылки поля, которые рисуются без GpuCuller
+    enum SceneObject { KLEIN_OBJECT = 0, MARKER_OBJECT = 1, FIELD_FIRST_OBJECT = 2 };
+
+    ///Биты признаков шейдеров бутылки, по порядку имен в kleinFeatureNames
+    enum KleinFeature { KLEIN_MORPH = 1 << 0, KLEIN_VEINS = 1 << 1, KLEIN_TWO_SIDED = 1 << 2 };
+
     MeshPtr _kleinBottle;
+    MeshPtr _kleinProcedural; //Меш без атрибутов для klein_procedural.vert
+    MeshCachePtr _meshCache; //Кеш сгенерированных мешей между запусками
+    ProgramCachePtr _programCache; //Кеш двоичных образов шейдерных программ между запусками
+    LodChainPtr _kleinLods;
+    size_t _kleinLod = 0; //Текущий уровень детализации бутылки
+    float _kleinProjectedSize = 0.0f;
+
+    GeometryArenaPtr _kleinArena; //Все уровни детализации бутылки в общих буферах для рисования поля
+    std::vector<GeometryRange> _kleinArenaRanges;
+    std::vector<size_t> _fieldLods; //Текущие уровни детализации бутылок поля
+    StreamingBufferPtr _fieldStream; //Матрицы бутылок поля и команды непрямого рисования
+    GeometryDrawList _fieldDrawList;
+    GpuCullerPtr _fieldCuller;
+    int _fieldCullerSize = 0; //fieldSize, для которого загружены объекты _fieldCuller
+    bool _fieldCullerFailed = false; //программа отсечения не собралась: поле отсекается на процессоре
+    bool _validateFieldCulling = false;
+
+    SceneBvh _sceneBvh;
+    int _sceneBvhFieldSize = -1; //количество бутылок поля в _sceneBvh по каждой стороне (0, если поле рисуется через GpuCuller)
+    std::vector<size_t> _visibleObjects;
+    std::vector<bool> _objectVisible;
     MeshPtr _backgroundCube;
 
     MeshPtr _marker; //Меш - маркер для источника света
 
+    LodChainPtr _modelLods; //Модель из файла и ее упрощения; уровень рисуется видимыми кластерами через _modelCuller
+    size_t _modelLod = 0; //Текущий уровень детализации модели
+    MeshletCuller _modelCuller;
+
+    MeshRequestPtr _asyncModel; //Та же модель, загружаемая в фоне через _meshLoader; до загрузки рисуется сфера-заглушка
+    MeshletCuller _asyncModelCuller;
+
+    ImportedScenePtr _modelScene; //Та же модель, импортированная как сцена: все экземпляры рисуются одной командой из арены сцены
+    GeometryDrawList _modelSceneDrawList;
+    DataBufferPtr _modelSceneInstances; //InstanceTransform экземпляров сцены по порядку ImportedScene::instances
+
     //Идентификатор шейдерной программы
-    ShaderProgramPtr _commonShader;
+    ShaderVariantsPtr _kleinVariants;
+    ShaderVariantsPtr _kleinProceduralVariants;
+    ShaderVariantsPtr _kleinFieldVariants;
     ShaderProgramPtr _markerShader;
     ShaderProgramPtr _skyboxShader;
+    ShaderProgramPtr _modelShader;
+    ShaderProgramPtr _modelSceneShader;
+
+    //Юниформы программ бутылки, которые задаются при отрисовке: места определяются один раз для каждого собранного варианта.
+    //Переменных, которые вариант не использует, в программе нет, и их дескрипторы невалидны (значение тогда не задается)
+    struct KleinUniforms {
+        Uniform<int> diffuseTex;
+        Uniform<int> snakeSkinTex;
+        Uniform<glm::ivec2> gridSize;
+        Uniform<glm::vec4> kleinDomain;
+        Uniform<glm::vec4> moebiusDomain;
+        Uniform<float> aa;
+        Uniform<float> scaler;
+    };
+    std::unordered_map<ShaderProgramPtr, KleinUniforms> _kleinUniforms;
+
+    Uniform<glm::mat3> _skyboxTextureMatrix;
+    Uniform<int> _skyboxCubeTex;
+
+    FrameUniformsPtr _frameUniforms; //Блоки камеры, света и отрисовок текущего кадра
+    //Блоков объектов за кадр (см. addObject в draw): бутылка, поле, маркер, модель с уровнями детализации, загруженная модель и сцена
+    static const size_t MAX_FRAME_OBJECTS = 6;
 
     //Переменные для управления положением одного источника света
     float _lr = 10.0f;
@@ -200,28 +498,91 @@ public:
     GLuint _sampler;
     GLuint _cubeTexSampler;
 
+    RenderMaterialPtr _kleinMaterial; //Текстуры бутылок: прожилки на блоке 0, змеиная кожа на блоке 1
+    RenderMaterialPtr _skyboxMaterial;
+
+    RenderQueue _renderQueue;
+
     CameraInfo _camera2;
 
     void makeScene() override
     {
         Application::makeScene();
 
+#ifndef NDEBUG
+        //Пакетные функции поверхностей сверяются со скалярными один раз при запуске отладочной сборки
+        const SurfaceBatchAccuracy accuracy = checkSurfaceBatchAccuracy(129);
+        assert(accuracy.withinBudget());
+#endif
+
+        //=========================================================
+        //Инициализация шейдеров
+
+        //Программы загружаются из двоичных образов прошлого запуска, если тексты шейдеров и драйвер не изменились.
+        //Остальные собираются драйвером, пока создаются меши и текстуры, и забираются перед первым использованием
+        _programCache = std::make_shared<ProgramCache>("696SverdlovData2/cache");
+
+        ProgramBatch programs(_programCache.get());
+        _markerShader = programs.add("696SverdlovData2/shaders/marker.vert", "696SverdlovData2/shaders/marker.frag");
+        _skyboxShader = programs.add("696SverdlovData2/shaders/skybox.vert", "696SverdlovData2/shaders/skybox.frag");
+        _modelShader = programs.add("696SverdlovData2/shaders/model.vert", "696SverdlovData2/shaders/model.frag");
+        _modelSceneShader = programs.add("696SverdlovData2/shaders/model_instanced.vert", "696SverdlovData2/shaders/model.frag");
+
+        //Варианты бутылки собираются при первой отрисовке с новым набором признаков; начальный начинаем собирать сразу
+        const std::vector<std::string> kleinFeatureNames = { "KLEIN_MORPH", "KLEIN_VEINS", "KLEIN_TWO_SIDED" };
+        _kleinVariants = std::make_shared<ShaderVariants>("696SverdlovData2/shaders/klein.vert", "696SverdlovData2/shaders/klein.frag",
+                                                          kleinFeatureNames, _programCache.get());
+        _kleinProceduralVariants = std::make_shared<ShaderVariants>("696SverdlovData2/shaders/klein_procedural.vert", "696SverdlovData2/shaders/klein.frag",
+                                                                    kleinFeatureNames, _programCache.get());
+        _kleinFieldVariants = std::make_shared<ShaderVariants>("696SverdlovData2/shaders/klein_field.vert", "696SverdlovData2/shaders/klein.frag",
+                                                               kleinFeatureNames, _programCache.get());
+        _kleinVariants->prepare(kleinFeatures());
+
+#ifndef NDEBUG
+        //Отладочная сборка сразу собирает все варианты, чтобы ошибка в редком сочетании признаков не ждала его выбора в интерфейсе.
+        //Ошибки уже напечатаны; варианты, которые не собрались, просто не рисуются
+        for (const ShaderVariantsPtr& variants : { _kleinVariants, _kleinProceduralVariants, _kleinFieldVariants }) {
+            if (size_t failedCount = variants->buildAll()) {
+                std::cerr << failedCount << " Klein bottle shader variants failed to build\n";
+            }
+        }
+#endif
+
         //=========================================================
         //Создание и загрузка мешей		
 
-        _kleinBottle = makeKleinBottle(0.5f);
-        _kleinBottle->setModelMatrix(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f)));
+        _meshCache = std::make_shared<MeshCache>("696SverdlovData2/cache");
+
+        _kleinLods = makeKleinBottleLods(0.5f, kleinVertexFormat, kleinVertexStreams, _meshCache.get());
+        for (size_t i = 0; i < _kleinLods->levelsCount(); i++) {
+            _kleinLods->level(i).mesh->setModelMatrix(kleinModelMatrix());
+        }
+
+        _kleinProcedural = std::make_shared<Mesh>();
+        _kleinProcedural->setModelMatrix(kleinModelMatrix());
 
         _marker = makeSphere(0.1f);
 
-        _backgroundCube = makeCube(10.0f);
+        //Меш из файла упрощается один раз, дальше уровни берутся из кеша. Каждый уровень разбит на кластеры,
+        //и при отрисовке невидимые кластеры отбрасываются
+        _modelLods = loadLodChainFromFile("696SverdlovData2/models/torus_knot.obj", 0, { 0.5f, 0.25f, 0.125f }, VertexFormat::Float, _meshCache.get());
+        if (_modelLods) {
+            for (size_t i = 0; i < _modelLods->levelsCount(); i++) {
+                _modelLods->level(i).mesh->setModelMatrix(modelModelMatrix());
+            }
+        }
 
-        //=========================================================
-        //Инициализация шейдеров
+        //Копия модели читается в рабочем потоке и загружается в видеопамять порциями между кадрами
+        _asyncModel = _meshLoader->load("696SverdlovData2/models/torus_knot.obj", 0, VertexFormat::Float, makeSphere(3.0f));
 
-        _commonShader = std::make_shared<ShaderProgram>("696SverdlovData2/shaders/klein.vert", "696SverdlovData2/shaders/klein.frag");
-        _markerShader = std::make_shared<ShaderProgram>("696SverdlovData2/shaders/marker.vert", "696SverdlovData2/shaders/marker.frag");
-        _skyboxShader = std::make_shared<ShaderProgram>("696SverdlovData2/shaders/skybox.vert", "696SverdlovData2/shaders/skybox.frag");
+        //Экземпляры сцены выбирают свои матрицы через baseInstance, поэтому сцена рисуется только с OpenGL 4.2
+        if (GeometryDrawList::supportsBaseInstance()) {
+            makeModelScene();
+        }
+
+        _backgroundCube = makeCube(10.0f);
+
+        _frameUniforms = std::make_shared<FrameUniforms>(MAX_FRAME_OBJECTS);
 
         //=========================================================
         //Инициализация значений переменных освщения
@@ -251,6 +612,42 @@ public:
         glSamplerParameteri(_cubeTexSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glSamplerParameteri(_cubeTexSampler, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
+        _kleinMaterial = std::make_shared<RenderMaterial>();
+        _kleinMaterial->textures = { { 0, _veinsTex->target(), _veinsTex->texture(), _sampler },
+                                     { 1, _snakeSkinTex->target(), _snakeSkinTex->texture(), _sampler } };
+
+        _skyboxMaterial = std::make_shared<RenderMaterial>();
+        _skyboxMaterial->textures = { { 0, _cubeTex->target(), _cubeTex->texture(), _cubeTexSampler } };
+
+        //=========================================================
+        //Дожидаемся оставшихся программ. Объекты, программа которых не собралась, не рисуются
+        programs.wait();
+        for (const ShaderError& error : programs.errors()) {
+            std::cerr << error << std::endl;
+        }
+        if (!_markerShader->isLinked()) {
+            _markerShader.reset();
+        }
+        if (!_skyboxShader->isLinked()) {
+            _skyboxShader.reset();
+        }
+        if (!_modelShader->isLinked()) {
+            _modelShader.reset();
+        }
+        if (!_modelSceneShader->isLinked()) {
+            _modelSceneShader.reset();
+        }
+
+        const ProgramBatch::Stats& programStats = programs.getStats();
+        std::cout << "Programs: " << programStats.fromCache << " of " << programStats.submitted << " loaded from cache, "
+                  << "submit " << programStats.submitSeconds * 1000.0 << " ms, wait " << programStats.finishSeconds * 1000.0 << " ms"
+                  << (ProgramBatch::isParallelSupported() ? " (parallel compile)" : "") << "\n";
+
+        if (_skyboxShader) {
+            _skyboxTextureMatrix = _skyboxShader->uniform<glm::mat3>("textureMatrix");
+            _skyboxCubeTex = _skyboxShader->uniform<int>("cubeTex");
+        }
+
         //=========================================================
         //Инициализация 2й виртуальной камеры
 
@@ -271,6 +668,17 @@ public:
         {
             ImGui::Text("FPS %.1f", ImGui::GetIO().Framerate);
 
+            ImGui::Checkbox("frustum culling", &frustumCulling);
+            if (frustumCulling) {
+                const SceneBvh::Stats& stats = _sceneBvh.getStats();
+                ImGui::Text("drawn %d, culled %d (BVH: %d nodes, %d visited)", (int)stats.visibleCount, (int)stats.culledCount,
+                            (int)stats.nodesCount, (int)stats.nodesVisited);
+            }
+
+            const RenderQueue::Stats& queueStats = _renderQueue.getStats();
+            ImGui::Text("%d draws: %d program, %d texture, %d VAO switches", (int)queueStats.itemsCount,
+                        (int)queueStats.programSwitches, (int)queueStats.textureBinds, (int)queueStats.vaoSwitches);
+
             if (ImGui::CollapsingHeader("Light"))
             {
                 ImGui::ColorEdit3("ambient", glm::value_ptr(_light.ambient));
@@ -282,10 +690,81 @@ public:
                 ImGui::SliderFloat("theta", &_theta, 0.0f, glm::pi<float>());
             }
 
+            if (_modelShader && _modelLods && ImGui::CollapsingHeader("Model"))
+            {
+                ImGui::Checkbox("show model", &showModel);
+                ImGui::Checkbox("cone culling", &_modelCuller.coneCulling);
+                _asyncModelCuller.coneCulling = _modelCuller.coneCulling;
+                ImGui::Checkbox("model LOD", &modelLod);
+                ImGui::Text("LOD %d of %d, error %g", (int)_modelLod, (int)_modelLods->levelsCount(), _modelLods->level(_modelLod).error);
+
+                const MeshletCuller::Stats& stats = _modelCuller.getStats();
+                ImGui::Text("meshlets %d: %d outside frustum, %d back-facing", (int)stats.meshletsCount,
+                            (int)stats.frustumCulledCount, (int)stats.coneCulledCount);
+                ImGui::Text("triangles %d of %d in %d ranges", (int)stats.drawnTrianglesCount, (int)stats.trianglesCount,
+                            (int)stats.rangesCount);
+
+                const MeshLoader::Stats loaderStats = _meshLoader->getStats();
+                ImGui::Text("background copy: %s, %d KB uploaded", _asyncModel->ready() ? "loaded" : "loading",
+                            (int)(loaderStats.uploadedBytes / 1024));
+                if (_modelScene) {
+                    ImGui::Text("imported scene: %d meshes, %d instances in one draw", (int)_modelScene->meshes.size(),
+                                (int)_modelScene->instances.size());
+                }
+            }
+
             if (ImGui::CollapsingHeader("Klein Bottle"))
             {
-                ImGui::SliderFloat("vein pulse", &veinPulse, 0.0f, 0.1f);
-                ImGui::SliderFloat("morphism speed", &morphismSpeed, 0.0f, 0.1f);
+                ImGui::Checkbox("veins", &veins);
+                if (veins) {
+                    ImGui::SliderFloat("vein pulse", &veinPulse, 0.0f, 0.1f);
+                }
+                ImGui::Checkbox("morphism", &morphism);
+                if (morphism) {
+                    ImGui::SliderFloat("morphism speed", &morphismSpeed, 0.0f, 0.1f);
+                }
+                ImGui::Checkbox("two-sided lighting", &twoSidedLighting);
+
+                size_t variantsCount = 0;
+                double variantsSeconds = 0.0;
+                for (const ShaderVariantsPtr& variants : { _kleinVariants, _kleinProceduralVariants, _kleinFieldVariants }) {
+                    variantsCount += variants->getStats().variantsCount;
+                    variantsSeconds += variants->getStats().buildSeconds;
+                }
+                ImGui::Text("shader variants: %d built in %.1f ms", (int)variantsCount, variantsSeconds * 1000.0);
+
+                ImGui::Checkbox("GPU evaluation", &gpuEvaluation);
+                ImGui::Checkbox("distance LOD", &distanceLod);
+                if (distanceLod) {
+                    ImGui::Text("LOD %d: grid %u, %.0f px", (int)_kleinLod, _kleinLods->level(_kleinLod).detail, _kleinProjectedSize);
+                }
+                else if (gpuEvaluation) {
+                    ImGui::SliderInt("grid size", &gpuGridSize, 8, 2000);
+                }
+
+                if (GeometryDrawList::supportsBaseInstance()) {
+                    ImGui::SliderInt("field size", &fieldSize, 0, MAX_FIELD_SIZE);
+                    if (GpuCuller::isSupported() && !_fieldCullerFailed) {
+                        ImGui::Checkbox("GPU culling", &gpuCulling);
+                    }
+                    if (fieldSize > 0 && gpuCulling && _fieldCuller) {
+                        ImGui::Text("field: %d bottles culled on GPU", (int)_fieldCuller->objectsCount());
+                        if (ImGui::Button("validate culling")) {
+                            _validateFieldCulling = true;
+                        }
+                        const GpuCuller::Stats& stats = _fieldCuller->getStats();
+                        if (stats.validated) {
+                            ImGui::Text("visible %d, mismatches %d, not checked %d", (int)stats.visibleCount, (int)stats.mismatchesCount,
+                                        (int)stats.ambiguousCount);
+                        }
+                    }
+                    else if (fieldSize > 0) {
+                        ImGui::Text("field: %d bottles in one multi-draw", (int)_fieldDrawList.size());
+                    }
+                }
+                else {
+                    ImGui::Text("field of bottles requires OpenGL 4.2");
+                }
             }
 
         }
@@ -310,85 +789,519 @@ public:
 
     void drawSceneWithCamera(const CameraInfo& camera)
     {
-        //====== РИСУЕМ ФОН С КУБИЧЕСКОЙ ТЕКСТУРОЙ ======
-        {
-            _skyboxShader->use();
+        _light.position = glm::vec3(glm::cos(_phi) * glm::cos(_theta), glm::sin(_phi) * glm::cos(_theta), glm::sin(_theta)) * _lr;
+        cullScene(camera);
+
+        //Камера и источники света загружаются один раз за кадр и общие для всех программ.
+        //Положение света копируется уже в системе координат виртуальной камеры
+        LightsBlock lights;
+        lights.lights[0] = makeLightBlock(_light, camera.viewMatrix);
+        lights.lightsCount = 1;
+        _frameUniforms->beginFrame(makeCameraBlock(camera), lights);
+
+        //Отрисовки собираются в очередь и выполняются отсортированными по проходу, программе, текстурам и VAO
+        _renderQueue.clear();
+
+        //====== ФОН С КУБИЧЕСКОЙ ТЕКСТУРОЙ ======
+        if (_skyboxShader) {
+            _renderQueue.setProgramSetup(_skyboxShader, [this]() {
+                //Для преобразования координат в текстурные координаты нужна специальная матрица
+                glm::mat3 textureMatrix = glm::mat3(0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f);
+                _skyboxShader->set(_skyboxTextureMatrix, textureMatrix);
+                _skyboxShader->set(_skyboxCubeTex, 0);
+            });
+            _renderQueue.submit(RenderPass::Background, _skyboxShader, _skyboxMaterial, _backgroundCube->getVAO(), 0.0f,
+                                [this]() { _backgroundCube->drawBound(); });
+        }
 
-            glm::vec3 cameraPos = glm::vec3(glm::inverse(camera.viewMatrix)[3]); //Извлекаем из матрицы вида положение виртуальный камеры в мировой системе координат
+        //====== ОСНОВНЫЕ ОБЪЕКТЫ СЦЕНЫ ======
+        int gridSize = gpuGridSize;
+        MeshPtr kleinMesh = _kleinBottle;
 
-            _skyboxShader->setVec3Uniform("cameraPos", cameraPos);
-            _skyboxShader->setMat4Uniform("viewMatrix", camera.viewMatrix);
-            _skyboxShader->setMat4Uniform("projectionMatrix", camera.projMatrix);
+        if (distanceLod) {
+            int width, height;
+            glfwGetFramebufferSize(_window, &width, &height);
 
-            //Для преобразования координат в текстурные координаты нужна специальная матрица
-            glm::mat3 textureMatrix = glm::mat3(0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-            _skyboxShader->setMat3Uniform("textureMatrix", textureMatrix);
+            _kleinProjectedSize = _kleinLods->projectedSize(camera, kleinModelMatrix(), height);
+            const LodChain::Level& level = _kleinLods->level(_kleinLods->select(camera, kleinModelMatrix(), height, _kleinLod));
+            gridSize = level.detail;
+            kleinMesh = level.mesh;
+        }
+        else if (!gpuEvaluation && !_kleinBottle) {
+            makeKleinBottleMesh();
+            kleinMesh = _kleinBottle;
+        }
+
+        if (gpuEvaluation) {
+            kleinMesh = _kleinProcedural;
+        }
+
+        ShaderProgramPtr kleinShader = (gpuEvaluation ? _kleinProceduralVariants : _kleinVariants)->get(kleinFeatures());
+        KleinUniforms uniforms;
+        if (kleinShader) {
+            uniforms = kleinUniforms(kleinShader);
+            _renderQueue.setProgramSetup(kleinShader, [kleinShader, uniforms]() { setKleinSamplers(*kleinShader, uniforms); });
+        }
+
+        //Пишем в кольцевой буфер матрицы модели мешей; перед отрисовкой блок объекта только привязывается
+        if (_objectVisible[KLEIN_OBJECT] && kleinShader) {
+            ObjectBlock object = kleinObjectBlock();
+            //Деквантование позиций входит в матрицу модели, нормали преобразуются без него
+            object.modelMatrix = kleinMesh->modelMatrix() * kleinMesh->dequantizationMatrix();
+            object.setNormalToCameraMatrix(glm::transpose(glm::inverse(glm::mat3(camera.viewMatrix * kleinMesh->modelMatrix()))));
+            StreamingBuffer::Allocation objectBlock = _frameUniforms->addObject(object);
+            if (objectBlock.size > 0) {
+                _renderQueue.submit(RenderPass::Transparent, kleinShader, _kleinMaterial, kleinMesh->getVAO(),
+                                    RenderQueue::viewDepth(camera.viewMatrix, glm::vec3(kleinMesh->modelMatrix()[3])),
+                                    [this, kleinShader, uniforms, kleinMesh, gridSize, objectBlock]() {
+                    _frameUniforms->bindObject(objectBlock);
+
+                    if (gpuEvaluation) {
+                        setProceduralKleinUniforms(*kleinShader, uniforms, gridSize);
+                    }
+
+                    kleinMesh->drawBound();
+                });
+            }
+        }
 
-            glActiveTexture(GL_TEXTURE0);  //текстурный юнит 0            
-            glBindSampler(0, _cubeTexSampler);
-            _cubeTex->bind();
-            _skyboxShader->setIntUniform("cubeTex", 0);
+        submitKleinField(camera);
+
+        //Рисуем маркеры для всех источников света
+        if (_objectVisible[MARKER_OBJECT] && _markerShader) {
+            ObjectBlock object;
+            object.modelMatrix = markerModelMatrix();
+            object.color = glm::vec4(_light.diffuse, 1.0f);
+            StreamingBuffer::Allocation objectBlock = _frameUniforms->addObject(object);
+            if (objectBlock.size > 0) {
+                _renderQueue.submit(RenderPass::Opaque, _markerShader, nullptr, _marker->getVAO(),
+                                    RenderQueue::viewDepth(camera.viewMatrix, _light.position), [this, objectBlock]() {
+                    _frameUniforms->bindObject(objectBlock);
+                    _marker->drawBound();
+                });
+            }
+        }
 
-            glDepthMask(GL_FALSE); //Отключаем запись в буфер глубины
+        if (showModel && _modelShader && _modelLods) {
+            if (modelLod) {
+                int width, height;
+                glfwGetFramebufferSize(_window, &width, &height);
+                _modelLods->select(camera, modelModelMatrix(), height, _modelLod);
+            }
+            else {
+                _modelLod = 0;
+            }
+            submitModel(camera, _modelLods->level(_modelLod).mesh, glm::vec4(0.8f, 0.6f, 0.2f, 1.0f), _modelCuller);
+        }
 
-            _backgroundCube->draw();
+        if (showModel && _modelShader && _asyncModel->state() != MeshRequest::State::Failed) {
+            //Загруженный меш появляется вместо заглушки в processUploads, поэтому матрица модели задается каждый кадр
+            const MeshPtr& asyncModel = _asyncModel->mesh();
+            asyncModel->setModelMatrix(asyncModelModelMatrix());
+            submitModel(camera, asyncModel, glm::vec4(0.2f, 0.6f, 0.8f, 1.0f), _asyncModelCuller);
+        }
 
-            glDepthMask(GL_TRUE); //Включаем обратно запись в буфер глубины
+        if (showModel && _modelSceneShader && _modelScene) {
+            //Матрицы экземпляров приходят атрибутами, из блока отрисовки берется только цвет
+            ObjectBlock object;
+            object.color = glm::vec4(0.4f, 0.8f, 0.3f, 1.0f);
+            StreamingBuffer::Allocation objectBlock = _frameUniforms->addObject(object);
+            if (objectBlock.size > 0) {
+                _renderQueue.submit(RenderPass::Opaque, _modelSceneShader, nullptr, 0,
+                                    RenderQueue::viewDepth(camera.viewMatrix, glm::vec3(modelSceneModelMatrix()[3])), [this, objectBlock]() {
+                    _frameUniforms->bindObject(objectBlock);
+                    _modelSceneDrawList.draw(*_modelScene->arena);
+                });
+            }
         }
 
-        //====== РИСУЕМ ОСНОВНЫЕ ОБЪЕКТЫ СЦЕНЫ ======
-        _commonShader->use();
+        //Все блоки кадра записаны: без постоянного отображения они копируются в буфер одним вызовом
+        _frameUniforms->flush();
 
-        //Загружаем на видеокарту значения юниформ-переменных
-        _commonShader->setMat4Uniform("viewMatrix", camera.viewMatrix);
-        _commonShader->setMat4Uniform("projectionMatrix", camera.projMatrix);
+        //Очередь отвязывает сэмплеры и шейдерную программу после выполнения
+        _renderQueue.execute();
 
-        _light.position = glm::vec3(glm::cos(_phi) * glm::cos(_theta), glm::sin(_phi) * glm::cos(_theta), glm::sin(_theta)) * _lr;
-        glm::vec3 lightPosCamSpace = glm::vec3(camera.viewMatrix * glm::vec4(_light.position, 1.0));
+        _frameUniforms->endFrame();
+    }
 
-        _commonShader->setVec3Uniform("light.pos", lightPosCamSpace); //копируем положение уже в системе виртуальной камеры
-        _commonShader->setVec3Uniform("light.La", _light.ambient);
-        _commonShader->setVec3Uniform("light.Ld", _light.diffuse);
-        _commonShader->setVec3Uniform("light.Ls", _light.specular);
+    /**
+    Добавляет в очередь меш, загруженный из файла. Рисуются только видимые кластеры;
+    отсечение по конусам нормалей верно только с отбрасыванием задних граней, поэтому оно включается на время отрисовки
+    */
+    void submitModel(const CameraInfo& camera, const MeshPtr& mesh, const glm::vec4& color, MeshletCuller& culler) {
+        ObjectBlock object;
+        object.modelMatrix = mesh->modelMatrix() * mesh->dequantizationMatrix();
+        object.setNormalToCameraMatrix(glm::transpose(glm::inverse(glm::mat3(camera.viewMatrix * mesh->modelMatrix()))));
+        object.color = color;
+        StreamingBuffer::Allocation objectBlock = _frameUniforms->addObject(object);
+        if (objectBlock.size == 0) {
+            return;
+        }
 
-        // enable transparency
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        _renderQueue.submit(RenderPass::Opaque, _modelShader, nullptr, 0,
+                            RenderQueue::viewDepth(camera.viewMatrix, glm::vec3(mesh->modelMatrix()[3])),
+                            [this, camera, mesh, objectBlock, &culler]() {
+            _frameUniforms->bindObject(objectBlock);
 
-        glActiveTexture(GL_TEXTURE0);  //текстурный юнит 0        
-        glBindSampler(0, _sampler);
-        _veinsTex->bind();
-        _commonShader->setIntUniform("diffuseTex", 0);
+            glEnable(GL_CULL_FACE);
+            culler.draw(*mesh, camera);
+            glDisable(GL_CULL_FACE);
+        });
+    }
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindSampler(1, _sampler);
-        _snakeSkinTex->bind();
-        _commonShader->setIntUniform("snakeSkinTex", 1);
+    /**
+    Блок отрисовки с параметрами анимации бутылки (общими для основной бутылки и поля)
+    */
+    ObjectBlock kleinObjectBlock() const {
+        ObjectBlock object;
+        object.morphismAlpha = morphismAlphaForNow();
+        object.alphaScaler = veinAlphaForNow();
+        return object;
+    }
 
-        //Загружаем на видеокарту матрицы модели мешей и запускаем отрисовку
-        {
-            _commonShader->setMat4Uniform("modelMatrix", _kleinBottle->modelMatrix());
-            _commonShader->setMat3Uniform("normalToCameraMatrix", glm::transpose(glm::inverse(glm::mat3(camera.viewMatrix * _kleinBottle->modelMatrix()))));
-            _commonShader->setFloatUniform("alphaScaler", veinAlphaForNow());
-            _commonShader->setFloatUniform("morphismAlpha", morphismAlphaForNow());
+    glm::mat4 kleinModelMatrix() const {
+        return glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
+    }
 
-            _kleinBottle->draw();
+    glm::mat4 modelModelMatrix() const {
+        return glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(4.0f, 0.0f, 0.5f)), glm::vec3(0.25f));
+    }
+
+    glm::mat4 asyncModelModelMatrix() const {
+        return glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(-4.0f, 0.0f, 0.5f)), glm::vec3(0.25f));
+    }
+
+    glm::mat4 modelSceneModelMatrix() const {
+        return glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 4.0f, 0.5f)), glm::vec3(0.25f));
+    }
+
+    glm::mat4 markerModelMatrix() const {
+        return glm::translate(glm::mat4(1.0f), _light.position);
+    }
+
+    bool fieldCulledOnGpu() const {
+        return gpuCulling && GpuCuller::isSupported() && !_fieldCullerFailed;
+    }
+
+    /**
+    Обновляет объекты _sceneBvh и заполняет _objectVisible для камеры.
+    Поле перестраивает дерево только при изменении размера, движущиеся объекты лишь обновляют свои параллелепипеды
+    */
+    void cullScene(const CameraInfo& camera) {
+        const int bvhFieldSize = fieldCulledOnGpu() || !GeometryDrawList::supportsBaseInstance() ? 0 : fieldSize;
+
+        if (bvhFieldSize != _sceneBvhFieldSize) {
+            const MeshPtr& kleinMesh = _kleinLods->level(0).mesh;
+
+            _sceneBvh.clear();
+            _sceneBvh.add(kleinMesh->boundsMin(), kleinMesh->boundsMax(), kleinModelMatrix());
+            _sceneBvh.add(_marker->boundsMin(), _marker->boundsMax(), markerModelMatrix());
+
+            _sceneBvhFieldSize = bvhFieldSize;
+            if (bvhFieldSize > 0) {
+                for (const glm::mat4& modelMatrix : fieldModelMatrices()) {
+                    _sceneBvh.add(kleinMesh->boundsMin(), kleinMesh->boundsMax(), modelMatrix);
+                }
+            }
+        }
+        else {
+            _sceneBvh.setModelMatrix(KLEIN_OBJECT, kleinModelMatrix());
+            _sceneBvh.setModelMatrix(MARKER_OBJECT, markerModelMatrix());
+        }
+
+        if (!frustumCulling) {
+            _objectVisible.assign(_sceneBvh.size(), true);
+            return;
         }
 
-        glDisable(GL_BLEND);
+        _sceneBvh.cull(Frustum::fromCamera(camera), _visibleObjects);
 
-        //Рисуем маркеры для всех источников света		
-        {
-            _markerShader->use();
+        _objectVisible.assign(_sceneBvh.size(), false);
+        for (size_t object : _visibleObjects) {
+            _objectVisible[object] = true;
+        }
+    }
+
+    /**
+    Добавляет в очередь fieldSize x fieldSize бутылок вокруг основной, которые рисуются одной командой из _kleinArena.
+    Каждая бутылка выбирает свой уровень детализации: на видеокарте через GpuCuller (с отсечением невидимых)
+    или на процессоре, тогда матрицы пишутся в кольцевой буфер. В обоих случаях данные бутылки выбираются по baseInstance.
+    Отсечение и заполнение буферов идут сразу, до выполнения очереди: они меняют программу и VAO
+    */
+    void submitKleinField(const CameraInfo& camera) {
+        if (fieldSize <= 0 || !GeometryDrawList::supportsBaseInstance()) {
+            return;
+        }
+
+        if (!_kleinArena) {
+            makeKleinArena();
+            if (!_kleinArena) {
+                fieldSize = 0;
+                return;
+            }
+        }
+
+        int width, height;
+        glfwGetFramebufferSize(_window, &width, &height);
+
+        if (fieldCulledOnGpu()) {
+            if (!_fieldCuller) {
+                _fieldCuller = std::make_shared<GpuCuller>("696SverdlovData2/shaders/cull.comp", *_kleinLods, _kleinArenaRanges, _programCache.get());
+                if (!_fieldCuller->isValid()) {
+                    //Ошибка уже сообщена; объекты поля в _sceneBvh появятся со следующего кадра
+                    _fieldCuller.reset();
+                    _fieldCullerFailed = true;
+                    return;
+                }
+            }
+            if (_fieldCullerSize != fieldSize) {
+                _fieldCuller->setObjects(fieldModelMatrices());
+                _fieldCullerSize = fieldSize;
+            }
+
+            if (_validateFieldCulling) {
+                size_t mismatches = _fieldCuller->validate(camera, height);
+                std::cout << "GPU culling: " << _fieldCuller->getStats().visibleCount << " of " << _fieldCuller->objectsCount()
+                          << " bottles visible, " << mismatches << " mismatches with the CPU reference, "
+                          << _fieldCuller->getStats().ambiguousCount << " on a boundary not checked\n";
+                _validateFieldCulling = false;
+            }
+            else {
+                _fieldCuller->cull(camera, height);
+            }
+
+            setInstanceAttributes(*_kleinArena, _fieldCuller->instanceBuffer(), 0);
+            submitKleinFieldDraw(camera, [this]() { _fieldCuller->draw(*_kleinArena); });
+            return;
+        }
+
+        const std::vector<glm::mat4> modelMatrices = fieldModelMatrices();
+        _fieldLods.resize(modelMatrices.size(), 0);
+
+        _fieldStream->beginFrame();
+
+        StreamingBuffer::Allocation allocation = _fieldStream->allocate(modelMatrices.size() * sizeof(InstanceTransform));
+        if (!allocation.data) {
+            _fieldStream->endFrame();
+            return;
+        }
+
+        InstanceTransform* instances = static_cast<InstanceTransform*>(allocation.data);
+
+        _fieldDrawList.clear();
+        for (size_t k = 0; k < modelMatrices.size(); k++) {
+            if (!_objectVisible[FIELD_FIRST_OBJECT + k]) {
+                continue;
+            }
+
+            size_t level = _kleinLods->select(camera, modelMatrices[k], height, _fieldLods[k]);
+
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrices[k])));
+            instances[k].modelMatrix = modelMatrices[k] * _kleinLods->level(level).mesh->dequantizationMatrix();
+            for (int c = 0; c < 3; c++) {
+                instances[k].normalMatrix[c] = glm::vec4(normalMatrix[c], 0.0f);
+            }
+
+            _fieldDrawList.add(_kleinArenaRanges[level], static_cast<GLuint>(k));
+        }
+
+        // Атрибуты экземпляров указывают на регион текущего кадра. Кадр кольцевого буфера заканчивается после отрисовки,
+        // которая читает и команды из него.
+        setInstanceAttributes(*_kleinArena, _fieldStream->buffer(), allocation.offset);
+        const bool submitted = submitKleinFieldDraw(camera, [this]() {
+            _fieldDrawList.draw(*_kleinArena, _fieldStream.get());
+            _fieldStream->endFrame();
+        });
+        if (!submitted) {
+            _fieldStream->endFrame();
+        }
+    }
 
-            _markerShader->setMat4Uniform("mvpMatrix", camera.projMatrix * camera.viewMatrix * glm::translate(glm::mat4(1.0f), _light.position));
-            _markerShader->setVec4Uniform("color", glm::vec4(_light.diffuse, 1.0f));
-            _marker->draw();
+    /**
+    Матрицы моделей бутылок поля. Место в центре поля нечетного размера занято основной бутылкой
+    */
+    std::vector<glm::mat4> fieldModelMatrices() const {
+        const float spacing = 6.0f;
+
+        std::vector<glm::mat4> modelMatrices;
+        for (int i = 0; i < fieldSize; i++) {
+            for (int j = 0; j < fieldSize; j++) {
+                if (2 * i == fieldSize - 1 && 2 * j == fieldSize - 1) {
+                    continue;
+                }
+                glm::vec3 position((i - 0.5f * (fieldSize - 1)) * spacing, (j - 0.5f * (fieldSize - 1)) * spacing, 0.0f);
+                modelMatrices.push_back(glm::translate(glm::mat4(1.0f), position));
+            }
+        }
+        return modelMatrices;
+    }
+
+    /**
+    Направляет атрибуты экземпляра 5-11 арены на массив InstanceTransform в buffer
+    */
+    static void setInstanceAttributes(const GeometryArena& arena, const DataBufferPtr& buffer, GLintptr offset) {
+        const MeshPtr& arenaMesh = arena.mesh();
+        for (GLuint c = 0; c < 4; c++) {
+            arenaMesh->setAttribute(5 + c, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), offset + c * sizeof(glm::vec4), buffer);
+            arenaMesh->setAttributeDivisor(5 + c, 1);
+        }
+        for (GLuint c = 0; c < 3; c++) {
+            arenaMesh->setAttribute(9 + c, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), offset + sizeof(glm::mat4) + c * sizeof(glm::vec4), buffer);
+            arenaMesh->setAttributeDivisor(9 + c, 1);
+        }
+    }
+
+    /**
+    Добавляет в очередь отрисовку поля; draw сама привязывает VAO арены.
+    \return false, если отрисовка пропущена (нет программы или места для блока объекта)
+    */
+    bool submitKleinFieldDraw(const CameraInfo& camera, RenderQueue::DrawFunction draw) {
+        ShaderProgramPtr fieldShader = _kleinFieldVariants->get(kleinFeatures());
+        if (!fieldShader) {
+            return false;
         }
 
-        //Отсоединяем сэмплер и шейдерную программу
-        glBindSampler(0, 0);
-        glUseProgram(0);
+        StreamingBuffer::Allocation objectBlock = _frameUniforms->addObject(kleinObjectBlock());
+        if (objectBlock.size == 0) {
+            return false;
+        }
+
+        const KleinUniforms uniforms = kleinUniforms(fieldShader);
+        _renderQueue.setProgramSetup(fieldShader, [fieldShader, uniforms]() { setKleinSamplers(*fieldShader, uniforms); });
+        _renderQueue.submit(RenderPass::Transparent, fieldShader, _kleinMaterial, 0,
+                            RenderQueue::viewDepth(camera.viewMatrix, glm::vec3(0.0f)), [this, objectBlock, draw]() {
+            _frameUniforms->bindObject(objectBlock);
+            draw();
+        });
+        return true;
+    }
+
+    /**
+    Копирует все уровни детализации бутылки в общую арену (на видеокарте, без чтения на процессор)
+    */
+    void makeKleinArena() {
+        GLuint verticesCount = 0;
+        GLuint indicesCount = 0;
+        for (size_t i = 0; i < _kleinLods->levelsCount(); i++) {
+            verticesCount += _kleinLods->level(i).mesh->getVertexCount();
+            indicesCount += _kleinLods->level(i).mesh->getIndicesCount();
+        }
+
+        if (kleinVertexFormat == VertexFormat::Quantized) {
+            _kleinArena = GeometryArena::create<QuantizedKleinVertex>(verticesCount, indicesCount);
+        }
+        else {
+            _kleinArena = GeometryArena::create<KleinVertex>(verticesCount, indicesCount);
+        }
+
+        _kleinArenaRanges.resize(_kleinLods->levelsCount());
+        for (size_t i = 0; i < _kleinLods->levelsCount(); i++) {
+            if (!_kleinArena->addMesh(*_kleinLods->level(i).mesh, _kleinArenaRanges[i])) {
+                std::cerr << "Failed to put Klein bottle LOD " << i << " into the geometry arena\n";
+                _kleinArena.reset();
+                return;
+            }
+        }
+
+        const size_t maxInstances = static_cast<size_t>(MAX_FIELD_SIZE) * MAX_FIELD_SIZE;
+        _fieldStream = std::make_shared<StreamingBuffer>(GL_ARRAY_BUFFER, maxInstances * (sizeof(InstanceTransform) + sizeof(GeometryDrawList::Command)) + 64);
+
+        const GeometryArena::Stats& stats = _kleinArena->getStats();
+        std::cout << "Geometry arena: " << stats.meshesCount << " meshes, " << stats.verticesCount << " vertices, "
+                  << stats.indicesCount << " indices, " << stats.bytesReserved << " bytes\n";
+    }
+
+    /**
+    Импортирует модель как сцену в собственную арену. Матрицы экземпляров не меняются, поэтому пишутся в буфер один раз
+    */
+    void makeModelScene() {
+        _modelScene = loadScene("696SverdlovData2/models/torus_knot.obj");
+        if (!_modelScene) {
+            return;
+        }
+
+        std::vector<InstanceTransform> instances(_modelScene->instances.size());
+        for (size_t i = 0; i < instances.size(); i++) {
+            const SceneInstance& instance = _modelScene->instances[i];
+            const glm::mat4 modelMatrix = modelSceneModelMatrix() * instance.modelMatrix;
+
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
+            instances[i].modelMatrix = modelMatrix * _modelScene->meshes[instance.meshIndex].dequantizationMatrix;
+            for (int c = 0; c < 3; c++) {
+                instances[i].normalMatrix[c] = glm::vec4(normalMatrix[c], 0.0f);
+            }
+        }
+
+        _modelSceneInstances = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
+        _modelSceneInstances->setData(instances.size() * sizeof(InstanceTransform), instances.data());
+        setInstanceAttributes(*_modelScene->arena, _modelSceneInstances, 0);
+
+        _modelScene->addToDrawList(_modelSceneDrawList);
+    }
+
+    void makeKleinBottleMesh() {
+        _kleinBottle = makeKleinBottle(0.5f, kleinTessellation, 0, 1000, 1e-4f, kleinVertexFormat, kleinVertexStreams, _meshCache.get());
+        _kleinBottle->setModelMatrix(kleinModelMatrix());
+    }
+
+    /**
+    Параметры поверхностей для klein_procedural.vert. Разрешение сетки - просто юниформ и количество вершин в glDrawArrays.
+    */
+    void setProceduralKleinUniforms(const ShaderProgram& program, const KleinUniforms& uniforms, int gridSize) {
+        const SurfaceDomain klein = surfaceDomain(kleinSurfaceParams());
+        const SurfaceDomain moebius = surfaceDomain(moebiusSurfaceParams());
+
+        program.set(uniforms.gridSize, glm::ivec2(gridSize, gridSize));
+        program.set(uniforms.kleinDomain, glm::vec4(klein.umin, klein.umax, klein.vmin, klein.vmax));
+        if (uniforms.moebiusDomain.valid()) {
+            program.set(uniforms.moebiusDomain, glm::vec4(moebius.umin, moebius.umax, moebius.vmin, moebius.vmax));
+        }
+        program.set(uniforms.aa, kleinSurfaceParams().aa);
+        program.set(uniforms.scaler, 0.5f);
+
+        _kleinProcedural->setVertexCount(6 * gridSize * gridSize);
+    }
+
+    uint32_t kleinFeatures() const {
+        return (morphism ? KLEIN_MORPH : 0) | (veins ? KLEIN_VEINS : 0) | (twoSidedLighting ? KLEIN_TWO_SIDED : 0);
+    }
+
+    /**
+    Дескрипторы юниформов варианта программы бутылки. Ищутся по именам только при первом обращении к варианту
+    */
+    const KleinUniforms& kleinUniforms(const ShaderProgramPtr& program) {
+        auto found = _kleinUniforms.find(program);
+        if (found != _kleinUniforms.end()) {
+            return found->second;
+        }
+
+        KleinUniforms& uniforms = _kleinUniforms[program];
+        uniforms.diffuseTex = optionalUniform<int>(*program, "diffuseTex");
+        uniforms.snakeSkinTex = program->uniform<int>("snakeSkinTex");
+        uniforms.gridSize = optionalUniform<glm::ivec2>(*program, "gridSize");
+        uniforms.kleinDomain = optionalUniform<glm::vec4>(*program, "kleinDomain");
+        uniforms.moebiusDomain = optionalUniform<glm::vec4>(*program, "moebiusDomain");
+        uniforms.aa = optionalUniform<float>(*program, "aa");
+        uniforms.scaler = optionalUniform<float>(*program, "scaler");
+        return uniforms;
+    }
+
+    /**
+    Дескриптор переменной, которой может не быть в варианте программы (без сообщения об ошибке)
+    */
+    template <class T>
+    static Uniform<T> optionalUniform(const ShaderProgram& program, const std::string& name) {
+        return program.hasUniform(name) ? program.uniform<T>(name) : Uniform<T>();
+    }
+
+    /**
+    Текстурные блоки материала бутылки. Вариант без прожилок не использует diffuseTex, и компилятор ее убирает
+    */
+    static void setKleinSamplers(const ShaderProgram& program, const KleinUniforms& uniforms) {
+        if (uniforms.diffuseTex.valid()) {
+            program.set(uniforms.diffuseTex, 0);
+        }
+        program.set(uniforms.snakeSkinTex, 1);
     }
 
     float veinAlphaForNow() const {
@@ -0,0 +1,292 @@
+#include "AdaptiveTessellator.hpp"
+
+#include <chrono>
+
+AdaptiveTessellator::AdaptiveTessellator(const Settings& settings) :
+    _settings(settings),
+    _resolution(static_cast<int32_t>(settings.baseCells) << settings.maxLevel)
+{
+}
+
+void AdaptiveTessellator::refine(const CellError& cellError)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    _cells.clear();
+    _vertexParams.clear();
+    _vertexByKey.clear();
+    _indices.clear();
+
+    const int32_t rootSize = 1 << _settings.maxLevel;
+    for (unsigned int i = 0; i < _settings.baseCells; i++) {
+        for (unsigned int j = 0; j < _settings.baseCells; j++) {
+            _cells.emplace_back(i * rootSize, j * rootSize, rootSize);
+        }
+    }
+
+    const float scale = 1.0f / _resolution;
+
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < _cells.size(); i++) {
+        pending.push_back(i);
+    }
+
+    while (!pending.empty()) {
+        size_t index = pending.back();
+        pending.pop_back();
+
+        const Cell cell = _cells[index];
+        if (cell.size == 1) {
+            continue;
+        }
+
+        float error = cellError(cell.x * scale, cell.y * scale, (cell.x + cell.size) * scale, (cell.y + cell.size) * scale);
+        if (error * _settings.errorMargin > _settings.tolerance) {
+            split(index);
+            for (int32_t k = 0; k < 4; k++) {
+                pending.push_back(_cells[index].firstChild + k);
+            }
+        }
+    }
+
+    balance();
+    triangulate();
+
+    _stats.leavesCount = 0;
+    for (const Cell& cell : _cells) {
+        _stats.leavesCount += cell.isLeaf() ? 1 : 0;
+    }
+    _stats.verticesCount = _vertexParams.size();
+    _stats.trianglesCount = _indices.size() / 3;
+    _stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void AdaptiveTessellator::fillInTopology(std::vector<glm::vec2>& texcoords, std::vector<GLuint>& indices) const
+{
+    texcoords = _vertexParams;
+    indices = _indices;
+}
+
+void AdaptiveTessellator::split(size_t cellIndex)
+{
+    const Cell cell = _cells[cellIndex];
+    const int32_t half = cell.size / 2;
+
+    // Порядок детей согласован с findLeaf: +2 при сдвиге по x, +1 при сдвиге по y.
+    _cells[cellIndex].firstChild = static_cast<int32_t>(_cells.size());
+    _cells.emplace_back(cell.x, cell.y, half);
+    _cells.emplace_back(cell.x, cell.y + half, half);
+    _cells.emplace_back(cell.x + half, cell.y, half);
+    _cells.emplace_back(cell.x + half, cell.y + half, half);
+}
+
+int32_t AdaptiveTessellator::findLeaf(int32_t x, int32_t y) const
+{
+    if (x < 0 || y < 0 || x >= _resolution || y >= _resolution) {
+        return -1;
+    }
+
+    const int32_t rootSize = 1 << _settings.maxLevel;
+    int32_t index = (x / rootSize) * static_cast<int32_t>(_settings.baseCells) + y / rootSize;
+
+    while (!_cells[index].isLeaf()) {
+        const Cell& cell = _cells[index];
+        const int32_t half = cell.size / 2;
+        index = cell.firstChild + (x >= cell.x + half ? 2 : 0) + (y >= cell.y + half ? 1 : 0);
+    }
+    return index;
+}
+
+size_t AdaptiveTessellator::neighbourProbes(const Cell& cell, int32_t probes[6][2], int32_t requiredSize[6]) const
+{
+    // Более крупный сосед целиком покрывает сторону, поэтому достаточно одной пробной точки за каждой стороной.
+    const int32_t inner[4][2] = {
+        { cell.x - 1, cell.y },
+        { cell.x + cell.size, cell.y },
+        { cell.x, cell.y - 1 },
+        { cell.x, cell.y + cell.size },
+    };
+
+    size_t count = 0;
+    for (const auto& probe : inner) {
+        probes[count][0] = probe[0];
+        probes[count][1] = probe[1];
+        requiredSize[count] = 2 * cell.size;
+        count++;
+    }
+
+    // На шве висячих вершин нет (с другой стороны шва внутри области соседа нет), поэтому вершины шва совпадают,
+    // только если листья напротив имеют тот же размер. Квадродерево выровнено, и отражение s -> 1 - s переводит ячейку в ячейку.
+    const int32_t last = _resolution - 1;
+    if (_settings.periodicS) {
+        if (cell.x == 0) {
+            probes[count][0] = last;
+            probes[count][1] = cell.y;
+            requiredSize[count++] = cell.size;
+        }
+        if (cell.x + cell.size == _resolution) {
+            probes[count][0] = 0;
+            probes[count][1] = cell.y;
+            requiredSize[count++] = cell.size;
+        }
+    }
+    if (_settings.periodicT) {
+        const int32_t x = _settings.flipSAcrossT ? _resolution - cell.x - cell.size : cell.x;
+        if (cell.y == 0) {
+            probes[count][0] = x;
+            probes[count][1] = last;
+            requiredSize[count++] = cell.size;
+        }
+        if (cell.y + cell.size == _resolution) {
+            probes[count][0] = x;
+            probes[count][1] = 0;
+            requiredSize[count++] = cell.size;
+        }
+    }
+    return count;
+}
+
+void AdaptiveTessellator::balance()
+{
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < _cells.size(); i++) {
+        if (_cells[i].isLeaf()) {
+            pending.push_back(i);
+        }
+    }
+
+    while (!pending.empty()) {
+        size_t index = pending.back();
+        pending.pop_back();
+
+        if (!_cells[index].isLeaf()) {
+            continue;
+        }
+
+        const Cell cell = _cells[index];
+
+        int32_t probes[6][2];
+        int32_t requiredSize[6];
+        const size_t probesCount = neighbourProbes(cell, probes, requiredSize);
+
+        for (size_t i = 0; i < probesCount; i++) {
+            int32_t neighbour = findLeaf(probes[i][0], probes[i][1]);
+            if (neighbour >= 0 && _cells[neighbour].size > requiredSize[i]) {
+                split(neighbour);
+                for (int32_t k = 0; k < 4; k++) {
+                    pending.push_back(_cells[neighbour].firstChild + k);
+                }
+                pending.push_back(index);
+            }
+        }
+    }
+}
+
+GLuint AdaptiveTessellator::vertexAt(int32_t x, int32_t y)
+{
+    auto inserted = _vertexByKey.insert(std::make_pair(vertexKey(x, y), static_cast<GLuint>(_vertexParams.size())));
+    if (inserted.second) {
+        _vertexParams.emplace_back((float)x / _resolution, (float)y / _resolution);
+    }
+    return inserted.first->second;
+}
+
+void AdaptiveTessellator::triangulate()
+{
+    // Сначала регистрируем углы всех листьев: по ним определяется, есть ли на стороне ячейки висячая вершина.
+    for (const Cell& cell : _cells) {
+        if (cell.isLeaf()) {
+            vertexAt(cell.x, cell.y);
+            vertexAt(cell.x, cell.y + cell.size);
+            vertexAt(cell.x + cell.size, cell.y);
+            vertexAt(cell.x + cell.size, cell.y + cell.size);
+        }
+    }
+
+    for (Cell& cell : _cells) {
+        if (!cell.isLeaf()) {
+            continue;
+        }
+
+        cell.firstIndex = static_cast<GLuint>(_indices.size());
+
+        const int32_t x0 = cell.x, y0 = cell.y;
+        const int32_t x1 = cell.x + cell.size, y1 = cell.y + cell.size;
+        const int32_t half = cell.size / 2;
+
+        GLuint aa = vertexAt(x0, y0);
+        GLuint ab = vertexAt(x0, y1);
+        GLuint ba = vertexAt(x1, y0);
+        GLuint bb = vertexAt(x1, y1);
+
+        // Обход границы в том же направлении, что и треугольники равномерной сетки.
+        std::vector<GLuint> ring;
+        ring.push_back(aa);
+        if (half > 0 && hasVertex(x0, y0 + half)) ring.push_back(vertexAt(x0, y0 + half));
+        ring.push_back(ab);
+        if (half > 0 && hasVertex(x0 + half, y1)) ring.push_back(vertexAt(x0 + half, y1));
+        ring.push_back(bb);
+        if (half > 0 && hasVertex(x1, y0 + half)) ring.push_back(vertexAt(x1, y0 + half));
+        ring.push_back(ba);
+        if (half > 0 && hasVertex(x0 + half, y0)) ring.push_back(vertexAt(x0 + half, y0));
+
+        if (ring.size() == 4) {
+            // upper-left triangle
+            _indices.push_back(aa);
+            _indices.push_back(ab);
+            _indices.push_back(ba);
+
+            // lower-right triangle
+            _indices.push_back(bb);
+            _indices.push_back(ba);
+            _indices.push_back(ab);
+        }
+        else {
+            GLuint center = vertexAt(x0 + half, y0 + half);
+            for (size_t i = 0; i < ring.size(); i++) {
+                _indices.push_back(center);
+                _indices.push_back(ring[i]);
+                _indices.push_back(ring[(i + 1) % ring.size()]);
+            }
+        }
+
+        cell.indicesCount = static_cast<GLuint>(_indices.size()) - cell.firstIndex;
+    }
+}
+
+bool AdaptiveTessellator::locate(float s, float t, GLuint corners[3], glm::vec3& weights) const
+{
+    int32_t x = std::min(static_cast<int32_t>(s * _resolution), _resolution - 1);
+    int32_t y = std::min(static_cast<int32_t>(t * _resolution), _resolution - 1);
+
+    int32_t leaf = findLeaf(x, y);
+    if (leaf < 0) {
+        return false;
+    }
+
+    const Cell& cell = _cells[leaf];
+    const glm::vec2 p(s, t);
+
+    float bestMinWeight = -1e30f;
+    for (GLuint i = cell.firstIndex; i < cell.firstIndex + cell.indicesCount; i += 3) {
+        const glm::vec2& a = _vertexParams[_indices[i]];
+        const glm::vec2& b = _vertexParams[_indices[i + 1]];
+        const glm::vec2& c = _vertexParams[_indices[i + 2]];
+
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        float wb = ((p.x - a.x) * (c.y - a.y) - (p.y - a.y) * (c.x - a.x)) / area;
+        float wc = ((b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x)) / area;
+        glm::vec3 w(1.0f - wb - wc, wb, wc);
+
+        // Точки на общих сторонах могут попасть в несколько треугольников - берем тот, где точка глубже всего внутри.
+        float minWeight = std::min(w.x, std::min(w.y, w.z));
+        if (minWeight > bestMinWeight) {
+            bestMinWeight = minWeight;
+            weights = w;
+            corners[0] = _indices[i];
+            corners[1] = _indices[i + 1];
+            corners[2] = _indices[i + 2];
+        }
+    }
+    return cell.indicesCount > 0;
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "SurfaceTessellator.hpp"
+
+/**
+Адаптивное разбиение области параметров (u, v) по оценке хордовой ошибки.
+Область нормируется в квадрат [0, 1] x [0, 1] и покрывается сеткой baseCells x baseCells ячеек,
+каждая из которых делится на 4 (квадродерево), пока ошибка ячейки больше tolerance и не достигнут maxLevel.
+Соседние листья отличаются по уровню не более чем на 1, поэтому на стороне ячейки бывает не больше одной
+"висячей" вершины; такие ячейки триангулируются веером из центра, и сетка получается без трещин.
+Если стороны области склеены (Settings::periodicS, periodicT), листья по обе стороны шва делятся одинаково,
+поэтому вершины шва совпадают и на нем тоже нет трещин.
+Топология (текстурные координаты и индексы) общая для всех поверхностей, вычисленных на этом разбиении.
+*/
+class AdaptiveTessellator
+{
+public:
+    struct Settings {
+        unsigned int baseCells = 16;
+        unsigned int maxLevel = 6;
+
+        ///Допустимая хордовая ошибка в единицах координат модели
+        float tolerance = 1e-4f;
+
+        ///Запас оценки ошибки: ячейка делится, если оценка, умноженная на запас, больше tolerance.
+        ///Оценка считается в конечном числе точек и может пропустить изгиб между ними
+        float errorMargin = 1.5f;
+
+        ///Стороны s = 0 и s = 1 склеены
+        bool periodicS = false;
+
+        ///Стороны t = 0 и t = 1 склеены
+        bool periodicT = false;
+
+        ///Шов по t склеивает точку s с точкой 1 - s (бутылка Клейна, лента Мебиуса)
+        bool flipSAcrossT = false;
+    };
+
+    struct Stats {
+        size_t leavesCount = 0;
+        size_t verticesCount = 0;
+        size_t trianglesCount = 0;
+        double seconds = 0.0;
+    };
+
+    /**
+    Оценка ошибки ячейки [s0, s1] x [t0, t1] нормированной области параметров
+    */
+    typedef std::function<float(float s0, float t0, float s1, float t1)> CellError;
+
+    explicit AdaptiveTessellator(const Settings& settings);
+
+    /**
+    Строит разбиение: делит ячейки, пока cellError больше допуска, выравнивает уровни соседей и триангулирует листья
+    */
+    void refine(const CellError& cellError);
+
+    /**
+    Текстурные координаты вершин (совпадают с нормированными параметрами) и индексы треугольников
+    */
+    void fillInTopology(std::vector<glm::vec2>& texcoords, std::vector<GLuint>& indices) const;
+
+    /**
+    Вычисляет позиции и аналитические нормали поверхности (см. SurfaceTessellator::fillInSurface) в вершинах разбиения
+    */
+    template <class Surface>
+    void fillInSurface(std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, const Surface& surface, const SurfaceDomain& domain) const;
+
+    /**
+    Максимальное отклонение построенной сетки от плотной равномерной сетки samplesPerAxis x samplesPerAxis узлов:
+    в каждом узле точка поверхности сравнивается с линейной интерполяцией по треугольнику, содержащему этот (u, v)
+    */
+    template <class Surface>
+    float maxErrorAgainstGrid(const std::vector<glm::vec3>& vertices, const Surface& surface, const SurfaceDomain& domain, unsigned int samplesPerAxis) const;
+
+    /**
+    Хордовая ошибка поверхности на ячейке: наибольшее отклонение поверхности от двух треугольников ячейки
+    в узлах сетки 5 x 5 (шаг - четверть ячейки)
+    */
+    template <class Surface>
+    static float chordalError(const Surface& surface, const SurfaceDomain& domain, float s0, float t0, float s1, float t1);
+
+    const Stats& getStats() const { return _stats; }
+
+protected:
+    struct Cell {
+        int32_t x;
+        int32_t y;
+        int32_t size;
+        int32_t firstChild = -1;
+
+        GLuint firstIndex = 0;
+        GLuint indicesCount = 0;
+
+        Cell(int32_t x_, int32_t y_, int32_t size_) : x(x_), y(y_), size(size_) {}
+
+        bool isLeaf() const { return firstChild < 0; }
+    };
+
+    void split(size_t cellIndex);
+
+    /**
+    Возвращает лист, содержащий точку (x, y) в целочисленных координатах самого мелкого уровня, или -1 вне области
+    */
+    int32_t findLeaf(int32_t x, int32_t y) const;
+
+    /**
+    Точки за сторонами ячейки в соседних листьях, в том числе через склеенные стороны области.
+    Возвращает количество точек; requiredSize - наибольший допустимый размер листа, содержащего точку
+    */
+    size_t neighbourProbes(const Cell& cell, int32_t probes[6][2], int32_t requiredSize[6]) const;
+
+    void balance();
+    void triangulate();
+
+    GLuint vertexAt(int32_t x, int32_t y);
+    bool hasVertex(int32_t x, int32_t y) const { return _vertexByKey.count(vertexKey(x, y)) > 0; }
+    uint64_t vertexKey(int32_t x, int32_t y) const { return static_cast<uint64_t>(x) * (_resolution + 1) + y; }
+
+    /**
+    Находит треугольник, содержащий точку (s, t), и барицентрические координаты точки в нем
+    */
+    bool locate(float s, float t, GLuint corners[3], glm::vec3& weights) const;
+
+    static glm::vec2 toParams(glm::vec2 st, const SurfaceDomain& domain)
+    {
+        return glm::vec2(domain.umin + st.x * (domain.umax - domain.umin), domain.vmin + st.y * (domain.vmax - domain.vmin));
+    }
+
+    Settings _settings;
+
+    ///Количество ячеек самого мелкого уровня по каждой стороне
+    int32_t _resolution;
+
+    std::vector<Cell> _cells;
+
+    std::vector<glm::vec2> _vertexParams;
+    std::unordered_map<uint64_t, GLuint> _vertexByKey;
+    std::vector<GLuint> _indices;
+
+    Stats _stats;
+};
+
+template <class Surface>
+void AdaptiveTessellator::fillInSurface(std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, const Surface& surface, const SurfaceDomain& domain) const
+{
+    vertices.resize(_vertexParams.size());
+    normals.resize(_vertexParams.size());
+
+    for (size_t i = 0; i < _vertexParams.size(); i++) {
+        glm::vec2 uv = toParams(_vertexParams[i], domain);
+
+        glm::vec3 du, dv;
+        surface.evaluate(uv.x, uv.y, vertices[i], du, dv);
+
+        glm::vec3 normal = glm::cross(du, dv);
+        float length = glm::length(normal);
+        normals[i] = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+    }
+}
+
+template <class Surface>
+float AdaptiveTessellator::maxErrorAgainstGrid(const std::vector<glm::vec3>& vertices, const Surface& surface, const SurfaceDomain& domain, unsigned int samplesPerAxis) const
+{
+    float maxError = 0.0f;
+    for (unsigned int i = 0; i <= samplesPerAxis; i++) {
+        for (unsigned int j = 0; j <= samplesPerAxis; j++) {
+            glm::vec2 st((float)i / samplesPerAxis, (float)j / samplesPerAxis);
+
+            GLuint corners[3];
+            glm::vec3 weights;
+            if (!locate(st.x, st.y, corners, weights)) {
+                continue;
+            }
+
+            glm::vec3 interpolated = weights.x * vertices[corners[0]] + weights.y * vertices[corners[1]] + weights.z * vertices[corners[2]];
+            glm::vec2 uv = toParams(st, domain);
+            maxError = std::max(maxError, glm::length(surface.position(uv.x, uv.y) - interpolated));
+        }
+    }
+    return maxError;
+}
+
+template <class Surface>
+float AdaptiveTessellator::chordalError(const Surface& surface, const SurfaceDomain& domain, float s0, float t0, float s1, float t1)
+{
+    const int samples = 4;
+
+    glm::vec2 a = toParams(glm::vec2(s0, t0), domain);
+    glm::vec2 b = toParams(glm::vec2(s1, t1), domain);
+
+    glm::vec3 p00 = surface.position(a.x, a.y);
+    glm::vec3 p01 = surface.position(a.x, b.y);
+    glm::vec3 p10 = surface.position(b.x, a.y);
+    glm::vec3 p11 = surface.position(b.x, b.y);
+
+    // Ячейка без висячих вершин делится диагональю p01 - p10 (см. triangulate). Веер из центра точнее на тех же узлах.
+    float error = 0.0f;
+    for (int i = 0; i <= samples; i++) {
+        for (int j = 0; j <= samples; j++) {
+            float x = (float)i / samples;
+            float y = (float)j / samples;
+
+            glm::vec3 interpolated = (x + y <= 1.0f) ?
+                p00 + x * (p10 - p00) + y * (p01 - p00) :
+                p11 + (1.0f - x) * (p01 - p11) + (1.0f - y) * (p10 - p11);
+
+            glm::vec3 point = surface.position(a.x + x * (b.x - a.x), a.y + y * (b.y - a.y));
+            error = std::max(error, glm::length(point - interpolated));
+        }
+    }
+    return error;
+}
@@ -44,6 +44,8 @@ Application::Application() :
 
 Application::~Application()
 {
+    _meshLoader.reset(); //буферы незагруженных мешей удаляются, пока контекст еще существует
+
     ImGui_ImplGlfwGL3_Shutdown();
     glfwTerminate();
 }
@@ -56,6 +58,8 @@ void Application::start()
 
     initGUI();
 
+    _meshLoader = std::make_shared<MeshLoader>(MeshLoader::Settings());
+
     makeScene();
 
     run();
@@ -146,6 +150,8 @@ void Application::run()
 
         update(); //Обновляем сцену и положение виртуальной камеры
 
+        _meshLoader->processUploads(); //Загружаем в видеопамять порцию подготовленных мешей
+
         updateGUI();
 
         draw(); //Рисуем один кадр
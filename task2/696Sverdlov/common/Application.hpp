@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Camera.hpp"
+#include "MeshLoader.hpp"
 
 #include <imgui.h>
 #include <imgui_impl_glfw_gl3.h>
@@ -97,6 +98,9 @@ protected:
     CameraInfo _camera;
     CameraMoverPtr _cameraMover;
 
+    ///Асинхронная загрузка мешей из файлов: готовые меши загружаются в видеопамять в run() перед отрисовкой каждого кадра
+    MeshLoaderPtr _meshLoader;
+
     //Время на предыдущем кадре
     double _oldTime = 0.0;
 };
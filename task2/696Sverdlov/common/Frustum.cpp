@@ -0,0 +1,34 @@
+#include "Frustum.hpp"
+
+Frustum Frustum::fromMatrix(const glm::mat4& viewProjection)
+{
+    // Строки матрицы: glm хранит столбцы, поэтому строка i - это (m[0][i], m[1][i], m[2][i], m[3][i]).
+    const glm::mat4 m = glm::transpose(viewProjection);
+
+    Frustum frustum;
+    frustum.planes[0] = m[3] + m[0];
+    frustum.planes[1] = m[3] - m[0];
+    frustum.planes[2] = m[3] + m[1];
+    frustum.planes[3] = m[3] - m[1];
+#ifdef GLM_FORCE_DEPTH_ZERO_TO_ONE
+    frustum.planes[4] = m[2]; //глубина в усеченных координатах от 0 до w
+#else
+    frustum.planes[4] = m[3] + m[2];
+#endif
+    frustum.planes[5] = m[3] - m[2];
+
+    for (glm::vec4& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const
+{
+    for (const glm::vec4& plane : planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
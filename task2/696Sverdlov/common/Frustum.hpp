@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Camera.hpp"
+
+/**
+Пирамида видимости камеры: 6 плоскостей (левая, правая, нижняя, верхняя, ближняя, дальняя),
+нормали смотрят внутрь и нормированы, поэтому dot(plane.xyz, p) + plane.w - расстояние со знаком от точки до плоскости.
+*/
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    /**
+    Извлекает плоскости из матрицы projMatrix * viewMatrix (метод Грибба-Хартманна), плоскости в мировой системе координат
+    */
+    static Frustum fromMatrix(const glm::mat4& viewProjection);
+
+    static Frustum fromCamera(const CameraInfo& camera) { return fromMatrix(camera.projMatrix * camera.viewMatrix); }
+
+    /**
+    Консервативный тест: false, только если сфера целиком снаружи одной из плоскостей
+    */
+    bool intersectsSphere(const glm::vec3& center, float radius) const;
+};
+
+/**
+Ограничивающая сфера модели в мировой системе координат: центр преобразуется матрицей модели,
+радиус умножается на наибольший масштаб по осям
+*/
+inline glm::vec4 transformBoundingSphere(const glm::mat4& modelMatrix, const glm::vec4& sphere)
+{
+    glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(glm::vec3(sphere), 1.0f));
+    float scale = glm::max(glm::length(glm::vec3(modelMatrix[0])), glm::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+    return glm::vec4(center, sphere.w * scale);
+}
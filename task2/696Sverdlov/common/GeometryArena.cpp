@@ -0,0 +1,231 @@
+#include "GeometryArena.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+GeometryArena::GeometryArena(const std::vector<VertexAttributeState>& layout, GLsizei stride, GLuint verticesCapacity, GLuint indicesCapacity) :
+    _layout(layout),
+    _stride(stride),
+    _mesh(std::make_shared<Mesh>())
+{
+    _mesh->setPrimitiveType(GL_TRIANGLES);
+    reserve(std::max(verticesCapacity, 1u), std::max(indicesCapacity, 1u));
+}
+
+void GeometryArena::reserve(GLuint verticesCapacity, GLuint indicesCapacity)
+{
+    if (verticesCapacity > _verticesCapacity) {
+        DataBufferPtr buffer = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
+        buffer->setData(static_cast<GLsizeiptr>(verticesCapacity) * _stride, nullptr);
+
+        if (_vertexBuffer && _verticesCount > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, _vertexBuffer->id());
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer->id());
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(_verticesCount) * _stride);
+        }
+
+        _vertexBuffer = buffer;
+        _verticesCapacity = verticesCapacity;
+
+        for (const VertexAttributeState& attribute : _layout) {
+            _mesh->setAttribute(attribute.index, attribute.size, attribute.type, attribute.normalized, _stride, attribute.offset, _vertexBuffer);
+        }
+    }
+
+    if (indicesCapacity > _indicesCapacity) {
+        DataBufferPtr buffer = std::make_shared<DataBuffer>(GL_ELEMENT_ARRAY_BUFFER);
+        buffer->setData(static_cast<GLsizeiptr>(indicesCapacity) * sizeof(GLuint), nullptr);
+
+        if (_indexBuffer && _indicesCount > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, _indexBuffer->id());
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer->id());
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(_indicesCount) * sizeof(GLuint));
+        }
+
+        _indexBuffer = buffer;
+        _indicesCapacity = indicesCapacity;
+
+        _mesh->setIndices(_indicesCount, _indexBuffer);
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    _stats.bytesReserved = static_cast<size_t>(_verticesCapacity) * _stride + static_cast<size_t>(_indicesCapacity) * sizeof(GLuint);
+}
+
+GeometryRange GeometryArena::allocate(GLuint verticesCount, GLuint indicesCount)
+{
+    GLuint verticesCapacity = _verticesCapacity;
+    while (_verticesCount + verticesCount > verticesCapacity) {
+        verticesCapacity *= 2;
+    }
+
+    GLuint indicesCapacity = _indicesCapacity;
+    while (_indicesCount + indicesCount > indicesCapacity) {
+        indicesCapacity *= 2;
+    }
+
+    if (verticesCapacity != _verticesCapacity || indicesCapacity != _indicesCapacity) {
+        reserve(verticesCapacity, indicesCapacity);
+        _stats.growsCount++;
+    }
+
+    GeometryRange range;
+    range.baseVertex = static_cast<GLint>(_verticesCount);
+    range.verticesCount = verticesCount;
+    range.firstIndex = _indicesCount;
+    range.indicesCount = indicesCount;
+
+    _verticesCount += verticesCount;
+    _indicesCount += indicesCount;
+    _mesh->setIndices(_indicesCount, _indexBuffer);
+    _mesh->setVertexCount(_verticesCount);
+
+    _stats.meshesCount++;
+    _stats.verticesCount = _verticesCount;
+    _stats.indicesCount = _indicesCount;
+
+    return range;
+}
+
+GeometryRange GeometryArena::add(const void* vertices, GLuint verticesCount, const GLuint* indices, GLuint indicesCount)
+{
+    GeometryRange range = allocate(verticesCount, indicesCount);
+
+    _vertexBuffer->bind();
+    glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(range.baseVertex) * _stride, static_cast<GLsizeiptr>(verticesCount) * _stride, vertices);
+    _vertexBuffer->unbind();
+
+    // Индексный буфер привязан к VAO арены, поэтому копируем через нейтральную точку привязки.
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _indexBuffer->id());
+    glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(range.firstIndex) * sizeof(GLuint), static_cast<GLsizeiptr>(indicesCount) * sizeof(GLuint), indices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    return range;
+}
+
+bool GeometryArena::addMesh(const Mesh& mesh, GeometryRange& range)
+{
+    const std::vector<VertexAttributeState> attributes = mesh.queryAttributes();
+
+    GLuint sourceBuffer = 0;
+    for (const VertexAttributeState& expected : _layout) {
+        auto found = std::find_if(attributes.begin(), attributes.end(), [&](const VertexAttributeState& a) { return a.index == expected.index; });
+        if (found == attributes.end() || found->size != expected.size || found->type != expected.type ||
+            found->normalized != expected.normalized || found->integer || found->offset != expected.offset ||
+            found->stride != _stride || (sourceBuffer != 0 && found->buffer != sourceBuffer)) {
+            std::cerr << "Mesh layout does not match the geometry arena: attribute " << expected.index << "\n";
+            return false;
+        }
+        sourceBuffer = found->buffer;
+    }
+
+    const GLuint verticesCount = static_cast<GLuint>(mesh.getVertexCount());
+    const GLuint indicesCount = mesh.hasIndices() ? mesh.getIndicesCount() : verticesCount;
+
+    range = allocate(verticesCount, indicesCount);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, sourceBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _vertexBuffer->id());
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, static_cast<GLintptr>(range.baseVertex) * _stride,
+                        static_cast<GLsizeiptr>(verticesCount) * _stride);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _indexBuffer->id());
+    if (mesh.hasIndices()) {
+        glBindBuffer(GL_COPY_READ_BUFFER, mesh.queryIndexBuffer());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, static_cast<GLintptr>(range.firstIndex) * sizeof(GLuint),
+                            static_cast<GLsizeiptr>(indicesCount) * sizeof(GLuint));
+    }
+    else {
+        std::vector<GLuint> indices(indicesCount);
+        for (GLuint i = 0; i < indicesCount; i++) {
+            indices[i] = i;
+        }
+        glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(range.firstIndex) * sizeof(GLuint), indices.size() * sizeof(GLuint), indices.data());
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    return true;
+}
+
+void GeometryDrawList::add(const GeometryRange& range, GLuint baseInstance, GLuint instanceCount)
+{
+    Command command;
+    command.count = range.indicesCount;
+    command.instanceCount = instanceCount;
+    command.firstIndex = range.firstIndex;
+    command.baseVertex = range.baseVertex;
+    command.baseInstance = baseInstance;
+    _commands.push_back(command);
+}
+
+bool GeometryDrawList::supportsBaseInstance()
+{
+    return GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+}
+
+void GeometryDrawList::draw(const GeometryArena& arena, StreamingBuffer* stream)
+{
+    if (_commands.empty()) {
+        return;
+    }
+
+    // Данные экземпляров могли быть записаны в stream до вызова: они должны дойти до видеокарты при любом способе рисования.
+    if (stream) {
+        stream->flush();
+    }
+
+    glBindVertexArray(arena.mesh()->getVAO());
+
+    if (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect) {
+        const GLsizeiptr size = _commands.size() * sizeof(Command);
+
+        StreamingBuffer::Allocation allocation;
+        if (stream) {
+            allocation = stream->allocate(size, 4);
+        }
+
+        if (allocation.data) {
+            std::memcpy(allocation.data, _commands.data(), size);
+            stream->flush();
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream->buffer()->id());
+        }
+        else {
+            if (!_indirectBuffer) {
+                _indirectBuffer = std::make_shared<DataBuffer>(GL_DRAW_INDIRECT_BUFFER);
+            }
+            _indirectBuffer->setData(size, _commands.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirectBuffer->id());
+        }
+
+        glMultiDrawElementsIndirect(arena.mesh()->getPrimitiveType(), GL_UNSIGNED_INT, reinterpret_cast<const void*>(allocation.offset),
+                                    static_cast<GLsizei>(_commands.size()), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else if (supportsBaseInstance()) {
+        for (const Command& command : _commands) {
+            glDrawElementsInstancedBaseVertexBaseInstance(arena.mesh()->getPrimitiveType(), command.count, GL_UNSIGNED_INT,
+                                                          reinterpret_cast<const void*>(command.firstIndex * sizeof(GLuint)),
+                                                          command.instanceCount, command.baseVertex, command.baseInstance);
+        }
+    }
+    else {
+        std::vector<GLsizei> counts(_commands.size());
+        std::vector<const GLvoid*> offsets(_commands.size());
+        std::vector<GLint> baseVertices(_commands.size());
+        for (size_t i = 0; i < _commands.size(); i++) {
+            counts[i] = _commands[i].count;
+            offsets[i] = reinterpret_cast<const GLvoid*>(_commands[i].firstIndex * sizeof(GLuint));
+            baseVertices[i] = _commands[i].baseVertex;
+        }
+        glMultiDrawElementsBaseVertex(arena.mesh()->getPrimitiveType(), counts.data(), GL_UNSIGNED_INT, offsets.data(),
+                                      static_cast<GLsizei>(_commands.size()), baseVertices.data());
+    }
+
+    glBindVertexArray(0);
+}
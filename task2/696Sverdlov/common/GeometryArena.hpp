@@ -0,0 +1,151 @@
+#pragma once
+
+#include "Mesh.hpp"
+#include "StreamingBuffer.hpp"
+#include "VertexLayout.hpp"
+
+#include <cassert>
+#include <memory>
+#include <vector>
+
+/**
+Диапазон одного меша внутри GeometryArena
+*/
+struct GeometryRange
+{
+    ///Номер первой вершины меша в общем вершинном буфере (индексы меша отсчитываются от нее)
+    GLint baseVertex = 0;
+    GLuint verticesCount = 0;
+
+    GLuint firstIndex = 0;
+    GLuint indicesCount = 0;
+};
+
+/**
+Данные одной отрисовки для атрибутов экземпляра с делителем 1 (матрица модели занимает 4 атрибута, матрица нормалей - 3).
+Раскладка совпадает со структурой std430 из cull.comp, поэтому эти данные может писать и вычислительный шейдер
+*/
+struct InstanceTransform
+{
+    ///Матрица модели, умноженная на матрицу деквантования меша
+    glm::mat4 modelMatrix;
+
+    ///Столбцы матрицы преобразования нормалей, дополненные до vec4
+    glm::vec4 normalMatrix[3];
+};
+
+/**
+Общие вершинный и индексный буферы для многих мешей одного формата вершин с одним VAO.
+Меши добавляются последовательно в конец буферов; при нехватке места буферы пересоздаются вдвое большими
+с копированием содержимого на видеокарте. Рисуются меши через GeometryDrawList, без переключения VAO и буферов.
+*/
+class GeometryArena
+{
+public:
+    struct Stats {
+        size_t meshesCount = 0;
+        size_t verticesCount = 0;
+        size_t indicesCount = 0;
+        size_t bytesReserved = 0;
+        size_t growsCount = 0;
+    };
+
+    /**
+    Создает арену для вершин с раскладкой VertexLayout<Vertex>
+    */
+    template <class Vertex>
+    static std::shared_ptr<GeometryArena> create(GLuint verticesCapacity = 65536, GLuint indicesCapacity = 3 * 65536)
+    {
+        return std::make_shared<GeometryArena>(describeVertexLayout<Vertex>(), sizeof(Vertex), verticesCapacity, indicesCapacity);
+    }
+
+    GeometryArena(const std::vector<VertexAttributeState>& layout, GLsizei stride, GLuint verticesCapacity, GLuint indicesCapacity);
+
+    /**
+    Добавляет меш из массивов в оперативной памяти. Индексы отсчитываются от первой вершины меша
+    */
+    template <class Vertex>
+    GeometryRange add(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
+    {
+        assert(sizeof(Vertex) == static_cast<size_t>(_stride));
+        return add(vertices.data(), static_cast<GLuint>(vertices.size()), indices.data(), static_cast<GLuint>(indices.size()));
+    }
+
+    GeometryRange add(const void* vertices, GLuint verticesCount, const GLuint* indices, GLuint indicesCount);
+
+    /**
+    Копирует в арену уже загруженный меш без чтения данных на процессор (glCopyBufferSubData).
+    Меш должен хранить все атрибуты арены в одном буфере с той же чередующейся раскладкой.
+    \return false, если раскладка не совпадает
+    */
+    bool addMesh(const Mesh& mesh, GeometryRange& range);
+
+    /**
+    Меш, владеющий общим VAO. К нему можно добавлять собственные атрибуты, например данные экземпляров
+    */
+    const MeshPtr& mesh() const { return _mesh; }
+
+    const Stats& getStats() const { return _stats; }
+
+protected:
+    GeometryRange allocate(GLuint verticesCount, GLuint indicesCount);
+    void reserve(GLuint verticesCapacity, GLuint indicesCapacity);
+
+    std::vector<VertexAttributeState> _layout;
+    GLsizei _stride;
+
+    MeshPtr _mesh;
+    DataBufferPtr _vertexBuffer;
+    DataBufferPtr _indexBuffer;
+
+    GLuint _verticesCapacity = 0;
+    GLuint _indicesCapacity = 0;
+    GLuint _verticesCount = 0;
+    GLuint _indicesCount = 0;
+
+    Stats _stats;
+};
+
+typedef std::shared_ptr<GeometryArena> GeometryArenaPtr;
+
+/**
+Список отрисовок диапазонов одной арены. Рисуется одной командой:
+- glMultiDrawElementsIndirect (OpenGL 4.3), команды кладутся в StreamingBuffer или в собственный буфер;
+- glDrawElementsInstancedBaseVertexBaseInstance в цикле (OpenGL 4.2);
+- glMultiDrawElementsBaseVertex (OpenGL 3.2).
+baseInstance каждой отрисовки сдвигает атрибуты экземпляров (с делителем 1), поэтому через него передаются
+данные отдельных отрисовок, например матрицы моделей. В последнем варианте baseInstance не поддерживается (см. supportsBaseInstance).
+*/
+class GeometryDrawList
+{
+public:
+    ///Раскладка совпадает с DrawElementsIndirectCommand
+    struct Command {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    void clear() { _commands.clear(); }
+
+    void add(const GeometryRange& range, GLuint baseInstance = 0, GLuint instanceCount = 1);
+
+    size_t size() const { return _commands.size(); }
+
+    const std::vector<Command>& commands() const { return _commands; }
+
+    /**
+    Рисует все диапазоны. Если задан stream, перед рисованием он сбрасывается (flush),
+    а команды непрямого рисования пишутся в регион текущего кадра
+    */
+    void draw(const GeometryArena& arena, StreamingBuffer* stream = nullptr);
+
+    static bool supportsBaseInstance();
+
+protected:
+    std::vector<Command> _commands;
+
+    DataBufferPtr _indirectBuffer;
+};
@@ -0,0 +1,235 @@
+#include "GpuCuller.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    const GLuint WORKGROUP_SIZE = 64; //local_size_x в cull.comp
+
+    template <class T>
+    void readBuffer(const DataBuffer& buffer, std::vector<T>& data)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer.id());
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, data.size() * sizeof(T), data.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+
+    ///Относительная погрешность, в пределах которой результаты процессора и видеокарты могут расходиться
+    const float TOLERANCE = 1e-4f;
+}
+
+bool GpuCuller::isSupported()
+{
+    return GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object && GLEW_ARB_multi_draw_indirect);
+}
+
+GpuCuller::GpuCuller(const std::string& shaderPath, const LodChain& lods, const std::vector<GeometryRange>& ranges, ProgramCache* cache) :
+    _boundingSphere(lods.boundingCenter(), lods.boundingRadius()),
+    _pixelsPerCell(lods.pixelsPerCell()),
+    _hysteresis(lods.hysteresis()),
+    _objectBuffer(std::make_shared<DataBuffer>(GL_SHADER_STORAGE_BUFFER)),
+    _levelBuffer(std::make_shared<DataBuffer>(GL_SHADER_STORAGE_BUFFER)),
+    _commandBuffer(std::make_shared<DataBuffer>(GL_DRAW_INDIRECT_BUFFER)),
+    _instanceBuffer(std::make_shared<DataBuffer>(GL_ARRAY_BUFFER))
+{
+    assert(ranges.size() == lods.levelsCount());
+
+    _program.createProgramCompute(shaderPath, cache);
+
+    _objectsCountUniform = _program.uniform<int>("objectsCount");
+    _levelsCountUniform = _program.uniform<int>("levelsCount");
+    _frustumPlanesUniform = _program.uniform<glm::vec4>("frustumPlanes");
+    _viewMatrixUniform = _program.uniform<glm::mat4>("viewMatrix");
+    _projectionScaleUniform = _program.uniform<float>("projectionScale");
+    _viewportHeightUniform = _program.uniform<float>("viewportHeight");
+    _pixelsPerCellUniform = _program.uniform<float>("pixelsPerCell");
+    _hysteresisUniform = _program.uniform<float>("hysteresis");
+
+    for (size_t i = 0; i < lods.levelsCount(); i++) {
+        Level level;
+        level.range = glm::uvec4(ranges[i].indicesCount, ranges[i].firstIndex, static_cast<GLuint>(ranges[i].baseVertex), lods.level(i).detail);
+        level.dequantizationMatrix = lods.level(i).mesh->dequantizationMatrix();
+        _levels.push_back(level);
+    }
+    _levelBuffer->setData(_levels.size() * sizeof(Level), _levels.data());
+}
+
+void GpuCuller::setObjects(const std::vector<glm::mat4>& modelMatrices)
+{
+    std::vector<Object> objects(modelMatrices.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        objects[i].modelMatrix = modelMatrices[i];
+
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrices[i])));
+        for (int c = 0; c < 3; c++) {
+            objects[i].normalMatrix[c] = glm::vec4(normalMatrix[c], 0.0f);
+        }
+
+        objects[i].boundingSphere = _boundingSphere;
+        objects[i].state = glm::uvec4(0);
+    }
+
+    _objectsCount = objects.size();
+    _stats.objectsCount = _objectsCount;
+
+    // Пустой буфер нельзя привязать к точке SSBO, поэтому выделяем хотя бы один элемент.
+    const size_t capacity = std::max<size_t>(_objectsCount, 1);
+    _objectBuffer->setData(capacity * sizeof(Object), nullptr);
+    if (_objectsCount > 0) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _objectBuffer->id());
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, _objectsCount * sizeof(Object), objects.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    _commandBuffer->setData(capacity * sizeof(GeometryDrawList::Command), nullptr, GL_DYNAMIC_COPY);
+    _instanceBuffer->setData(capacity * sizeof(InstanceTransform), nullptr, GL_DYNAMIC_COPY);
+}
+
+void GpuCuller::cull(const CameraInfo& camera, int viewportHeight)
+{
+    if (_objectsCount == 0) {
+        return;
+    }
+
+    const Frustum frustum = Frustum::fromCamera(camera);
+
+    _program.use();
+    _program.set(_objectsCountUniform, static_cast<int>(_objectsCount));
+    _program.set(_levelsCountUniform, static_cast<int>(_levels.size()));
+    _program.set(_frustumPlanesUniform, frustum.planes, 6);
+    _program.set(_viewMatrixUniform, camera.viewMatrix);
+    _program.set(_projectionScaleUniform, camera.projMatrix[1][1]);
+    _program.set(_viewportHeightUniform, static_cast<float>(viewportHeight));
+    _program.set(_pixelsPerCellUniform, _pixelsPerCell);
+    _program.set(_hysteresisUniform, _hysteresis);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _objectBuffer->id());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _levelBuffer->id());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _commandBuffer->id());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _instanceBuffer->id());
+
+    glDispatchCompute(static_cast<GLuint>((_objectsCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE), 1, 1);
+
+    // Команды читаются как параметры непрямого рисования, матрицы - как вершинные атрибуты.
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    for (GLuint binding = 0; binding < 4; binding++) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+    }
+}
+
+void GpuCuller::draw(const GeometryArena& arena) const
+{
+    if (_objectsCount == 0) {
+        return;
+    }
+
+    glBindVertexArray(arena.mesh()->getVAO());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer->id());
+    glMultiDrawElementsIndirect(arena.mesh()->getPrimitiveType(), GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(_objectsCount), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void GpuCuller::cullOnCpu(std::vector<Object>& objects, const CameraInfo& camera, int viewportHeight,
+                          std::vector<GeometryDrawList::Command>& commands, std::vector<bool>* ambiguous) const
+{
+    const Frustum frustum = Frustum::fromCamera(camera);
+    const GLuint levelsCount = static_cast<GLuint>(_levels.size());
+
+    commands.resize(objects.size());
+    if (ambiguous) {
+        ambiguous->assign(objects.size(), false);
+    }
+
+    for (size_t i = 0; i < objects.size(); i++) {
+        Object& object = objects[i];
+        const glm::vec4 sphere = transformBoundingSphere(object.modelMatrix, object.boundingSphere);
+        const glm::vec3 center(sphere);
+
+        bool visible = true;
+        bool uncertain = false;
+        for (const glm::vec4& plane : frustum.planes) {
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            visible = visible && distance >= -sphere.w;
+            uncertain = uncertain || std::fabs(distance + sphere.w) <= TOLERANCE * (1.0f + std::fabs(distance) + sphere.w);
+        }
+
+        GLuint lod = std::min(object.state.x, levelsCount - 1);
+        if (visible) {
+            // То же, что LodChain::select, но для сферы, уже переведенной в мировую систему координат.
+            float distance = -(camera.viewMatrix * glm::vec4(center, 1.0f)).z;
+            float requiredDetail = distance <= sphere.w ? std::numeric_limits<float>::infinity() :
+                                   sphere.w * camera.projMatrix[1][1] / distance * viewportHeight / _pixelsPerCell;
+
+            while (lod > 0 && _levels[lod].range.w < requiredDetail) {
+                lod--;
+            }
+            while (lod + 1 < levelsCount && _levels[lod + 1].range.w >= requiredDetail * (1.0f + _hysteresis)) {
+                lod++;
+            }
+            object.state.x = lod;
+
+            for (const Level& level : _levels) {
+                float detail = static_cast<float>(level.range.w);
+                uncertain = uncertain || std::fabs(detail - requiredDetail) <= TOLERANCE * detail ||
+                            std::fabs(detail - requiredDetail * (1.0f + _hysteresis)) <= TOLERANCE * detail;
+            }
+        }
+
+        const Level& level = _levels[lod];
+        commands[i].count = level.range.x;
+        commands[i].instanceCount = visible ? 1 : 0;
+        commands[i].firstIndex = level.range.y;
+        commands[i].baseVertex = static_cast<GLint>(level.range.z);
+        commands[i].baseInstance = static_cast<GLuint>(i);
+
+        if (ambiguous) {
+            (*ambiguous)[i] = uncertain;
+        }
+    }
+}
+
+size_t GpuCuller::validate(const CameraInfo& camera, int viewportHeight)
+{
+    if (_objectsCount == 0) {
+        return 0;
+    }
+
+    // Уровни на входе должны совпадать, поэтому эталон считается от состояния объектов на видеокарте.
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    std::vector<Object> objects(_objectsCount);
+    readBuffer(*_objectBuffer, objects);
+
+    std::vector<GeometryDrawList::Command> expected;
+    std::vector<bool> ambiguous;
+    cullOnCpu(objects, camera, viewportHeight, expected, &ambiguous);
+
+    cull(camera, viewportHeight);
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    std::vector<GeometryDrawList::Command> actual(_objectsCount);
+    readBuffer(*_commandBuffer, actual);
+
+    _stats.visibleCount = 0;
+    _stats.mismatchesCount = 0;
+    _stats.ambiguousCount = 0;
+    for (size_t i = 0; i < _objectsCount; i++) {
+        _stats.visibleCount += actual[i].instanceCount > 0 ? 1 : 0;
+
+        bool same = actual[i].instanceCount == expected[i].instanceCount && actual[i].count == expected[i].count &&
+                    actual[i].firstIndex == expected[i].firstIndex && actual[i].baseVertex == expected[i].baseVertex &&
+                    actual[i].baseInstance == expected[i].baseInstance;
+        if (ambiguous[i]) {
+            _stats.ambiguousCount++;
+        }
+        else if (!same) {
+            _stats.mismatchesCount++;
+        }
+    }
+    _stats.validated = true;
+
+    return _stats.mismatchesCount;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Camera.hpp"
+#include "Frustum.hpp"
+#include "GeometryArena.hpp"
+#include "LodChain.hpp"
+#include "ShaderProgram.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+Отсечение по пирамиде видимости и выбор уровня детализации на видеокарте для многих экземпляров одной LodChain из GeometryArena.
+Вычислительный шейдер (cull.comp) проходит по буферу объектов (матрица модели, ограничивающая сфера, текущий уровень),
+проверяет сферу против плоскостей камеры, выбирает уровень с тем же гистерезисом, что и LodChain::select,
+и пишет для каждого объекта команду DrawElementsIndirectCommand и InstanceTransform для атрибутов экземпляра.
+Команд всегда столько же, сколько объектов: у невидимых instanceCount = 0, поэтому результат не читается на процессор,
+а работа процессора за кадр не зависит от количества объектов (несколько юниформов, dispatch и одна glMultiDrawElementsIndirect).
+
+Требует OpenGL 4.3 (вычислительные шейдеры, SSBO, glMultiDrawElementsIndirect).
+cullOnCpu - эталонная реализация того же алгоритма, по ней validate сверяет результат видеокарты.
+*/
+class GpuCuller
+{
+public:
+    ///Раскладка совпадает со структурой Object из cull.comp (std430)
+    struct Object {
+        glm::mat4 modelMatrix;
+        glm::vec4 normalMatrix[3];
+
+        ///Центр и радиус ограничивающей сферы в локальной системе координат
+        glm::vec4 boundingSphere;
+
+        ///x - текущий уровень детализации (обновляется шейдером), остальное - выравнивание
+        glm::uvec4 state;
+    };
+
+    struct Stats {
+        size_t objectsCount = 0;
+
+        ///Результаты последней проверки validate
+        size_t visibleCount = 0;
+        size_t mismatchesCount = 0;
+
+        ///Объекты на границе плоскости или порога уровня, которые не сверялись
+        size_t ambiguousCount = 0;
+        bool validated = false;
+    };
+
+    static bool isSupported();
+
+    /**
+    \param ranges диапазоны уровней lods в арене, в том же порядке
+    \param cache кеш двоичных образов для вычислительной программы (может быть nullptr)
+    */
+    GpuCuller(const std::string& shaderPath, const LodChain& lods, const std::vector<GeometryRange>& ranges, ProgramCache* cache = nullptr);
+
+    /**
+    Загружает матрицы объектов в буфер. Вызывается только при изменении набора объектов, а не каждый кадр
+    */
+    void setObjects(const std::vector<glm::mat4>& modelMatrices);
+
+    /**
+    Запускает отсечение для кадра
+    */
+    void cull(const CameraInfo& camera, int viewportHeight);
+
+    /**
+    Рисует результат последнего cull одной командой. Атрибуты экземпляров арены должны указывать на instanceBuffer
+    */
+    void draw(const GeometryArena& arena) const;
+
+    /**
+    Выполняет cull и сверяет команды с cullOnCpu. Читает буферы с видеокарты, поэтому только для отладки.
+    Объекты на границе плоскости или порога уровня в пределах погрешности float не считаются расхождением.
+    \return количество расхождений
+    */
+    size_t validate(const CameraInfo& camera, int viewportHeight);
+
+    /**
+    Эталонное отсечение на процессоре: обновляет уровни objects и пишет команды с instanceCount = 0 для невидимых
+    \param ambiguous если не nullptr, отмечает объекты, результат которых чувствителен к погрешности вычислений
+    */
+    void cullOnCpu(std::vector<Object>& objects, const CameraInfo& camera, int viewportHeight,
+                   std::vector<GeometryDrawList::Command>& commands, std::vector<bool>* ambiguous = nullptr) const;
+
+    ///false, если вычислительная программа не собралась: тогда cull и draw не вызываются
+    bool isValid() const { return _program.isLinked(); }
+
+    ///Буфер InstanceTransform объектов, индекс объекта - baseInstance его команды
+    const DataBufferPtr& instanceBuffer() const { return _instanceBuffer; }
+
+    size_t objectsCount() const { return _objectsCount; }
+
+    const Stats& getStats() const { return _stats; }
+
+protected:
+    ///Раскладка совпадает со структурой Level из cull.comp (std430)
+    struct Level {
+        ///count, firstIndex, baseVertex, detail
+        glm::uvec4 range;
+        glm::mat4 dequantizationMatrix;
+    };
+
+    ShaderProgram _program;
+
+    //Юниформы, которые задаются в каждом cull: места определяются один раз после сборки программы
+    Uniform<int> _objectsCountUniform;
+    Uniform<int> _levelsCountUniform;
+    Uniform<glm::vec4> _frustumPlanesUniform;
+    Uniform<glm::mat4> _viewMatrixUniform;
+    Uniform<float> _projectionScaleUniform;
+    Uniform<float> _viewportHeightUniform;
+    Uniform<float> _pixelsPerCellUniform;
+    Uniform<float> _hysteresisUniform;
+
+    std::vector<Level> _levels;
+    glm::vec4 _boundingSphere;
+    float _pixelsPerCell;
+    float _hysteresis;
+
+    size_t _objectsCount = 0;
+
+    DataBufferPtr _objectBuffer;
+    DataBufferPtr _levelBuffer;
+    DataBufferPtr _commandBuffer;
+    DataBufferPtr _instanceBuffer;
+
+    Stats _stats;
+};
+
+typedef std::shared_ptr<GpuCuller> GpuCullerPtr;
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+const uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ULL;
+const uint64_t FNV1A_PRIME = 1099511628211ULL;
+
+/**
+64-битный хеш FNV-1a. Ключи кешей на диске и контрольные суммы их файлов (см. MeshCache, ProgramCache).
+Несколько кусков данных хешируются цепочкой: результат для предыдущего куска передается как seed следующего
+*/
+inline uint64_t fnv1a(const void* data, size_t size, uint64_t seed = FNV1A_OFFSET_BASIS)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; i++) {
+        h ^= bytes[i];
+        h *= FNV1A_PRIME;
+    }
+    return h;
+}
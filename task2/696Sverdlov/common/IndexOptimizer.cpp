@@ -0,0 +1,437 @@
+#include "IndexOptimizer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+
+namespace
+{
+    /**
+    Модель FIFO-кеша вершин: вершина в кеше, если с ее загрузки было меньше cacheSize промахов
+    */
+    class FifoCache
+    {
+    public:
+        FifoCache(size_t verticesCount, unsigned int cacheSize) :
+            _timestamps(verticesCount, 0),
+            _cacheSize(cacheSize),
+            _time(cacheSize + 1)
+        {
+        }
+
+        ///true при промахе
+        bool access(GLuint vertex)
+        {
+            if (_time - _timestamps[vertex] > _cacheSize) {
+                _timestamps[vertex] = _time++;
+                return true;
+            }
+            return false;
+        }
+
+        void reset() { _time += _cacheSize + 1; }
+
+    private:
+        std::vector<uint32_t> _timestamps;
+        uint32_t _cacheSize;
+        uint32_t _time;
+    };
+
+    /**
+    Треугольники каждой вершины: triangles[offsets[v], offsets[v + 1])
+    */
+    struct VertexAdjacency
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+
+        VertexAdjacency(const std::vector<GLuint>& indices, size_t verticesCount) :
+            offsets(verticesCount + 1, 0),
+            triangles(indices.size())
+        {
+            for (GLuint index : indices) {
+                offsets[index + 1]++;
+            }
+            for (size_t v = 0; v < verticesCount; v++) {
+                offsets[v + 1] += offsets[v];
+            }
+
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++) {
+                triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+    };
+
+    /**
+    Порядок кластеров треугольников [boundaries[c], boundaries[c + 1]) для уменьшения перерисовки.
+    Кластер рисуется раньше, если он дальше от центра меша в направлении своей нормали: такие чаще закрывают остальные
+    */
+    std::vector<size_t> sortClustersForOverdraw(const std::vector<GLuint>& indices, const std::vector<glm::vec3>& positions,
+                                                const std::vector<size_t>& boundaries)
+    {
+        glm::vec3 meshCentroid(0.0f);
+        double meshArea = 0.0;
+        std::vector<glm::vec3> clusterCentroids(boundaries.size() - 1, glm::vec3(0.0f));
+        std::vector<glm::vec3> clusterNormals(boundaries.size() - 1, glm::vec3(0.0f));
+        for (size_t c = 0; c + 1 < boundaries.size(); c++) {
+            float clusterArea = 0.0f;
+            for (size_t t = boundaries[c]; t < boundaries[c + 1]; t++) {
+                const glm::vec3& a = positions[indices[3 * t]];
+                const glm::vec3& b = positions[indices[3 * t + 1]];
+                const glm::vec3& d = positions[indices[3 * t + 2]];
+
+                glm::vec3 normal = glm::cross(b - a, d - a);
+                float area = glm::length(normal);
+                glm::vec3 centroid = (a + b + d) / 3.0f;
+
+                clusterCentroids[c] += centroid * area;
+                clusterNormals[c] += normal;
+                clusterArea += area;
+                meshCentroid += centroid * area;
+                meshArea += area;
+            }
+            clusterCentroids[c] = clusterArea > 0.0f ? clusterCentroids[c] / clusterArea : positions[indices[3 * boundaries[c]]];
+            float normalLength = glm::length(clusterNormals[c]);
+            clusterNormals[c] = normalLength > 0.0f ? clusterNormals[c] / normalLength : glm::vec3(0.0f);
+        }
+        if (meshArea > 0.0) {
+            meshCentroid /= static_cast<float>(meshArea);
+        }
+
+        std::vector<size_t> order(boundaries.size() - 1);
+        std::vector<float> keys(order.size());
+        for (size_t c = 0; c < order.size(); c++) {
+            order[c] = c;
+            keys[c] = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+        }
+        std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] > keys[b]; });
+        return order;
+    }
+
+    /**
+    Результат optimizeVertexFetch или тождественная перестановка, если этап выключен
+    */
+    size_t remapVertices(std::vector<GLuint>& indices, size_t verticesCount, const IndexOptimizationSettings& settings,
+                         std::vector<GLuint>& remap)
+    {
+        if (settings.vertexFetch) {
+            return optimizeVertexFetch(indices, verticesCount, remap);
+        }
+        remap.resize(verticesCount);
+        for (size_t i = 0; i < remap.size(); i++) {
+            remap[i] = static_cast<GLuint>(i);
+        }
+        return verticesCount;
+    }
+}
+
+VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& indices, size_t verticesCount, unsigned int cacheSize)
+{
+    VertexCacheStats stats;
+    if (indices.empty()) {
+        return stats;
+    }
+
+    FifoCache cache(verticesCount, cacheSize);
+    std::vector<bool> referenced(verticesCount, false);
+
+    size_t misses = 0;
+    size_t referencedCount = 0;
+    for (GLuint index : indices) {
+        misses += cache.access(index) ? 1 : 0;
+        if (!referenced[index]) {
+            referenced[index] = true;
+            referencedCount++;
+        }
+    }
+
+    stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / referencedCount;
+    return stats;
+}
+
+void optimizeVertexCache(std::vector<GLuint>& indices, size_t verticesCount, unsigned int cacheSize)
+{
+    assert(indices.size() % 3 == 0);
+
+    const size_t trianglesCount = indices.size() / 3;
+    const VertexAdjacency adjacency(indices, verticesCount);
+
+    // Сколько еще не выведенных треугольников у вершины.
+    std::vector<uint32_t> liveTriangles(verticesCount);
+    for (size_t v = 0; v < verticesCount; v++) {
+        liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    }
+
+    std::vector<uint32_t> cacheTimestamps(verticesCount, 0);
+    std::vector<bool> emitted(trianglesCount, false);
+    std::vector<GLuint> deadEnd;
+    std::vector<GLuint> candidates;
+
+    std::vector<GLuint> result;
+    result.reserve(indices.size());
+
+    uint32_t time = cacheSize + 1;
+    size_t cursor = 0;
+
+    // Следующая вершина, когда у кандидатов не осталось треугольников: сначала недавно выведенные, потом по порядку номеров.
+    auto skipDeadEnd = [&]() -> long long {
+        while (!deadEnd.empty()) {
+            GLuint vertex = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[vertex] > 0) {
+                return vertex;
+            }
+        }
+        while (cursor < verticesCount) {
+            if (liveTriangles[cursor] > 0) {
+                return static_cast<long long>(cursor);
+            }
+            cursor++;
+        }
+        return -1;
+    };
+
+    long long fanning = skipDeadEnd();
+    while (fanning >= 0) {
+        candidates.clear();
+
+        for (uint32_t i = adjacency.offsets[fanning]; i < adjacency.offsets[fanning + 1]; i++) {
+            const uint32_t triangle = adjacency.triangles[i];
+            if (emitted[triangle]) {
+                continue;
+            }
+            emitted[triangle] = true;
+
+            for (int k = 0; k < 3; k++) {
+                GLuint vertex = indices[3 * triangle + k];
+                result.push_back(vertex);
+                deadEnd.push_back(vertex);
+                candidates.push_back(vertex);
+                liveTriangles[vertex]--;
+                if (time - cacheTimestamps[vertex] > cacheSize) {
+                    cacheTimestamps[vertex] = time++;
+                }
+            }
+        }
+
+        // Лучший кандидат - вершина, которая останется в кеше после вывода всех ее треугольников, причем самая старая из таких.
+        long long best = -1;
+        long long bestPriority = -1;
+        for (GLuint vertex : candidates) {
+            if (liveTriangles[vertex] == 0) {
+                continue;
+            }
+            long long priority = 0;
+            if (time - cacheTimestamps[vertex] + 2 * liveTriangles[vertex] <= cacheSize) {
+                priority = time - cacheTimestamps[vertex];
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                best = vertex;
+            }
+        }
+
+        fanning = best >= 0 ? best : skipDeadEnd();
+    }
+
+    assert(result.size() == indices.size());
+    indices.swap(result);
+}
+
+size_t optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<glm::vec3>& positions, unsigned int cacheSize, float threshold)
+{
+    const size_t trianglesCount = indices.size() / 3;
+    if (trianglesCount == 0) {
+        return 0;
+    }
+
+    // Жесткие границы: треугольник, все вершины которого не в кеше, - начало нового веера Tipsify.
+    std::vector<size_t> hardBoundaries;
+    {
+        FifoCache cache(positions.size(), cacheSize);
+        for (size_t t = 0; t < trianglesCount; t++) {
+            int misses = 0;
+            for (int k = 0; k < 3; k++) {
+                misses += cache.access(indices[3 * t + k]) ? 1 : 0;
+            }
+            if (t == 0 || misses == 3) {
+                hardBoundaries.push_back(t);
+            }
+        }
+        hardBoundaries.push_back(trianglesCount);
+    }
+
+    // Мягкие границы: отрезок делится там, где накопленный ACMR уже не хуже ACMR всего отрезка больше чем в threshold раз.
+    std::vector<size_t> boundaries;
+    {
+        FifoCache cache(positions.size(), cacheSize);
+        for (size_t h = 0; h + 1 < hardBoundaries.size(); h++) {
+            const size_t start = hardBoundaries[h];
+            const size_t end = hardBoundaries[h + 1];
+
+            cache.reset();
+            size_t misses = 0;
+            for (size_t t = start; t < end; t++) {
+                for (int k = 0; k < 3; k++) {
+                    misses += cache.access(indices[3 * t + k]) ? 1 : 0;
+                }
+            }
+            const float segmentAcmr = static_cast<float>(misses) / (end - start);
+
+            boundaries.push_back(start);
+            cache.reset();
+            misses = 0;
+            size_t clusterStart = start;
+            for (size_t t = start; t < end; t++) {
+                for (int k = 0; k < 3; k++) {
+                    misses += cache.access(indices[3 * t + k]) ? 1 : 0;
+                }
+
+                const float clusterAcmr = static_cast<float>(misses) / (t + 1 - clusterStart);
+                if (t + 1 < end && clusterAcmr <= segmentAcmr * threshold) {
+                    boundaries.push_back(t + 1);
+                    clusterStart = t + 1;
+                    misses = 0;
+                    cache.reset();
+                }
+            }
+        }
+        boundaries.push_back(trianglesCount);
+    }
+
+    std::vector<size_t> order = sortClustersForOverdraw(indices, positions, boundaries);
+
+    std::vector<GLuint> result;
+    result.reserve(indices.size());
+    for (size_t c : order) {
+        result.insert(result.end(), indices.begin() + 3 * boundaries[c], indices.begin() + 3 * boundaries[c + 1]);
+    }
+    indices.swap(result);
+
+    return order.size();
+}
+
+size_t optimizeVertexFetch(std::vector<GLuint>& indices, size_t verticesCount, std::vector<GLuint>& remap)
+{
+    remap.assign(verticesCount, ~0u);
+
+    GLuint next = 0;
+    for (GLuint& index : indices) {
+        if (remap[index] == ~0u) {
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+    return next;
+}
+
+IndexOptimizationReport optimizeIndices(std::vector<GLuint>& indices, const std::vector<glm::vec3>& positions,
+                                        const IndexOptimizationSettings& settings, std::vector<GLuint>& remap, size_t& usedCount)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    IndexOptimizationReport report;
+    report.before = analyzeVertexCache(indices, positions.size(), settings.cacheSize);
+
+    optimizeVertexCache(indices, positions.size(), settings.cacheSize);
+    if (settings.overdraw) {
+        report.overdrawClustersCount = optimizeOverdraw(indices, positions, settings.cacheSize, settings.overdrawThreshold);
+    }
+
+    usedCount = remapVertices(indices, positions.size(), settings, remap);
+
+    report.after = analyzeVertexCache(indices, usedCount, settings.cacheSize);
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+IndexOptimizationReport optimizeMeshletIndices(std::vector<GLuint>& indices, const std::vector<glm::vec3>& positions,
+                                               const IndexOptimizationSettings& settings, std::vector<Meshlet>& meshlets,
+                                               std::vector<GLuint>& remap, size_t& usedCount)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    IndexOptimizationReport report;
+    report.before = analyzeVertexCache(indices, positions.size(), settings.cacheSize);
+
+    meshlets = buildMeshlets(positions, indices);
+
+    // Tipsify внутри кластера: вершины кластера временно нумеруются с нуля, чтобы не заводить массивы на весь меш.
+    std::vector<GLuint> local(positions.size(), ~0u);
+    std::vector<GLuint> global;
+    std::vector<GLuint> range;
+    for (const Meshlet& meshlet : meshlets) {
+        auto first = indices.begin() + meshlet.firstIndex;
+        auto last = first + 3 * meshlet.trianglesCount;
+
+        global.clear();
+        range.assign(first, last);
+        for (GLuint& index : range) {
+            if (local[index] == ~0u) {
+                local[index] = static_cast<GLuint>(global.size());
+                global.push_back(index);
+            }
+            index = local[index];
+        }
+
+        optimizeVertexCache(range, global.size(), settings.cacheSize);
+
+        for (size_t i = 0; i < range.size(); i++) {
+            first[i] = global[range[i]];
+        }
+        for (GLuint vertex : global) {
+            local[vertex] = ~0u;
+        }
+    }
+
+    if (settings.overdraw && meshlets.size() > 1) {
+        std::vector<size_t> boundaries;
+        boundaries.reserve(meshlets.size() + 1);
+        for (const Meshlet& meshlet : meshlets) {
+            boundaries.push_back(meshlet.firstIndex / 3);
+        }
+        boundaries.push_back(indices.size() / 3);
+
+        std::vector<size_t> order = sortClustersForOverdraw(indices, positions, boundaries);
+
+        std::vector<GLuint> result;
+        result.reserve(indices.size());
+        std::vector<Meshlet> sorted;
+        sorted.reserve(meshlets.size());
+        for (size_t c : order) {
+            sorted.push_back(meshlets[c]);
+            sorted.back().firstIndex = static_cast<GLuint>(result.size());
+            result.insert(result.end(), indices.begin() + 3 * boundaries[c], indices.begin() + 3 * boundaries[c + 1]);
+        }
+        indices.swap(result);
+        meshlets.swap(sorted);
+        report.overdrawClustersCount = meshlets.size();
+    }
+
+    usedCount = remapVertices(indices, positions.size(), settings, remap);
+
+    report.after = analyzeVertexCache(indices, usedCount, settings.cacheSize);
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+std::ostream& operator<<(std::ostream& stream, const IndexOptimizationReport& report)
+{
+    std::ios::fmtflags flags = stream.flags();
+    std::streamsize precision = stream.precision();
+    stream << std::fixed << std::setprecision(3)
+           << "ACMR " << report.before.acmr << " -> " << report.after.acmr
+           << ", ATVR " << report.before.atvr << " -> " << report.after.atvr;
+    if (report.overdrawClustersCount > 0) {
+        stream << ", " << report.overdrawClustersCount << " overdraw clusters";
+    }
+    stream << std::setprecision(1) << " (" << report.seconds * 1000.0 << " ms)";
+    stream.flags(flags);
+    stream.precision(precision);
+    return stream;
+}
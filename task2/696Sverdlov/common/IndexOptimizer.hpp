@@ -0,0 +1,153 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <GL/glew.h>
+
+#include "Meshlets.hpp"
+
+#include <initializer_list>
+#include <iosfwd>
+#include <vector>
+
+/**
+Оптимизация индексных буферов треугольных мешей. Этапы выполняются в таком порядке:
+1. optimizeVertexCache - порядок треугольников для кеша вершин после преобразования (алгоритм Tipsify, Sander, Nehab, Barczak 2007);
+2. optimizeOverdraw - делит результат на кластеры с почти той же эффективностью кеша и сортирует кластеры так,
+   что обращенные наружу рисуются первыми и закрывают внутренние (там же, раздел о перерисовке);
+3. optimizeVertexFetch - перенумеровывает вершины в порядке первого использования, чтобы чтение вершинного буфера шло подряд.
+Для мешей, рисуемых кластерами (см. buildMeshlets), те же этапы выполняются над кластерами (см. optimizeMeshletIndices):
+кластеры строятся первыми, потому что сами переставляют треугольники и сломали бы порядок Tipsify.
+Все этапы дорогие по сравнению с отрисовкой, поэтому их результат рассчитан на сохранение в MeshCache.
+*/
+
+/**
+Эффективность кеша вершин на модели FIFO-кеша заданного размера
+*/
+struct VertexCacheStats
+{
+    ///Average cache miss ratio: преобразованных вершин на треугольник (от 0.5 у больших регулярных сеток до 3)
+    float acmr = 0.0f;
+
+    ///Average transformed vertex ratio: преобразованных вершин на используемую вершину (1 - каждая вершина ровно один раз)
+    float atvr = 0.0f;
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& indices, size_t verticesCount, unsigned int cacheSize = 16);
+
+struct IndexOptimizationSettings
+{
+    ///Размер кеша, под который оптимизирует Tipsify
+    unsigned int cacheSize = 16;
+
+    /**
+    Сортировать кластеры для уменьшения перерисовки. Меняет порядок отрисовки треугольников,
+    поэтому выключается для полупрозрачных мешей, нарисованных без сортировки
+    */
+    bool overdraw = true;
+
+    ///Насколько ACMR кластера может быть хуже ACMR всего отрезка Tipsify (1.05 - на 5%)
+    float overdrawThreshold = 1.05f;
+
+    bool vertexFetch = true;
+};
+
+struct IndexOptimizationReport
+{
+    VertexCacheStats before;
+    VertexCacheStats after;
+
+    size_t overdrawClustersCount = 0;
+    double seconds = 0.0;
+};
+
+std::ostream& operator<<(std::ostream& stream, const IndexOptimizationReport& report);
+
+void optimizeVertexCache(std::vector<GLuint>& indices, size_t verticesCount, unsigned int cacheSize = 16);
+
+/**
+Переставляет кластеры треугольников, упорядоченных optimizeVertexCache
+\return количество кластеров
+*/
+size_t optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<glm::vec3>& positions, unsigned int cacheSize = 16, float threshold = 1.05f);
+
+/**
+Перенумеровывает вершины в порядке первого использования и меняет indices
+\param remap новый номер каждой старой вершины (~0u для неиспользуемых)
+\return количество используемых вершин
+*/
+size_t optimizeVertexFetch(std::vector<GLuint>& indices, size_t verticesCount, std::vector<GLuint>& remap);
+
+/**
+Переставляет атрибуты вершин по результату optimizeVertexFetch
+*/
+template <class T>
+void remapVertexArray(std::vector<T>& vertices, const std::vector<GLuint>& remap, size_t usedCount)
+{
+    if (vertices.empty()) {
+        return;
+    }
+
+    std::vector<T> remapped(usedCount);
+    for (size_t i = 0; i < remap.size(); i++) {
+        if (remap[i] != ~0u) {
+            remapped[remap[i]] = vertices[i];
+        }
+    }
+    vertices.swap(remapped);
+}
+
+/**
+Выполняет все включенные этапы над индексами. remap и usedCount - результат optimizeVertexFetch (тождественная перестановка, если этап выключен)
+*/
+IndexOptimizationReport optimizeIndices(std::vector<GLuint>& indices, const std::vector<glm::vec3>& positions,
+                                        const IndexOptimizationSettings& settings, std::vector<GLuint>& remap, size_t& usedCount);
+
+/**
+То же, что optimizeIndices, и переставляет вершины. positions используются для сортировки кластеров и переставляются вместе с остальными атрибутами
+\param attributes остальные атрибуты вершин (пустые массивы пропускаются)
+*/
+template <class... Attributes>
+IndexOptimizationReport optimizeIndexedMesh(std::vector<GLuint>& indices, std::vector<glm::vec3>& positions,
+                                            const IndexOptimizationSettings& settings, std::vector<Attributes>&... attributes)
+{
+    std::vector<GLuint> remap;
+    size_t usedCount = 0;
+    IndexOptimizationReport report = optimizeIndices(indices, positions, settings, remap, usedCount);
+
+    if (settings.vertexFetch) {
+        remapVertexArray(positions, remap, usedCount);
+        (void)std::initializer_list<int>{ (remapVertexArray(attributes, remap, usedCount), 0)... };
+    }
+    return report;
+}
+
+/**
+Строит кластеры (см. buildMeshlets) и оптимизирует индексы, не нарушая их: Tipsify переставляет треугольники внутри каждого кластера,
+сортировка для уменьшения перерисовки переставляет кластеры целиком (по тому же признаку, что и optimizeOverdraw),
+и последней перенумеровываются вершины в итоговом порядке индексов. report.after описывает именно итоговый индексный буфер.
+Сферы и конусы кластеров не зависят от нумерации вершин и остаются верными после remapVertexArray
+*/
+IndexOptimizationReport optimizeMeshletIndices(std::vector<GLuint>& indices, const std::vector<glm::vec3>& positions,
+                                               const IndexOptimizationSettings& settings, std::vector<Meshlet>& meshlets,
+                                               std::vector<GLuint>& remap, size_t& usedCount);
+
+/**
+То же, что optimizeMeshletIndices, и переставляет вершины (см. optimizeIndexedMesh)
+*/
+template <class... Attributes>
+IndexOptimizationReport optimizeMeshletMesh(std::vector<GLuint>& indices, std::vector<glm::vec3>& positions,
+                                            const IndexOptimizationSettings& settings, std::vector<Meshlet>& meshlets,
+                                            std::vector<Attributes>&... attributes)
+{
+    std::vector<GLuint> remap;
+    size_t usedCount = 0;
+    IndexOptimizationReport report = optimizeMeshletIndices(indices, positions, settings, meshlets, remap, usedCount);
+
+    if (settings.vertexFetch) {
+        remapVertexArray(positions, remap, usedCount);
+        (void)std::initializer_list<int>{ (remapVertexArray(attributes, remap, usedCount), 0)... };
+    }
+    return report;
+}
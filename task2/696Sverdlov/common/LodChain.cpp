@@ -0,0 +1,144 @@
+#include "LodChain.hpp"
+#include "MeshCache.hpp"
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+LodChain::LodChain(const glm::vec3& boundingCenter, float boundingRadius, float pixelsPerCell, float hysteresis) :
+    _boundingCenter(boundingCenter),
+    _boundingRadius(boundingRadius),
+    _pixelsPerCell(pixelsPerCell),
+    _hysteresis(hysteresis)
+{
+}
+
+void LodChain::addLevel(const MeshPtr& mesh, unsigned int detail, float error)
+{
+    assert(_levels.empty() || _levels.back().detail > detail);
+    _levels.push_back(Level{ mesh, detail, error });
+}
+
+unsigned int LodChain::detailForError(float error) const
+{
+    const float maxDetail = static_cast<float>(std::numeric_limits<unsigned int>::max() / 2);
+    if (error <= 0.0f) {
+        return std::numeric_limits<unsigned int>::max();
+    }
+    return static_cast<unsigned int>(std::max(1.0f, std::min(2.0f * _boundingRadius / error, maxDetail)));
+}
+
+float LodChain::projectedSize(const CameraInfo& camera, const glm::mat4& modelMatrix, int viewportHeight) const
+{
+    glm::vec4 centerCamSpace = camera.viewMatrix * modelMatrix * glm::vec4(_boundingCenter, 1.0f);
+
+    float scale = std::max(glm::length(glm::vec3(modelMatrix[0])), std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+    float radius = _boundingRadius * scale;
+
+    float distance = -centerCamSpace.z;
+    if (distance <= radius) {
+        return std::numeric_limits<float>::infinity(); //камера внутри сферы или сфера позади камеры
+    }
+
+    //projMatrix[1][1] = ctg(fovy / 2): диаметр 2r на расстоянии d занимает 2r * ctg / (2d) высоты экрана
+    return radius * camera.projMatrix[1][1] / distance * viewportHeight;
+}
+
+size_t LodChain::select(const CameraInfo& camera, const glm::mat4& modelMatrix, int viewportHeight, size_t& currentLevel) const
+{
+    assert(!_levels.empty());
+    currentLevel = std::min(currentLevel, _levels.size() - 1);
+
+    const float requiredDetail = projectedSize(camera, modelMatrix, viewportHeight) / _pixelsPerCell;
+
+    // Недостаточно подробный уровень меняем сразу.
+    while (currentLevel > 0 && _levels[currentLevel].detail < requiredDetail) {
+        currentLevel--;
+    }
+
+    // Огрубляем только с запасом.
+    while (currentLevel + 1 < _levels.size() && _levels[currentLevel + 1].detail >= requiredDetail * (1.0f + _hysteresis)) {
+        currentLevel++;
+    }
+
+    return currentLevel;
+}
+
+LodChainPtr loadLodChainFromFile(const std::string& filename, int meshIndex, const std::vector<float>& ratios,
+                                 VertexFormat format, const MeshCache* cache, float maxPixelError)
+{
+    const std::string baseKey = meshFileCacheKey(filename, meshIndex, format);
+
+    // Ключ исходного уровня совпадает с ключом loadFromFile, поэтому запись в кеше общая.
+    std::vector<std::string> keys(1, baseKey);
+    for (float ratio : ratios) {
+        std::ostringstream key;
+        key << baseKey << ":simplified=" << ratio;
+        keys.push_back(key.str());
+    }
+
+    std::vector<MeshPtr> meshes(keys.size());
+    if (cache) {
+        for (size_t i = 0; i < keys.size(); i++) {
+            meshes[i] = cache->load(keys[i]);
+        }
+    }
+
+    if (std::find(meshes.begin(), meshes.end(), nullptr) != meshes.end()) {
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::vec3> normals;
+        std::vector<glm::vec2> texcoords;
+        std::vector<GLuint> indices;
+        if (!readMeshFile(filename, meshIndex, vertices, normals, texcoords, indices)) {
+            return nullptr;
+        }
+
+        for (size_t i = 0; i < meshes.size(); i++) {
+            if (meshes[i]) {
+                continue;
+            }
+
+            std::ostringstream name;
+            name << "Mesh " << meshIndex << " of " << filename;
+
+            if (i == 0) {
+                meshes[i] = makeIndexedMesh(vertices, normals, texcoords, indices, format, name.str());
+            }
+            else {
+                name << " simplified to " << ratios[i - 1];
+
+                SimplificationResult simplified = simplifyMesh(indices, vertices, static_cast<size_t>(indices.size() * ratios[i - 1]));
+                std::cout << name.str() << ": " << simplified << "\n";
+
+                meshes[i] = makeIndexedMesh(vertices, normals, texcoords, std::move(simplified.indices), format, name.str());
+                meshes[i]->setSimplificationError(simplified.error);
+            }
+
+            if (cache) {
+                cache->store(keys[i], *meshes[i]);
+            }
+        }
+    }
+
+    // Упрощенные уровни используют подмножество исходных вершин, поэтому сфера исходного меша ограничивает все уровни.
+    const glm::vec4 sphere = meshes[0]->boundingSphere();
+    LodChainPtr lods = std::make_shared<LodChain>(glm::vec3(sphere), sphere.w, maxPixelError);
+
+    for (const MeshPtr& mesh : meshes) {
+        const unsigned int detail = lods->detailForError(mesh->simplificationError());
+        if (lods->levelsCount() > 0) {
+            const LodChain::Level& previous = lods->level(lods->levelsCount() - 1);
+            if (detail >= previous.detail || mesh->getIndicesCount() >= previous.mesh->getIndicesCount()) {
+                std::cout << "Simplified level with " << mesh->getTrianglesCount() << " triangles is skipped: it is not coarser than the previous one\n";
+                continue;
+            }
+        }
+
+        lods->addLevel(mesh, detail, mesh->simplificationError());
+    }
+
+    return lods;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Camera.hpp"
+#include "Mesh.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+Цепочка уровней детализации одной модели.
+Уровни упорядочены от самого подробного к самому грубому и разделяются всеми экземплярами модели,
+а текущий уровень хранит каждый экземпляр сам (см. select).
+Уровень выбирается по размеру ограничивающей сферы на экране: на одну ячейку сетки
+должно приходиться не больше pixelsPerCell пикселей.
+У упрощенных мешей вместо ячеек сетки - геометрическая ошибка (см. detailForError), и pixelsPerCell - допустимая ошибка в пикселях.
+*/
+class LodChain
+{
+public:
+    struct Level {
+        MeshPtr mesh;
+
+        ///Количество ячеек сетки вдоль модели (для равномерной сетки - gridSize)
+        unsigned int detail;
+
+        ///Оценка отклонения от самого подробного уровня в локальной системе координат (см. Mesh::simplificationError; 0 - не оценивалось)
+        float error;
+    };
+
+    /**
+    \param boundingRadius радиус ограничивающей сферы в локальной системе координат модели
+    \param pixelsPerCell желаемый размер ячейки сетки на экране
+    \param hysteresis запас, с которым уровень огрубляется: грубый уровень выбирается, только если он подходит
+    и при размере на экране, увеличенном в (1 + hysteresis) раз. Так модель на границе двух уровней не мерцает
+    */
+    LodChain(const glm::vec3& boundingCenter, float boundingRadius, float pixelsPerCell = 4.0f, float hysteresis = 0.25f);
+
+    /**
+    Добавляет уровень. Уровни должны добавляться от подробного к грубому
+    */
+    void addLevel(const MeshPtr& mesh, unsigned int detail, float error = 0.0f);
+
+    /**
+    Детализация уровня с геометрической ошибкой error: сколько раз ошибка укладывается в диаметр ограничивающей сферы.
+    Уровень без ошибки подходит при любом размере на экране
+    */
+    unsigned int detailForError(float error) const;
+
+    /**
+    Размер ограничивающей сферы на экране в пикселях (по вертикали)
+    */
+    float projectedSize(const CameraInfo& camera, const glm::mat4& modelMatrix, int viewportHeight) const;
+
+    /**
+    Выбирает уровень для кадра с учетом гистерезиса
+    \param currentLevel уровень экземпляра на предыдущем кадре, обновляется
+    */
+    size_t select(const CameraInfo& camera, const glm::mat4& modelMatrix, int viewportHeight, size_t& currentLevel) const;
+
+    const Level& level(size_t index) const { return _levels[index]; }
+    size_t levelsCount() const { return _levels.size(); }
+
+    const glm::vec3& boundingCenter() const { return _boundingCenter; }
+    float boundingRadius() const { return _boundingRadius; }
+    float pixelsPerCell() const { return _pixelsPerCell; }
+    float hysteresis() const { return _hysteresis; }
+
+protected:
+    glm::vec3 _boundingCenter;
+    float _boundingRadius;
+    float _pixelsPerCell;
+    float _hysteresis;
+
+    std::vector<Level> _levels;
+};
+
+typedef std::shared_ptr<LodChain> LodChainPtr;
+
+class MeshCache;
+
+/**
+Загружает меш из внешнего файла (см. loadFromFile) и строит цепочку его упрощений (см. simplifyMesh).
+Каждый уровень сохраняет долю ratios[i] треугольников исходного меша и упрощается из исходного меша, а не из предыдущего уровня.
+Уровень, который не стал грубее предыдущего, пропускается.
+Если задан cache, уровни ищутся в нем и сохраняются туда, поэтому упрощение выполняется один раз
+\param maxPixelError допустимая ошибка уровня на экране в пикселях
+\return nullptr, если файл не удалось прочитать
+*/
+LodChainPtr loadLodChainFromFile(const std::string& filename, int meshIndex = 0, const std::vector<float>& ratios = { 0.5f, 0.25f, 0.125f },
+                                 VertexFormat format = VertexFormat::Float, const MeshCache* cache = nullptr, float maxPixelError = 1.0f);
@@ -1,13 +1,260 @@
 #include "Mesh.hpp"
+#include "IndexOptimizer.hpp"
+#include "MeshCache.hpp"
+#include "VertexLayout.hpp"
+#include "VertexQuantization.hpp"
 
 #include <assimp/cimport.h>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <type_traits>
 #include <vector>
 
-MeshPtr makeSphere(float radius, unsigned int N)
+std::vector<VertexAttributeState> Mesh::queryAttributes() const
+{
+    std::vector<VertexAttributeState> attributes;
+
+    glBindVertexArray(_vao);
+
+    GLint maxAttributes = 0;
+    glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxAttributes);
+    for (GLint i = 0; i < maxAttributes; i++) {
+        GLint enabled = 0;
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+        if (!enabled) {
+            continue;
+        }
+
+        GLint buffer, size, type, normalized, integer, stride;
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_SIZE, &size);
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_TYPE, &type);
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &normalized);
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_INTEGER, &integer);
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+
+        void* pointer = nullptr;
+        glGetVertexAttribPointerv(i, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
+
+        VertexAttributeState attribute;
+        attribute.index = i;
+        attribute.size = size;
+        attribute.type = type;
+        attribute.normalized = static_cast<GLboolean>(normalized);
+        attribute.integer = static_cast<GLboolean>(integer);
+        attribute.stride = stride;
+        attribute.offset = static_cast<GLuint>(reinterpret_cast<uintptr_t>(pointer));
+        attribute.buffer = buffer;
+        attributes.push_back(attribute);
+    }
+
+    glBindVertexArray(0);
+
+    return attributes;
+}
+
+GLuint Mesh::queryIndexBuffer() const
+{
+    glBindVertexArray(_vao);
+
+    GLint buffer = 0;
+    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &buffer);
+
+    glBindVertexArray(0);
+
+    return buffer;
+}
+
+namespace
+{
+    bool computeBoundingBox(const std::vector<const std::vector<glm::vec3>*>& positions, glm::vec3& boundsMin, glm::vec3& boundsMax)
+    {
+        boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+        for (const std::vector<glm::vec3>* points : positions) {
+            for (const glm::vec3& p : *points) {
+                boundsMin = glm::min(boundsMin, p);
+                boundsMax = glm::max(boundsMax, p);
+            }
+        }
+        return boundsMin.x <= boundsMax.x; //false, если нет ни одной точки
+    }
+
+    /**
+    Упаковывает атрибуты в формат format и передает массив вершин (MeshVertex или QuantizedMeshVertex) в use
+    \return отчет о сжатии (нулевой для VertexFormat::Float)
+    */
+    template <class Use>
+    VertexQuantizationReport packVertices(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& texcoords,
+                      VertexFormat format, glm::mat4& dequantizationMatrix, Use&& use)
+    {
+        const glm::vec3 noNormal(0.0f);
+        const glm::vec2 noTexcoord(0.0f);
+
+        if (format == VertexFormat::Quantized) {
+            const PositionQuantization quantization = PositionQuantization::fit({ &vertices });
+
+            VertexQuantizationReport report;
+            std::vector<QuantizedMeshVertex> packed(vertices.size());
+            for (size_t i = 0; i < vertices.size(); i++) {
+                packed[i].position = quantizePosition(vertices[i], quantization, report);
+                packed[i].normal = packNormal(normals.empty() ? noNormal : normals[i], report);
+                packed[i].texcoord = packTexcoord(texcoords.empty() ? noTexcoord : texcoords[i], report);
+            }
+
+            dequantizationMatrix = quantization.dequantizationMatrix();
+            use(packed);
+            return report;
+        }
+
+        std::vector<MeshVertex> interleaved(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            interleaved[i].position = vertices[i];
+            interleaved[i].normal = normals.empty() ? noNormal : normals[i];
+            interleaved[i].texcoord = texcoords.empty() ? noTexcoord : texcoords[i];
+        }
+
+        dequantizationMatrix = glm::mat4(1.0f);
+        use(interleaved);
+        return VertexQuantizationReport();
+    }
+
+    /**
+    Дописывает отчет о сжатии к сообщению о создании меша (ничего, если атрибуты во float)
+    */
+    void printQuantizationReport(std::ostream& stream, const VertexQuantizationReport& report)
+    {
+        if (report.quantizedBytes > 0) {
+            stream << "; " << report;
+        }
+    }
+
+    /**
+    Загружает упакованные вершины в буфер меша (приемник для packVertices)
+    */
+    struct VertexBufferUpload
+    {
+        Mesh& mesh;
+        VertexStreams streams;
+
+        template <class Vertex>
+        void operator()(const std::vector<Vertex>& packed) const
+        {
+            setVertexBuffer(mesh, packed, streams);
+        }
+    };
+
+    /**
+    Копирует упакованные вершины и их раскладку в MeshData (приемник для packVertices)
+    */
+    struct VertexDataCopy
+    {
+        MeshData& data;
+
+        template <class Vertex>
+        void operator()(const std::vector<Vertex>& packed) const
+        {
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(packed.data());
+            data.vertexData.assign(bytes, bytes + packed.size() * sizeof(Vertex));
+            data.attributes = describeVertexLayout<Vertex>();
+        }
+    };
+}
+
+void computeBounds(Mesh& mesh, const std::vector<const std::vector<glm::vec3>*>& positions)
+{
+    glm::vec3 boundsMin, boundsMax;
+    if (!computeBoundingBox(positions, boundsMin, boundsMax)) {
+        return; //нет ни одной точки
+    }
+    mesh.setBounds(boundsMin, boundsMax);
+    mesh.setBoundingSphere(computeBoundingSphere(positions));
+}
+
+glm::vec4 computeBoundingSphere(const std::vector<const std::vector<glm::vec3>*>& positions)
+{
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+    glm::vec3 first(0.0f);
+    bool empty = true;
+    for (const std::vector<glm::vec3>* points : positions) {
+        for (const glm::vec3& p : *points) {
+            boundsMin = glm::min(boundsMin, p);
+            boundsMax = glm::max(boundsMax, p);
+            if (empty) {
+                first = p;
+                empty = false;
+            }
+        }
+    }
+    if (empty) {
+        return glm::vec4(0.0f);
+    }
+
+    // Сфера вокруг центра параллелепипеда.
+    glm::vec3 boxCenter = 0.5f * (boundsMin + boundsMax);
+    float boxRadius2 = 0.0f;
+    for (const std::vector<glm::vec3>* points : positions) {
+        for (const glm::vec3& p : *points) {
+            boxRadius2 = std::max(boxRadius2, glm::dot(p - boxCenter, p - boxCenter));
+        }
+    }
+
+    // Сфера Риттера: начинаем с пары далеких точек и расширяем сферу до каждой точки снаружи.
+    glm::vec3 a = first, b = first;
+    for (const std::vector<glm::vec3>* points : positions) {
+        for (const glm::vec3& p : *points) {
+            if (glm::dot(p - first, p - first) > glm::dot(a - first, a - first)) a = p;
+        }
+    }
+    for (const std::vector<glm::vec3>* points : positions) {
+        for (const glm::vec3& p : *points) {
+            if (glm::dot(p - a, p - a) > glm::dot(b - a, b - a)) b = p;
+        }
+    }
+    glm::vec3 center = 0.5f * (a + b);
+    float radius = 0.5f * glm::length(b - a);
+    for (const std::vector<glm::vec3>* points : positions) {
+        for (const glm::vec3& p : *points) {
+            float distance = glm::length(p - center);
+            if (distance > radius) {
+                float newRadius = 0.5f * (radius + distance);
+                center += (distance - newRadius) / distance * (p - center);
+                radius = newRadius;
+            }
+        }
+    }
+
+    // Выбираем меньшую из двух сфер; запас компенсирует округление при расширении.
+    float boxRadius = std::sqrt(boxRadius2);
+    if (boxRadius <= radius) {
+        return glm::vec4(boxCenter, boxRadius);
+    }
+    return glm::vec4(center, radius * (1.0f + 1e-5f));
+}
+
+void setVertexAttributes(Mesh& mesh, const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& normals,
+                         const std::vector<glm::vec2>& texcoords, VertexFormat format, VertexStreams streams)
+{
+    computeBounds(mesh, { &vertices });
+
+    glm::mat4 dequantizationMatrix;
+    VertexBufferUpload upload = { mesh, streams };
+    mesh.setQuantizationReport(packVertices(vertices, normals, texcoords, format, dequantizationMatrix, upload));
+    if (format == VertexFormat::Quantized) {
+        mesh.setDequantizationMatrix(dequantizationMatrix);
+    }
+}
+
+MeshPtr makeSphere(float radius, unsigned int N, VertexFormat format)
 {
     unsigned int M = N / 2;
 
@@ -55,28 +302,19 @@ MeshPtr makeSphere(float radius, unsigned int N)
 
     //----------------------------------------
 
-    DataBufferPtr buf0 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-    buf0->setData(vertices.size() * sizeof(float) * 3, vertices.data());
-
-    DataBufferPtr buf1 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-    buf1->setData(normals.size() * sizeof(float) * 3, normals.data());
-
-    DataBufferPtr buf2 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-    buf2->setData(texcoords.size() * sizeof(float) * 2, texcoords.data());
-
     MeshPtr mesh = std::make_shared<Mesh>();
-    mesh->setAttribute(0, 3, GL_FLOAT, GL_FALSE, 0, 0, buf0);
-    mesh->setAttribute(1, 3, GL_FLOAT, GL_FALSE, 0, 0, buf1);
-    mesh->setAttribute(2, 2, GL_FLOAT, GL_FALSE, 0, 0, buf2);
+    setVertexAttributes(*mesh, vertices, normals, texcoords, format);
     mesh->setPrimitiveType(GL_TRIANGLES);
     mesh->setVertexCount(vertices.size());
 
-    std::cout << "Sphere is created with " << vertices.size() << " vertices\n";
+    std::cout << "Sphere is created with " << vertices.size() << " vertices";
+    printQuantizationReport(std::cout, mesh->quantizationReport());
+    std::cout << "\n";
 
     return mesh;
 }
 
-MeshPtr makeCube(float size)
+MeshPtr makeCube(float size, VertexFormat format)
 {
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec3> normals;
@@ -240,23 +478,14 @@ MeshPtr makeCube(float size)
 
     //----------------------------------------
 
-    DataBufferPtr buf0 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-    buf0->setData(vertices.size() * sizeof(float) * 3, vertices.data());
-
-    DataBufferPtr buf1 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-    buf1->setData(normals.size() * sizeof(float) * 3, normals.data());
-
-    DataBufferPtr buf2 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-    buf2->setData(texcoords.size() * sizeof(float) * 2, texcoords.data());
-
     MeshPtr mesh = std::make_shared<Mesh>();
-    mesh->setAttribute(0, 3, GL_FLOAT, GL_FALSE, 0, 0, buf0);
-    mesh->setAttribute(1, 3, GL_FLOAT, GL_FALSE, 0, 0, buf1);
-    mesh->setAttribute(2, 2, GL_FLOAT, GL_FALSE, 0, 0, buf2);
+    setVertexAttributes(*mesh, vertices, normals, texcoords, format);
     mesh->setPrimitiveType(GL_TRIANGLES);
     mesh->setVertexCount(vertices.size());
 
-    std::cout << "Cube is created with " << vertices.size() << " vertices\n";
+    std::cout << "Cube is created with " << vertices.size() << " vertices";
+    printQuantizationReport(std::cout, mesh->quantizationReport());
+    std::cout << "\n";
 
     return mesh;
 }
@@ -284,11 +513,12 @@ MeshPtr makeScreenAlignedQuad()
     mesh->setAttribute(0, 3, GL_FLOAT, GL_FALSE, 0, 0, buf0);
     mesh->setPrimitiveType(GL_TRIANGLES);
     mesh->setVertexCount(vertices.size());
+    computeBounds(*mesh, { &vertices });
 
     return mesh;
 }
 
-MeshPtr makeGroundPlane(float size, float numTiles)
+MeshPtr makeGroundPlane(float size, float numTiles, VertexFormat format)
 {
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec3> normals;
@@ -322,36 +552,30 @@ MeshPtr makeGroundPlane(float size, float numTiles)
 
     //----------------------------------------
 
-    DataBufferPtr buf0 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-    buf0->setData(vertices.size() * sizeof(float) * 3, vertices.data());
-
-    DataBufferPtr buf1 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-    buf1->setData(normals.size() * sizeof(float) * 3, normals.data());
-
-    DataBufferPtr buf2 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-    buf2->setData(texcoords.size() * sizeof(float) * 2, texcoords.data());
-
     MeshPtr mesh = std::make_shared<Mesh>();
-    mesh->setAttribute(0, 3, GL_FLOAT, GL_FALSE, 0, 0, buf0);
-    mesh->setAttribute(1, 3, GL_FLOAT, GL_FALSE, 0, 0, buf1);
-    mesh->setAttribute(2, 2, GL_FLOAT, GL_FALSE, 0, 0, buf2);
+    setVertexAttributes(*mesh, vertices, normals, texcoords, format);
     mesh->setPrimitiveType(GL_TRIANGLES);
     mesh->setVertexCount(vertices.size());
 
+    std::cout << "Ground plane is created with " << vertices.size() << " vertices";
+    printQuantizationReport(std::cout, mesh->quantizationReport());
+    std::cout << "\n";
+
     return mesh;
 }
 
-MeshPtr loadFromAIMesh(const aiMesh &assimpMesh) {
+bool readAIMesh(const aiMesh &assimpMesh, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals,
+                std::vector<glm::vec2>& texcoords, std::vector<GLuint>& indices) {
 	if (!assimpMesh.HasPositions())
 	{
 		std::cerr << "This demo does not support meshes without positions\n";
-		return std::make_shared<Mesh>();
+		return false;
 	}
 
 	if (!assimpMesh.HasNormals())
 	{
 		std::cerr << "This demo does not support meshes without normals\n";
-		return std::make_shared<Mesh>();
+		return false;
 	}
 
 	if (!assimpMesh.HasTextureCoords(0))
@@ -359,24 +583,25 @@ MeshPtr loadFromAIMesh(const aiMesh &assimpMesh) {
 		std::cerr << "Mesh with no texture coords for texture unit 0 can cause strange visualization\n";
 	}
 
-	DataBufferPtr buf0 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-	buf0->setData(assimpMesh.mNumVertices * sizeof(float) * 3, assimpMesh.mVertices);
-
-	DataBufferPtr buf1 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-	buf1->setData(assimpMesh.mNumVertices * sizeof(float) * 3, assimpMesh.mNormals);
-
-
-	MeshPtr mesh = std::make_shared<Mesh>();
-	mesh->setAttribute(0, 3, GL_FLOAT, GL_FALSE, 0, 0, buf0);
-	mesh->setAttribute(1, 3, GL_FLOAT, GL_FALSE, 0, 0, buf1);
-	mesh->setPrimitiveType(GL_TRIANGLES);
-	mesh->setVertexCount(assimpMesh.mNumVertices);
+	vertices.resize(assimpMesh.mNumVertices);
+	normals.resize(assimpMesh.mNumVertices);
+	texcoords.clear();
+	for (unsigned int i = 0; i < assimpMesh.mNumVertices; i++) {
+		vertices[i] = glm::vec3(assimpMesh.mVertices[i].x, assimpMesh.mVertices[i].y, assimpMesh.mVertices[i].z);
+		normals[i] = glm::vec3(assimpMesh.mNormals[i].x, assimpMesh.mNormals[i].y, assimpMesh.mNormals[i].z);
+	}
 
-	// Upload indices.
-	DataBufferPtr indexBuf = std::make_shared<DataBuffer>(GL_ELEMENT_ARRAY_BUFFER);
+	// Optional texcoords0.
+	if (assimpMesh.HasTextureCoords(0)) {
+		texcoords.resize(assimpMesh.mNumVertices);
+		for (unsigned int i = 0; i < assimpMesh.mNumVertices; i++) {
+			texcoords[i] = glm::vec2(assimpMesh.mTextureCoords[0][i].x, assimpMesh.mTextureCoords[0][i].y);
+		}
+	}
 
-	std::vector<unsigned int> indices(3 * assimpMesh.mNumFaces);
-	for (int i = 0; i < assimpMesh.mNumFaces; i++) {
+	indices.clear();
+	indices.reserve(3 * assimpMesh.mNumFaces);
+	for (unsigned int i = 0; i < assimpMesh.mNumFaces; i++) {
 		const aiFace &face = assimpMesh.mFaces[i];
 		if (face.mNumIndices != 3)
 			continue;
@@ -384,45 +609,168 @@ MeshPtr loadFromAIMesh(const aiMesh &assimpMesh) {
 		indices.push_back(face.mIndices[1]);
 		indices.push_back(face.mIndices[2]);
 	}
-	indexBuf->setData(indices.size() * sizeof(unsigned int), indices.data());
-	mesh->setIndices(indices.size(), indexBuf);
+	return true;
+}
 
-	// Optional upload texcoords0.
-	if (assimpMesh.HasTextureCoords(0)) {
-		DataBufferPtr buf2 = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
-		buf2->setData(assimpMesh.mNumVertices * sizeof(float) * 3, assimpMesh.mTextureCoords[0]);
-		mesh->setAttribute(2, 3, GL_FLOAT, GL_FALSE, 0, 0, buf2);
+MeshData prepareIndexedMesh(std::vector<glm::vec3> vertices, std::vector<glm::vec3> normals, std::vector<glm::vec2> texcoords,
+                            std::vector<GLuint> indices, VertexFormat format, const std::string& name) {
+	// Треугольники кластера идут в индексном буфере подряд, поэтому кластер рисуется одним диапазоном.
+	// Кластеры строятся до оптимизации индексов, иначе их порядок ломает Tipsify; вершины переставляются в порядке
+	// первого использования, поэтому все это идет до упаковки атрибутов. Неиспользуемые вершины при этом отбрасываются.
+	MeshData data;
+	IndexOptimizationReport optimization = optimizeMeshletMesh(indices, vertices, IndexOptimizationSettings(), data.meshlets, normals, texcoords);
+
+	data.name = name;
+	data.vertexCount = static_cast<GLuint>(vertices.size());
+
+	if (computeBoundingBox({ &vertices }, data.boundsMin, data.boundsMax)) {
+		data.boundingSphere = computeBoundingSphere({ &vertices });
 	}
 
-	std::cout << "Mesh " << assimpMesh.mName.data << " is loaded with " << assimpMesh.mNumVertices << " vertices\n";
+	VertexDataCopy copy = { data };
+	data.quantizationReport = packVertices(vertices, normals, texcoords, format, data.dequantizationMatrix, copy);
+	data.indices = std::move(indices);
+
+	// Может выполняться в рабочем потоке: сообщение собирается целиком, чтобы строки разных потоков не перемешивались.
+	std::ostringstream message;
+	message << name << " is prepared with " << data.vertexCount << " vertices, " << data.indices.size() / 3 << " triangles, "
+	        << data.meshlets.size() << " meshlets; " << optimization;
+	printQuantizationReport(message, data.quantizationReport);
+	message << "\n";
+	std::cout << message.str();
+	return data;
+}
+
+MeshPtr makeMeshFromBuffers(const MeshData& data, const DataBufferPtr& vertexBuffer, const DataBufferPtr& indexBuffer) {
+	MeshPtr mesh = std::make_shared<Mesh>();
+	for (const VertexAttributeState& attribute : data.attributes) {
+		if (attribute.integer) {
+			mesh->setAttributeI(attribute.index, attribute.size, attribute.type, attribute.stride, attribute.offset, vertexBuffer);
+		}
+		else {
+			mesh->setAttribute(attribute.index, attribute.size, attribute.type, attribute.normalized, attribute.stride, attribute.offset, vertexBuffer);
+		}
+	}
+
+	mesh->setPrimitiveType(GL_TRIANGLES);
+	mesh->setVertexCount(data.vertexCount);
+	mesh->setIndices(data.indices.size(), indexBuffer);
+
+	mesh->setBounds(data.boundsMin, data.boundsMax);
+	mesh->setBoundingSphere(data.boundingSphere);
+	mesh->setDequantizationMatrix(data.dequantizationMatrix);
+	mesh->setQuantizationReport(data.quantizationReport);
+	mesh->setMeshlets(data.meshlets);
 	return mesh;
 }
 
-MeshPtr loadFromFile(const std::string& filename, int meshIndex)
+MeshPtr uploadMeshData(const MeshData& data) {
+	DataBufferPtr vertexBuffer = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
+	vertexBuffer->setData(data.vertexData.size(), data.vertexData.data());
+
+	DataBufferPtr indexBuffer = std::make_shared<DataBuffer>(GL_ELEMENT_ARRAY_BUFFER);
+	indexBuffer->setData(data.indices.size() * sizeof(GLuint), data.indices.data());
+
+	return makeMeshFromBuffers(data, vertexBuffer, indexBuffer);
+}
+
+MeshPtr makeIndexedMesh(std::vector<glm::vec3> vertices, std::vector<glm::vec3> normals, std::vector<glm::vec2> texcoords,
+                        std::vector<GLuint> indices, VertexFormat format, const std::string& name) {
+	return uploadMeshData(prepareIndexedMesh(std::move(vertices), std::move(normals), std::move(texcoords), std::move(indices), format, name));
+}
+
+MeshPtr loadFromAIMesh(const aiMesh &assimpMesh, VertexFormat format) {
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> texcoords;
+	std::vector<GLuint> indices;
+	if (!readAIMesh(assimpMesh, vertices, normals, texcoords, indices)) {
+		return std::make_shared<Mesh>();
+	}
+
+	return makeIndexedMesh(std::move(vertices), std::move(normals), std::move(texcoords), std::move(indices), format,
+	                       std::string("Mesh ") + assimpMesh.mName.data);
+}
+
+const aiScene* importAssimpFile(const std::string& filename, unsigned int flags)
 {
-    aiEnableVerboseLogging(true);
-    auto stream = aiGetPredefinedLogStream(aiDefaultLogStream_STDOUT, nullptr);
-    aiAttachLogStream(&stream);
+    static std::mutex mutex;
+    static bool logAttached = false;
 
-    const struct aiScene* assimpScene = aiImportFile(filename.c_str(),
-		    aiProcessPreset_TargetRealtime_MaxQuality);
+    std::lock_guard<std::mutex> lock(mutex);
 
+    if (!logAttached) {
+        aiEnableVerboseLogging(true);
+        aiLogStream stream = aiGetPredefinedLogStream(aiDefaultLogStream_STDOUT, nullptr);
+        aiAttachLogStream(&stream);
+        logAttached = true;
+    }
+
+    const aiScene* assimpScene = aiImportFile(filename.c_str(), flags);
     if (!assimpScene)
     {
         std::cerr << aiGetErrorString() << std::endl;
-        return std::make_shared<Mesh>();
     }
+    return assimpScene;
+}
 
-    if (assimpScene->mNumMeshes <= meshIndex)
+bool readMeshFile(const std::string& filename, int meshIndex, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals,
+                  std::vector<glm::vec2>& texcoords, std::vector<GLuint>& indices)
+{
+    const aiScene* assimpScene = importAssimpFile(filename, aiProcessPreset_TargetRealtime_MaxQuality);
+    if (!assimpScene)
+    {
+        return false;
+    }
+
+    bool result = false;
+    if (meshIndex < 0 || assimpScene->mNumMeshes <= static_cast<unsigned int>(meshIndex))
     {
         std::cerr << "Wrong mesh index " << meshIndex << " for file " << filename << std::endl;
+    }
+    else
+    {
+        result = readAIMesh(*assimpScene->mMeshes[meshIndex], vertices, normals, texcoords, indices);
+    }
+
+    aiReleaseImport(assimpScene);
+
+    return result;
+}
+
+std::string meshFileCacheKey(const std::string& filename, int meshIndex, VertexFormat format)
+{
+    std::ostringstream key;
+    key << "assimp:" << std::hex << MeshCache::hashFile(filename) << std::dec << ":" << meshIndex << ":" << static_cast<int>(format);
+    return key.str();
+}
+
+MeshPtr loadFromFile(const std::string& filename, int meshIndex, VertexFormat format, const MeshCache* cache)
+{
+    std::string cacheKey;
+    if (cache) {
+        cacheKey = meshFileCacheKey(filename, meshIndex, format);
+
+        if (MeshPtr cached = cache->load(cacheKey)) {
+            return cached;
+        }
+    }
+
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> texcoords;
+    std::vector<GLuint> indices;
+    if (!readMeshFile(filename, meshIndex, vertices, normals, texcoords, indices)) {
         return std::make_shared<Mesh>();
     }
 
-    auto mesh = loadFromAIMesh(*assimpScene->mMeshes[meshIndex]);
+    std::ostringstream name;
+    name << "Mesh " << meshIndex << " of " << filename;
+    auto mesh = makeIndexedMesh(std::move(vertices), std::move(normals), std::move(texcoords), std::move(indices), format, name.str());
 
-    aiReleaseImport(assimpScene);
-    aiDetachAllLogStreams();
+    if (cache) {
+        cache->store(cacheKey, *mesh);
+    }
 
     return mesh;
 }
\ No newline at end of file
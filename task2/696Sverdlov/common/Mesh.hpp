@@ -7,11 +7,14 @@
 
 #include <GL/glew.h>
 
+#include <cstdint>
+#include <iosfwd>
 #include <string>
 #include <map>
 #include <memory>
 #include <vector>
 #include "Common.h"
+#include "Meshlets.hpp"
 
 /**
 Абстракция буфера с данными в видеопамяти
@@ -43,11 +46,22 @@ public:
     Копирует данные из оперативной памяти в видеопамять, выделяя память под данные при необходимости
     \param size размер данных в байтах
     \param data указатель на начало массива данных в оперативной памяти
+    \param usage подсказка о характере использования (GL_STATIC_DRAW, GL_STREAM_DRAW и другие)
     */
-    void setData(GLsizeiptr size, const GLvoid* data)
+    void setData(GLsizeiptr size, const GLvoid* data, GLenum usage = GL_STATIC_DRAW)
     {
         glBindBuffer(_target, _vbo);
-        glBufferData(_target, size, data, GL_STATIC_DRAW);
+        glBufferData(_target, size, data, usage);
+        glBindBuffer(_target, 0);
+    }
+
+    /**
+    Копирует данные в часть уже выделенной памяти буфера (например, порциями по кадрам, см. MeshLoader)
+    */
+    void setSubData(GLintptr offset, GLsizeiptr size, const GLvoid* data)
+    {
+        glBindBuffer(_target, _vbo);
+        glBufferSubData(_target, offset, size, data);
         glBindBuffer(_target, 0);
     }
 
@@ -71,6 +85,8 @@ public:
     */
     GLuint id() const { return _vbo; }
 
+    GLenum target() const { return _target; }
+
 protected:
     DataBuffer(const DataBuffer&) = delete;
     void operator=(const DataBuffer&) = delete;
@@ -84,6 +100,44 @@ protected:
 
 typedef std::shared_ptr<DataBuffer> DataBufferPtr;
 
+/**
+Параметры вершинного атрибута, как они записаны в VAO (см. Mesh::queryAttributes)
+*/
+struct VertexAttributeState
+{
+    GLuint index = 0;
+    GLint size = 0;
+    GLenum type = GL_FLOAT;
+    GLboolean normalized = GL_FALSE;
+    GLboolean integer = GL_FALSE;
+    GLsizei stride = 0;
+    GLuint offset = 0;
+
+    ///Буфер, из которого читается атрибут
+    GLuint buffer = 0;
+};
+
+/**
+Сколько памяти сэкономлено и какая ошибка внесена сжатием атрибутов одного меша (см. VertexQuantization.hpp)
+*/
+struct VertexQuantizationReport
+{
+    size_t floatBytes = 0;
+    size_t quantizedBytes = 0;
+
+    ///Максимальное отклонение позиции в единицах координат модели
+    float maxPositionError = 0.0f;
+
+    ///Максимальный угол между исходной и распакованной нормалью в градусах
+    float maxNormalError = 0.0f;
+
+    float maxTexcoordError = 0.0f;
+
+    size_t savedBytes() const { return floatBytes - quantizedBytes; }
+};
+
+std::ostream& operator<<(std::ostream& stream, const VertexQuantizationReport& report);
+
 /**
 Абстракция полигональной модели
 Инкапсулирует:
@@ -194,6 +248,54 @@ public:
     */
     void setModelMatrix(const glm::mat4& m) { _modelMatrix = m; }
 
+    /**
+    Преобразование квантованных позиций в локальные координаты (единичное для позиций во float).
+    Позиции нужно умножать на modelMatrix() * dequantizationMatrix(), а нормали - преобразовывать без него
+    */
+    glm::mat4 dequantizationMatrix() const { return _dequantizationMatrix; }
+
+    void setDequantizationMatrix(const glm::mat4& m) { _dequantizationMatrix = m; }
+
+    /**
+    Экономия памяти и ошибка сжатия атрибутов (нулевой отчет для атрибутов во float)
+    */
+    const VertexQuantizationReport& quantizationReport() const { return _quantizationReport; }
+
+    void setQuantizationReport(const VertexQuantizationReport& report) { _quantizationReport = report; }
+
+    /**
+    Ограничивающий параллелепипед в локальной системе координат (после деквантования)
+    */
+    glm::vec3 boundsMin() const { return _boundsMin; }
+    glm::vec3 boundsMax() const { return _boundsMax; }
+
+    void setBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        _boundsMin = boundsMin;
+        _boundsMax = boundsMax;
+    }
+
+    /**
+    Ограничивающая сфера в локальной системе координат: центр (xyz) и радиус (w)
+    */
+    glm::vec4 boundingSphere() const { return _boundingSphere; }
+
+    void setBoundingSphere(const glm::vec4& sphere) { _boundingSphere = sphere; }
+
+    /**
+    Кластеры индексного буфера (см. buildMeshlets). Пустой массив - меш рисуется целиком
+    */
+    const std::vector<Meshlet>& meshlets() const { return _meshlets; }
+
+    void setMeshlets(std::vector<Meshlet> meshlets) { _meshlets = std::move(meshlets); }
+
+    /**
+    Оценка ошибки упрощения в локальной системе координат (среднеквадратичная, см. SimplificationResult::error). 0 - меш не упрощался
+    */
+    float simplificationError() const { return _simplificationError; }
+
+    void setSimplificationError(float error) { _simplificationError = error; }
+
     GLuint getTrianglesCount() const {
         if (_hasIndices)
             return _indicesCount / 3;
@@ -207,6 +309,14 @@ public:
     void draw() const
     {
         glBindVertexArray(_vao);
+        drawBound();
+    }
+
+    /**
+    Рисует модель, когда ее VAO уже привязан (см. RenderQueue)
+    */
+    void drawBound() const
+    {
         if (_hasIndices) {
             glDrawElements(_primitiveType, _indicesCount, GL_UNSIGNED_INT, nullptr);
         }
@@ -224,7 +334,7 @@ public:
     /**
      * Запускает multiDraw по одним и тем же смещениям.
      * Ненатурально, используется для демонстрации.
-     * Случай с несколькими мэшами в одном буфере потребует задания смещений.
+     * Несколько мешей в общих буферах рисуются через GeometryArena и GeometryDrawList.
      */
     void multiDraw(GLsizei drawCount) {
         glBindVertexArray(_vao);
@@ -261,6 +371,22 @@ public:
 
 	GLsizei getVertexCount() const { return _vertexCount; }
 
+    /**
+    Читает из VAO параметры всех включенных атрибутов
+    */
+    std::vector<VertexAttributeState> queryAttributes() const;
+
+    /**
+    Читает из VAO идентификатор индексного буфера (0, если его нет)
+    */
+    GLuint queryIndexBuffer() const;
+
+    GLuint getPrimitiveType() const { return _primitiveType; }
+
+    bool hasIndices() const { return _hasIndices; }
+
+    GLuint getIndicesCount() const { return _indicesCount; }
+
     GLuint getVAO() const { return _vao; }
 
 protected:
@@ -287,21 +413,68 @@ protected:
 
     ///Матрица модели (local to world)
     glm::mat4 _modelMatrix;
+
+    ///Матрица деквантования позиций (quantized to local)
+    glm::mat4 _dequantizationMatrix = glm::mat4(1.0f);
+    VertexQuantizationReport _quantizationReport;
+
+    glm::vec3 _boundsMin = glm::vec3(0.0f);
+    glm::vec3 _boundsMax = glm::vec3(0.0f);
+    glm::vec4 _boundingSphere = glm::vec4(0.0f);
+
+    std::vector<Meshlet> _meshlets;
+
+    float _simplificationError = 0.0f;
 };
 
 typedef std::shared_ptr<Mesh> MeshPtr;
 
 //=========== Функции для создания тестовых мешей
 
+/**
+Формат вершинных атрибутов, создаваемых функциями ниже
+*/
+enum class VertexFormat {
+    Float,     ///< позиции и нормали vec3, текстурные координаты vec2 во float
+    Quantized, ///< сжатые атрибуты (см. VertexQuantization.hpp), позиции требуют Mesh::dequantizationMatrix
+};
+
+/**
+Расположение атрибутов в буферах (см. setVertexBuffer в VertexLayout.hpp)
+*/
+enum class VertexStreams {
+    Interleaved, ///< один буфер, атрибуты вершины лежат подряд
+    Separate,    ///< отдельный буфер на каждый атрибут
+};
+
+/**
+Загружает позиции, нормали и текстурные координаты в атрибуты 0, 1 и 2 в заданном формате.
+Недостающие нормали и текстурные координаты (пустые массивы) заполняются нулями
+*/
+void setVertexAttributes(Mesh& mesh, const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& normals,
+                         const std::vector<glm::vec2>& texcoords, VertexFormat format,
+                         VertexStreams streams = VertexStreams::Interleaved);
+
+/**
+Вычисляет ограничивающий параллелепипед и ограничивающую сферу всех точек из positions
+(несколько массивов - например, поверхности, между которыми морфирует меш)
+*/
+void computeBounds(Mesh& mesh, const std::vector<const std::vector<glm::vec3>*>& positions);
+
+/**
+Ограничивающая сфера точек (меньшая из сферы Риттера и сферы с центром в центре параллелепипеда): центр (xyz) и радиус (w)
+*/
+glm::vec4 computeBoundingSphere(const std::vector<const std::vector<glm::vec3>*>& positions);
+
 /**
 Создает модель сферы
 */
-MeshPtr makeSphere(float radius, unsigned int N = 100);
+MeshPtr makeSphere(float radius, unsigned int N = 100, VertexFormat format = VertexFormat::Float);
 
 /**
 Создает модель куба размером 2 * size
 */
-MeshPtr makeCube(float size);
+MeshPtr makeCube(float size, VertexFormat format = VertexFormat::Float);
 
 /**
 Создает прямоугольник (2 треугольника), заполняющий экран (координаты в Clip Space)
@@ -312,12 +485,92 @@ MeshPtr makeScreenAlignedQuad();
 Создает плоскость земли размером от -size до +size по осям XY
 Генерирует текстурные координаты, так чтобы на плоскости размещалось 2 * numTiles по каждой оси
 */
-MeshPtr makeGroundPlane(float size, float numTiles);
+MeshPtr makeGroundPlane(float size, float numTiles, VertexFormat format = VertexFormat::Float);
+
+/**
+Индексный меш в оперативной памяти, готовый к загрузке в видеопамять: атрибуты упакованы в один чередующийся буфер.
+Создается без контекста OpenGL, поэтому может готовиться в рабочих потоках (см. MeshLoader)
+*/
+struct MeshData
+{
+    std::string name;
+
+    std::vector<uint8_t> vertexData;
+
+    ///Раскладка vertexData (поле buffer не используется)
+    std::vector<VertexAttributeState> attributes;
+
+    GLuint vertexCount = 0;
+    std::vector<GLuint> indices;
+    std::vector<Meshlet> meshlets;
+
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    glm::vec4 boundingSphere = glm::vec4(0.0f);
+    glm::mat4 dequantizationMatrix = glm::mat4(1.0f);
+    VertexQuantizationReport quantizationReport;
+
+    size_t bytesCount() const { return vertexData.size() + indices.size() * sizeof(GLuint); }
+};
+
+/**
+Готовит индексный меш: строит кластеры и оптимизирует индексы и порядок вершин внутри них (см. optimizeMeshletIndices)
+и упаковывает атрибуты. Пустые normals и texcoords заполняются нулями. Не обращается к OpenGL
+*/
+MeshData prepareIndexedMesh(std::vector<glm::vec3> vertices, std::vector<glm::vec3> normals, std::vector<glm::vec2> texcoords,
+                            std::vector<GLuint> indices, VertexFormat format, const std::string& name);
+
+/**
+Создает меш над буферами, уже заполненными содержимым data.vertexData и data.indices
+*/
+MeshPtr makeMeshFromBuffers(const MeshData& data, const DataBufferPtr& vertexBuffer, const DataBufferPtr& indexBuffer);
+
+/**
+Загружает подготовленный меш в видеопамять целиком
+*/
+MeshPtr uploadMeshData(const MeshData& data);
+
+/**
+То же, что uploadMeshData(prepareIndexedMesh(...))
+*/
+MeshPtr makeIndexedMesh(std::vector<glm::vec3> vertices, std::vector<glm::vec3> normals, std::vector<glm::vec2> texcoords,
+                        std::vector<GLuint> indices, VertexFormat format, const std::string& name);
 
 class aiMesh;
-MeshPtr loadFromAIMesh(const aiMesh &sourceMesh);
+struct aiScene;
+
+/**
+Импортирует файл через Assimp (aiImportFile) и печатает ошибку, если импорт не удался. Результат освобождается aiReleaseImport.
+Журнал и последняя ошибка Assimp общие для процесса, поэтому импорты из разных потоков (MeshLoader, loadScene) выполняются
+по очереди под одной блокировкой, а журнал подключается один раз, при первом импорте
+*/
+const aiScene* importAssimpFile(const std::string& filename, unsigned int flags);
+
+/**
+Читает атрибуты и треугольники меша Assimp без загрузки в видеопамять. texcoords пустой, если у меша нет текстурных координат
+\return false, если меш не поддерживается
+*/
+bool readAIMesh(const aiMesh &sourceMesh, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals,
+                std::vector<glm::vec2>& texcoords, std::vector<GLuint>& indices);
+
+MeshPtr loadFromAIMesh(const aiMesh &sourceMesh, VertexFormat format = VertexFormat::Float);
+
+class MeshCache;
+
+/**
+То же, что readAIMesh, для меша meshIndex из внешнего файла
+*/
+bool readMeshFile(const std::string& filename, int meshIndex, std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals,
+                  std::vector<glm::vec2>& texcoords, std::vector<GLuint>& indices);
+
+/**
+Ключ MeshCache для меша из файла: хеш содержимого файла, индекс меша и формат
+*/
+std::string meshFileCacheKey(const std::string& filename, int meshIndex, VertexFormat format);
 
 /**
-Загружает меш из внешнего файла с помощью библиотеки Assimp
+Загружает меш из внешнего файла с помощью библиотеки Assimp.
+Если задан cache, меш ищется в нем по хешу содержимого файла, индексу меша и формату, а после импорта сохраняется туда.
+Каждый вызов импортирует файл целиком; несколько мешей одного файла лучше загружать через loadScene (SceneImport.hpp)
 */
-MeshPtr loadFromFile(const std::string& filename, int meshIndex = 0);
\ No newline at end of file
+MeshPtr loadFromFile(const std::string& filename, int meshIndex = 0, VertexFormat format = VertexFormat::Float, const MeshCache* cache = nullptr);
\ No newline at end of file
@@ -0,0 +1,448 @@
+#include "MeshCache.hpp"
+#include "Hash.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char MAGIC[4] = { 'M', 'S', 'H', 'C' };
+    const uint32_t NO_BUFFER = 0xffffffffu;
+    const uint64_t DATA_ALIGNMENT = 16;
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t keyLength;
+        uint32_t buffersCount;
+        uint32_t attributesCount;
+        uint32_t meshletsCount;
+        uint32_t primitiveType;
+        uint32_t vertexCount;
+        uint32_t indicesCount;
+        uint32_t indexBuffer; //номер буфера с индексами или NO_BUFFER
+        float boundsMin[3];
+        float boundsMax[3];
+        float boundingSphere[4];
+        float dequantization[16];
+        float simplificationError;
+        float quantizationErrors[3]; //VertexQuantizationReport: позиция, нормаль, текстурные координаты
+        uint64_t floatBytes;
+        uint64_t quantizedBytes;
+    };
+
+    struct BufferRecord
+    {
+        uint64_t offset; //от начала файла
+        uint64_t size;
+    };
+
+    struct AttributeRecord
+    {
+        uint32_t index;
+        int32_t size;
+        uint32_t type;
+        uint32_t normalized;
+        uint32_t integer;
+        int32_t stride;
+        uint32_t buffer;
+        uint32_t offset;
+    };
+
+    struct MeshletRecord
+    {
+        uint32_t firstIndex;
+        uint32_t trianglesCount;
+        uint32_t verticesCount;
+        float boundingSphere[4];
+        float coneAxis[3];
+        float coneCutoff;
+    };
+
+    uint64_t alignUp(uint64_t value)
+    {
+        return (value + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+    }
+
+    /**
+    Файл, отображенный в память только для чтения
+    */
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::string& filename)
+        {
+#ifdef _WIN32
+            _file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (_file == INVALID_HANDLE_VALUE) {
+                return;
+            }
+
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+                return;
+            }
+
+            _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (!_mapping) {
+                return;
+            }
+
+            _data = static_cast<const uint8_t*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+            _size = _data ? static_cast<size_t>(size.QuadPart) : 0;
+#else
+            _fd = open(filename.c_str(), O_RDONLY);
+            if (_fd < 0) {
+                return;
+            }
+
+            struct stat info;
+            if (fstat(_fd, &info) != 0 || info.st_size == 0) {
+                return;
+            }
+
+            void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (data == MAP_FAILED) {
+                return;
+            }
+
+            _data = static_cast<const uint8_t*>(data);
+            _size = static_cast<size_t>(info.st_size);
+#endif
+        }
+
+        ~MappedFile()
+        {
+#ifdef _WIN32
+            if (_data) UnmapViewOfFile(_data);
+            if (_mapping) CloseHandle(_mapping);
+            if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+#else
+            if (_data) munmap(const_cast<uint8_t*>(_data), _size);
+            if (_fd >= 0) close(_fd);
+#endif
+        }
+
+        const uint8_t* data() const { return _data; }
+        size_t size() const { return _size; }
+
+    private:
+        MappedFile(const MappedFile&) = delete;
+        void operator=(const MappedFile&) = delete;
+
+        const uint8_t* _data = nullptr;
+        size_t _size = 0;
+
+#ifdef _WIN32
+        HANDLE _file = INVALID_HANDLE_VALUE;
+        HANDLE _mapping = NULL;
+#else
+        int _fd = -1;
+#endif
+    };
+
+    void makeDirectory(const std::string& directory)
+    {
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+
+    std::vector<uint8_t> readBuffer(GLuint buffer)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+
+        GLint size = 0;
+        glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+
+        std::vector<uint8_t> data(size);
+        if (size > 0) {
+            glGetBufferSubData(GL_COPY_READ_BUFFER, 0, size, data.data());
+        }
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        return data;
+    }
+}
+
+MeshCache::MeshCache(const std::string& directory) :
+    _directory(directory)
+{
+    makeDirectory(_directory);
+}
+
+uint64_t MeshCache::hashFile(const std::string& filename)
+{
+    MappedFile file(filename);
+    return file.data() ? fnv1a(file.data(), file.size()) : 0;
+}
+
+std::string MeshCache::pathForKey(const std::string& key) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.mesh", static_cast<unsigned long long>(fnv1a(key.data(), key.size())));
+    return _directory + "/" + name;
+}
+
+bool MeshCache::contains(const std::string& key) const
+{
+    std::ifstream stream(pathForKey(key), std::ios::binary);
+
+    FileHeader header;
+    if (!stream.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.keyLength != key.size()) {
+        return false;
+    }
+
+    std::string storedKey(key.size(), '\0');
+    return stream.read(&storedKey[0], storedKey.size()) && storedKey == key;
+}
+
+MeshPtr MeshCache::load(const std::string& key) const
+{
+    auto start = std::chrono::steady_clock::now();
+
+    MappedFile file(pathForKey(key));
+    if (!file.data() || file.size() < sizeof(FileHeader)) {
+        return nullptr;
+    }
+
+    FileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+        return nullptr;
+    }
+
+    // Ключ хранится в файле целиком, чтобы совпадение хешей имен файлов не подменило меш.
+    const uint64_t recordsOffset = sizeof(FileHeader) + header.keyLength;
+    const uint64_t meshletsOffset = recordsOffset + header.buffersCount * sizeof(BufferRecord) + header.attributesCount * sizeof(AttributeRecord);
+    const uint64_t dataOffset = meshletsOffset + static_cast<uint64_t>(header.meshletsCount) * sizeof(MeshletRecord);
+    if (dataOffset > file.size() || header.keyLength != key.size() ||
+        std::memcmp(file.data() + sizeof(FileHeader), key.data(), key.size()) != 0) {
+        return nullptr;
+    }
+
+    std::vector<BufferRecord> bufferRecords(header.buffersCount);
+    std::vector<AttributeRecord> attributeRecords(header.attributesCount);
+    std::memcpy(bufferRecords.data(), file.data() + recordsOffset, bufferRecords.size() * sizeof(BufferRecord));
+    std::memcpy(attributeRecords.data(), file.data() + recordsOffset + bufferRecords.size() * sizeof(BufferRecord),
+                attributeRecords.size() * sizeof(AttributeRecord));
+
+    std::vector<Meshlet> meshlets(header.meshletsCount);
+    for (size_t i = 0; i < meshlets.size(); i++) {
+        MeshletRecord record;
+        std::memcpy(&record, file.data() + meshletsOffset + i * sizeof(MeshletRecord), sizeof(record));
+        if (record.firstIndex + 3ull * record.trianglesCount > header.indicesCount) {
+            return nullptr;
+        }
+
+        meshlets[i].firstIndex = record.firstIndex;
+        meshlets[i].trianglesCount = record.trianglesCount;
+        meshlets[i].verticesCount = record.verticesCount;
+        meshlets[i].boundingSphere = glm::make_vec4(record.boundingSphere);
+        meshlets[i].coneAxis = glm::make_vec3(record.coneAxis);
+        meshlets[i].coneCutoff = record.coneCutoff;
+    }
+
+    for (const BufferRecord& record : bufferRecords) {
+        if (record.offset > file.size() || record.size > file.size() - record.offset) {
+            std::cerr << "Mesh cache entry for " << key << " is truncated\n";
+            return nullptr;
+        }
+    }
+
+    std::vector<DataBufferPtr> buffers(bufferRecords.size());
+    for (size_t i = 0; i < bufferRecords.size(); i++) {
+        buffers[i] = std::make_shared<DataBuffer>(i == header.indexBuffer ? GL_ELEMENT_ARRAY_BUFFER : GL_ARRAY_BUFFER);
+        buffers[i]->setData(bufferRecords[i].size, file.data() + bufferRecords[i].offset);
+    }
+
+    MeshPtr mesh = std::make_shared<Mesh>();
+    for (const AttributeRecord& record : attributeRecords) {
+        if (record.buffer >= buffers.size()) {
+            return nullptr;
+        }
+
+        if (record.integer) {
+            mesh->setAttributeI(record.index, record.size, record.type, record.stride, record.offset, buffers[record.buffer]);
+        }
+        else {
+            mesh->setAttribute(record.index, record.size, record.type, record.normalized, record.stride, record.offset, buffers[record.buffer]);
+        }
+    }
+
+    mesh->setPrimitiveType(header.primitiveType);
+    mesh->setVertexCount(header.vertexCount);
+    if (header.indexBuffer < buffers.size()) {
+        mesh->setIndices(header.indicesCount, buffers[header.indexBuffer]);
+    }
+
+    mesh->setBounds(glm::make_vec3(header.boundsMin), glm::make_vec3(header.boundsMax));
+    mesh->setBoundingSphere(glm::make_vec4(header.boundingSphere));
+    mesh->setDequantizationMatrix(glm::make_mat4(header.dequantization));
+    mesh->setMeshlets(std::move(meshlets));
+    mesh->setSimplificationError(header.simplificationError);
+
+    VertexQuantizationReport report;
+    report.floatBytes = static_cast<size_t>(header.floatBytes);
+    report.quantizedBytes = static_cast<size_t>(header.quantizedBytes);
+    report.maxPositionError = header.quantizationErrors[0];
+    report.maxNormalError = header.quantizationErrors[1];
+    report.maxTexcoordError = header.quantizationErrors[2];
+    mesh->setQuantizationReport(report);
+
+    std::ostringstream message;
+    message << "Mesh " << key << " is loaded from cache (" << file.size() << " bytes) in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000.0 << " ms";
+    if (report.quantizedBytes > 0) {
+        message << "; " << report;
+    }
+    message << "\n";
+    std::cout << message.str();
+
+    return mesh;
+}
+
+bool MeshCache::store(const std::string& key, const Mesh& mesh) const
+{
+    FileHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.keyLength = static_cast<uint32_t>(key.size());
+    header.primitiveType = mesh.getPrimitiveType();
+    header.vertexCount = mesh.getVertexCount();
+    header.indicesCount = mesh.getIndicesCount();
+    header.indexBuffer = NO_BUFFER;
+
+    glm::vec3 boundsMin = mesh.boundsMin();
+    glm::vec3 boundsMax = mesh.boundsMax();
+    glm::vec4 boundingSphere = mesh.boundingSphere();
+    glm::mat4 dequantization = mesh.dequantizationMatrix();
+    std::memcpy(header.boundsMin, glm::value_ptr(boundsMin), sizeof(header.boundsMin));
+    std::memcpy(header.boundsMax, glm::value_ptr(boundsMax), sizeof(header.boundsMax));
+    std::memcpy(header.boundingSphere, glm::value_ptr(boundingSphere), sizeof(header.boundingSphere));
+    std::memcpy(header.dequantization, glm::value_ptr(dequantization), sizeof(header.dequantization));
+    header.simplificationError = mesh.simplificationError();
+
+    const VertexQuantizationReport& report = mesh.quantizationReport();
+    header.floatBytes = report.floatBytes;
+    header.quantizedBytes = report.quantizedBytes;
+    header.quantizationErrors[0] = report.maxPositionError;
+    header.quantizationErrors[1] = report.maxNormalError;
+    header.quantizationErrors[2] = report.maxTexcoordError;
+
+    // Раскладку атрибутов и буферы читаем из VAO: так сохраняется ровно то, что рисуется.
+    std::map<GLuint, uint32_t> bufferIndices;
+    std::vector<GLuint> bufferIds;
+    std::vector<AttributeRecord> attributeRecords;
+
+    auto bufferIndex = [&](GLuint id) {
+        auto inserted = bufferIndices.insert(std::make_pair(id, static_cast<uint32_t>(bufferIds.size())));
+        if (inserted.second) {
+            bufferIds.push_back(id);
+        }
+        return inserted.first->second;
+    };
+
+    for (const VertexAttributeState& attribute : mesh.queryAttributes()) {
+        AttributeRecord record;
+        record.index = attribute.index;
+        record.size = attribute.size;
+        record.type = attribute.type;
+        record.normalized = attribute.normalized;
+        record.integer = attribute.integer;
+        record.stride = attribute.stride;
+        record.buffer = bufferIndex(attribute.buffer);
+        record.offset = attribute.offset;
+        attributeRecords.push_back(record);
+    }
+
+    if (mesh.hasIndices()) {
+        header.indexBuffer = bufferIndex(mesh.queryIndexBuffer());
+    }
+
+    std::vector<MeshletRecord> meshletRecords;
+    for (const Meshlet& meshlet : mesh.meshlets()) {
+        MeshletRecord record;
+        record.firstIndex = meshlet.firstIndex;
+        record.trianglesCount = meshlet.trianglesCount;
+        record.verticesCount = meshlet.verticesCount;
+        std::memcpy(record.boundingSphere, glm::value_ptr(meshlet.boundingSphere), sizeof(record.boundingSphere));
+        std::memcpy(record.coneAxis, glm::value_ptr(meshlet.coneAxis), sizeof(record.coneAxis));
+        record.coneCutoff = meshlet.coneCutoff;
+        meshletRecords.push_back(record);
+    }
+
+    header.buffersCount = static_cast<uint32_t>(bufferIds.size());
+    header.attributesCount = static_cast<uint32_t>(attributeRecords.size());
+    header.meshletsCount = static_cast<uint32_t>(meshletRecords.size());
+
+    std::vector<std::vector<uint8_t>> bufferData;
+    std::vector<BufferRecord> bufferRecords;
+    uint64_t offset = alignUp(sizeof(FileHeader) + key.size() + bufferIds.size() * sizeof(BufferRecord) + attributeRecords.size() * sizeof(AttributeRecord) +
+                              meshletRecords.size() * sizeof(MeshletRecord));
+    for (GLuint id : bufferIds) {
+        bufferData.push_back(readBuffer(id));
+        bufferRecords.push_back(BufferRecord{ offset, bufferData.back().size() });
+        offset = alignUp(offset + bufferData.back().size());
+    }
+
+    // Пишем во временный файл и переименовываем, чтобы прерванная запись не оставила поврежденный файл под ключом.
+    const std::string path = pathForKey(key);
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!stream) {
+            std::cerr << "Failed to write mesh cache file " << temporaryPath << std::endl;
+            return false;
+        }
+
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(key.data(), key.size());
+        stream.write(reinterpret_cast<const char*>(bufferRecords.data()), bufferRecords.size() * sizeof(BufferRecord));
+        stream.write(reinterpret_cast<const char*>(attributeRecords.data()), attributeRecords.size() * sizeof(AttributeRecord));
+        stream.write(reinterpret_cast<const char*>(meshletRecords.data()), meshletRecords.size() * sizeof(MeshletRecord));
+
+        for (size_t i = 0; i < bufferData.size(); i++) {
+            const std::vector<char> padding(bufferRecords[i].offset - static_cast<uint64_t>(stream.tellp()), 0);
+            stream.write(padding.data(), padding.size());
+            stream.write(reinterpret_cast<const char*>(bufferData[i].data()), bufferData[i].size());
+        }
+
+        if (!stream) {
+            std::cerr << "Failed to write mesh cache file " << temporaryPath << std::endl;
+            return false;
+        }
+    }
+
+    std::remove(path.c_str());
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write mesh cache file " << path << std::endl;
+        return false;
+    }
+
+    return true;
+}
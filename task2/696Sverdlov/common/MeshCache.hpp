@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <string>
+
+/**
+Дисковый кеш готовых мешей в двоичном формате.
+Ключ - строка, однозначно описывающая меш: параметры генератора или хеш исходного файла.
+Файл содержит содержимое вершинных буферов и индексного буфера, раскладку атрибутов, границы, кластеры (Mesh::meshlets), матрицу деквантования, отчет о сжатии атрибутов и ошибку упрощения.
+Сохраняется то, что уже загружено в видеопамять (буферы читаются из VAO меша), поэтому подходит любой меш.
+При загрузке файл отображается в память, и буферы заполняются прямо из отображения, без промежуточных копий.
+*/
+class MeshCache
+{
+public:
+    ///Версия формата. Меняется при любом изменении формата файла или генераторов, чьи меши кешируются
+    static const uint32_t VERSION = 7;
+
+    explicit MeshCache(const std::string& directory);
+
+    /**
+    Загружает меш по ключу. Возвращает nullptr, если меша нет в кеше или файл устарел либо поврежден
+    */
+    MeshPtr load(const std::string& key) const;
+
+    /**
+    Есть ли в кеше файл текущей версии с этим ключом. Читает только заголовок и не обращается к OpenGL,
+    поэтому подходит для рабочих потоков; load при этом все еще может отказать, если файл поврежден
+    */
+    bool contains(const std::string& key) const;
+
+    /**
+    Сохраняет меш под ключом. Ошибки записи не фатальны: меш просто будет построен заново при следующем запуске
+    */
+    bool store(const std::string& key, const Mesh& mesh) const;
+
+    /**
+    Хеш содержимого файла (fnv1a; 0, если файл не читается)
+    */
+    static uint64_t hashFile(const std::string& filename);
+
+protected:
+    std::string pathForKey(const std::string& key) const;
+
+    std::string _directory;
+};
+
+typedef std::shared_ptr<MeshCache> MeshCachePtr;
@@ -0,0 +1,224 @@
+#include "MeshLoader.hpp"
+#include "MeshCache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+MeshLoader::MeshLoader(const Settings& settings, const MeshCache* cache) :
+    _settings(settings),
+    _cache(cache),
+    _pool(new ThreadPool(std::max(1u, settings.threadsCount)))
+{
+}
+
+MeshLoader::~MeshLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _queueHasSpace.notify_all();
+
+    // Задачи, которые еще не начались, завершаются сразу (см. import).
+    _pool.reset();
+}
+
+MeshRequestPtr MeshLoader::load(const std::string& filename, int meshIndex, VertexFormat format, const MeshPtr& placeholder)
+{
+    MeshRequestPtr request = std::make_shared<MeshRequest>(filename, meshIndex, format, placeholder);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stats.requestsCount++;
+    }
+    postImport(request);
+    return request;
+}
+
+void MeshLoader::postImport(const MeshRequestPtr& request)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _importingCount++;
+    }
+    request->_state = MeshRequest::State::Importing;
+    _pool->post([this, request]() { import(request); });
+}
+
+void MeshLoader::import(const MeshRequestPtr& request)
+{
+    std::unique_ptr<Upload> upload(new Upload());
+    upload->request = request;
+
+    bool stopping;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        stopping = _stopping;
+    }
+
+    bool prepared = false;
+    if (!stopping) {
+        // Хеш файла читает его целиком, поэтому ключ тоже считается здесь, а не в потоке OpenGL.
+        if (_cache && !request->_skipCache) {
+            upload->cacheKey = meshFileCacheKey(request->filename(), request->meshIndex(), request->format());
+            upload->cached = _cache->contains(upload->cacheKey);
+        }
+
+        if (upload->cached) {
+            prepared = true;
+        }
+        else {
+            std::vector<glm::vec3> vertices;
+            std::vector<glm::vec3> normals;
+            std::vector<glm::vec2> texcoords;
+            std::vector<GLuint> indices;
+            if (readMeshFile(request->filename(), request->meshIndex(), vertices, normals, texcoords, indices)) {
+                std::ostringstream name;
+                name << "Mesh " << request->meshIndex() << " of " << request->filename();
+                upload->data = prepareIndexedMesh(std::move(vertices), std::move(normals), std::move(texcoords), std::move(indices),
+                                                  request->format(), name.str());
+                prepared = true;
+            }
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _importingCount--;
+
+    if (!prepared) {
+        request->_state = MeshRequest::State::Failed;
+        _stats.failedCount += stopping ? 0 : 1;
+        return;
+    }
+
+    // Ограниченная очередь: ждем, пока поток OpenGL не загрузит уже подготовленные меши. Пустая очередь принимает любой меш.
+    const size_t bytes = upload->data.bytesCount();
+    _queueHasSpace.wait(lock, [this, bytes]() {
+        return _stopping || _stats.pendingCount == 0 || _stats.pendingBytes + bytes <= _settings.maxPendingBytes;
+    });
+    if (_stopping) {
+        request->_state = MeshRequest::State::Failed;
+        return;
+    }
+
+    _stats.pendingCount++;
+    _stats.pendingBytes += bytes;
+    request->_state = MeshRequest::State::Uploading;
+    _ready.push_back(std::move(upload));
+}
+
+size_t MeshLoader::processUploads()
+{
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [start]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+
+    size_t finishedCount = 0;
+    while (true) {
+        if (!_current) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_ready.empty()) {
+                break;
+            }
+            _current = std::move(_ready.front());
+            _ready.pop_front();
+        }
+
+        if (_current->cached) {
+            MeshPtr mesh = _cache->load(_current->cacheKey);
+            if (mesh) {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _stats.cacheHitsCount++;
+                }
+                finish(*_current, mesh);
+                finishedCount++;
+            }
+            else {
+                // Файл кеша поврежден или устарел между проверкой и чтением.
+                MeshRequestPtr request = _current->request;
+                request->_skipCache = true;
+                finish(*_current, nullptr);
+                postImport(request);
+            }
+            _current.reset();
+        }
+        else if (uploadChunk(*_current)) {
+            MeshPtr mesh = makeMeshFromBuffers(_current->data, _current->vertexBuffer, _current->indexBuffer);
+            if (_cache) {
+                _cache->store(_current->cacheKey.empty() ? meshFileCacheKey(_current->request->filename(), _current->request->meshIndex(), _current->request->format())
+                                                         : _current->cacheKey, *mesh);
+            }
+            finish(*_current, mesh);
+            finishedCount++;
+            _current.reset();
+        }
+
+        if (elapsed() >= _settings.uploadBudget) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.lastFrameSeconds = elapsed();
+    return finishedCount;
+}
+
+bool MeshLoader::uploadChunk(Upload& upload)
+{
+    const MeshData& data = upload.data;
+    const size_t vertexBytes = data.vertexData.size();
+    const size_t indexBytes = data.indices.size() * sizeof(GLuint);
+
+    if (!upload.vertexBuffer) {
+        upload.vertexBuffer = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
+        upload.vertexBuffer->setData(vertexBytes, nullptr);
+
+        upload.indexBuffer = std::make_shared<DataBuffer>(GL_ELEMENT_ARRAY_BUFFER);
+        upload.indexBuffer->setData(indexBytes, nullptr);
+    }
+
+    // Сначала вершины, затем индексы: смещение uploadedBytes сквозное по двум буферам.
+    size_t chunk = std::min(_settings.uploadChunkSize, vertexBytes + indexBytes - upload.uploadedBytes);
+    if (upload.uploadedBytes < vertexBytes) {
+        chunk = std::min(chunk, vertexBytes - upload.uploadedBytes);
+        upload.vertexBuffer->setSubData(upload.uploadedBytes, chunk, data.vertexData.data() + upload.uploadedBytes);
+    }
+    else if (chunk > 0) {
+        const size_t offset = upload.uploadedBytes - vertexBytes;
+        upload.indexBuffer->setSubData(offset, chunk, reinterpret_cast<const uint8_t*>(data.indices.data()) + offset);
+    }
+    upload.uploadedBytes += chunk;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.uploadedBytes += chunk;
+    return upload.uploadedBytes == vertexBytes + indexBytes;
+}
+
+void MeshLoader::finish(Upload& upload, const MeshPtr& mesh)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stats.pendingCount--;
+        _stats.pendingBytes -= upload.data.bytesCount();
+        _stats.loadedCount += mesh ? 1 : 0;
+    }
+    _queueHasSpace.notify_all();
+
+    if (mesh) {
+        upload.request->_mesh = mesh;
+        upload.request->_state = MeshRequest::State::Ready;
+    }
+}
+
+bool MeshLoader::idle() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _importingCount == 0 && _ready.empty() && !_current;
+}
+
+MeshLoader::Stats MeshLoader::getStats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
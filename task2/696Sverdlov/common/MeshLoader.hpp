@@ -0,0 +1,182 @@
+#pragma once
+
+#include "Mesh.hpp"
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class MeshCache;
+
+/**
+Запрос асинхронной загрузки одного меша (см. MeshLoader::load).
+Пока меш не загружен, mesh() возвращает заглушку, поэтому сцену можно рисовать сразу
+*/
+class MeshRequest
+{
+public:
+    enum class State {
+        Importing, ///< файл читается в рабочем потоке
+        Uploading, ///< меш подготовлен и ждет загрузки в видеопамять
+        Ready,
+        Failed,
+    };
+
+    MeshRequest(const std::string& filename, int meshIndex, VertexFormat format, const MeshPtr& placeholder) :
+        _filename(filename),
+        _meshIndex(meshIndex),
+        _format(format),
+        _placeholder(placeholder)
+    {
+    }
+
+    ///Состояние меняют и рабочие потоки
+    State state() const { return _state.load(); }
+
+    bool ready() const { return state() == State::Ready; }
+
+    /**
+    Загруженный меш или заглушка, пока загрузка не закончена. Вызывается только в потоке OpenGL
+    */
+    const MeshPtr& mesh() const { return _mesh ? _mesh : _placeholder; }
+
+    const std::string& filename() const { return _filename; }
+    int meshIndex() const { return _meshIndex; }
+    VertexFormat format() const { return _format; }
+
+protected:
+    friend class MeshLoader;
+
+    std::string _filename;
+    int _meshIndex;
+    VertexFormat _format;
+
+    MeshPtr _placeholder;
+    MeshPtr _mesh;
+
+    std::atomic<State> _state{ State::Importing };
+
+    ///Файл кеша оказался негодным, и меш импортируется заново
+    bool _skipCache = false;
+};
+
+typedef std::shared_ptr<MeshRequest> MeshRequestPtr;
+
+/**
+Асинхронная загрузка мешей из файлов в два этапа:
+1. импорт Assimp, оптимизация индексов и упаковка атрибутов в рабочих потоках (prepareIndexedMesh) - без OpenGL;
+   сам импорт потоки выполняют по очереди (см. importAssimpFile), остальное - параллельно;
+2. загрузка в видеопамять в потоке OpenGL: processUploads вызывается раз в кадр и заполняет буферы порциями,
+   пока не исчерпан бюджет времени кадра.
+Подготовленные меши ждут загрузки в ограниченной очереди: если она заполнена, рабочие потоки ждут, и память не растет.
+*/
+class MeshLoader
+{
+public:
+    struct Settings {
+        ///Количество рабочих потоков
+        unsigned int threadsCount = 2;
+
+        ///Время на загрузку в видеопамять за один кадр, в секундах. Хотя бы одна порция загружается в любом случае
+        double uploadBudget = 0.002;
+
+        ///Размер одной порции glBufferSubData в байтах
+        size_t uploadChunkSize = 1 << 20;
+
+        ///Сколько байт подготовленных мешей может ждать загрузки
+        size_t maxPendingBytes = 256 << 20;
+    };
+
+    struct Stats {
+        size_t requestsCount = 0;
+        size_t loadedCount = 0;
+        size_t failedCount = 0;
+        size_t cacheHitsCount = 0;
+
+        ///Подготовленные меши, ожидающие загрузки (включая загружаемый сейчас)
+        size_t pendingCount = 0;
+        size_t pendingBytes = 0;
+
+        size_t uploadedBytes = 0;
+
+        ///Время processUploads на последнем кадре, в секундах
+        double lastFrameSeconds = 0.0;
+    };
+
+    /**
+    \param cache если задан, меши ищутся в нем (см. loadFromFile), а импортированные меши сохраняются туда
+    */
+    explicit MeshLoader(const Settings& settings, const MeshCache* cache = nullptr);
+
+    /**
+    Отменяет незавершенные запросы и ждет рабочие потоки. Вызывается, пока контекст OpenGL еще существует
+    */
+    ~MeshLoader();
+
+    /**
+    Ставит меш meshIndex из файла filename в очередь загрузки и сразу возвращается
+    \param placeholder меш, который возвращает MeshRequest::mesh до окончания загрузки (может быть nullptr)
+    */
+    MeshRequestPtr load(const std::string& filename, int meshIndex = 0, VertexFormat format = VertexFormat::Float,
+                        const MeshPtr& placeholder = nullptr);
+
+    /**
+    Загружает подготовленные меши в видеопамять в пределах Settings::uploadBudget. Вызывается в потоке OpenGL раз в кадр
+    \return количество мешей, загрузка которых закончилась
+    */
+    size_t processUploads();
+
+    ///Все запросы завершены
+    bool idle() const;
+
+    Stats getStats() const;
+
+protected:
+    MeshLoader(const MeshLoader&) = delete;
+    void operator=(const MeshLoader&) = delete;
+
+    struct Upload {
+        MeshRequestPtr request;
+
+        ///Ключ кеша; если cached, меш читается из кеша вместо data
+        std::string cacheKey;
+        bool cached = false;
+
+        MeshData data;
+
+        DataBufferPtr vertexBuffer;
+        DataBufferPtr indexBuffer;
+        size_t uploadedBytes = 0;
+    };
+
+    void postImport(const MeshRequestPtr& request);
+
+    ///Выполняется в рабочем потоке
+    void import(const MeshRequestPtr& request);
+
+    void finish(Upload& upload, const MeshPtr& mesh);
+
+    ///Загружает следующую порцию текущего меша. Возвращает true, когда меш загружен целиком
+    bool uploadChunk(Upload& upload);
+
+    Settings _settings;
+    const MeshCache* _cache;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _queueHasSpace;
+    std::deque<std::unique_ptr<Upload>> _ready;
+    std::unique_ptr<Upload> _current;
+    size_t _importingCount = 0;
+    bool _stopping = false;
+
+    Stats _stats;
+
+    ///Объявлен последним: при разрушении потоки останавливаются раньше, чем очередь и мьютекс
+    std::unique_ptr<ThreadPool> _pool;
+};
+
+typedef std::shared_ptr<MeshLoader> MeshLoaderPtr;
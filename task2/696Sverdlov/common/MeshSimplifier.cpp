@@ -0,0 +1,510 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <unordered_map>
+
+namespace
+{
+    const GLuint NO_VERTEX = ~0u;
+    const GLuint MANY_VERTICES = ~0u - 1;
+
+    ///Вес квадрик открытых ребер относительно квадрик треугольников: граница и швы сдвигаются намного неохотнее поверхности
+    const double BORDER_WEIGHT = 10.0;
+
+    enum class VertexKind : uint8_t
+    {
+        Manifold, ///< внутренняя вершина, стягивается в любого соседа
+        Border,   ///< на открытой границе, стягивается только вдоль границы
+        Seam,     ///< одна из двух копий позиции на шве, стягивается вдоль шва вместе со второй копией
+        Locked,   ///< не двигается
+    };
+
+    /**
+    Квадрика ошибки: взвешенная сумма квадратов расстояний до плоскостей, Q(p) = p^T A p + 2 b^T p + c
+    */
+    struct Quadric
+    {
+        double a00 = 0.0, a11 = 0.0, a22 = 0.0, a01 = 0.0, a02 = 0.0, a12 = 0.0;
+        double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+        double c = 0.0;
+        double weight = 0.0;
+
+        ///Плоскость dot(normal, p) + distance = 0 с единичной нормалью
+        static Quadric fromPlane(const glm::dvec3& normal, double distance, double weight)
+        {
+            Quadric q;
+            q.a00 = weight * normal.x * normal.x;
+            q.a11 = weight * normal.y * normal.y;
+            q.a22 = weight * normal.z * normal.z;
+            q.a01 = weight * normal.x * normal.y;
+            q.a02 = weight * normal.x * normal.z;
+            q.a12 = weight * normal.y * normal.z;
+            q.b0 = weight * normal.x * distance;
+            q.b1 = weight * normal.y * distance;
+            q.b2 = weight * normal.z * distance;
+            q.c = weight * distance * distance;
+            q.weight = weight;
+            return q;
+        }
+
+        void add(const Quadric& q)
+        {
+            a00 += q.a00; a11 += q.a11; a22 += q.a22;
+            a01 += q.a01; a02 += q.a02; a12 += q.a12;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2;
+            c += q.c;
+            weight += q.weight;
+        }
+
+        ///Взвешенная сумма квадратов расстояний (без деления на вес)
+        double evaluate(const glm::vec3& p) const
+        {
+            const double x = p.x, y = p.y, z = p.z;
+            double r = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                     + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+            return std::fabs(r);
+        }
+    };
+
+    struct Collapse
+    {
+        GLuint from;
+        GLuint to;
+
+        ///Средний квадрат расстояния
+        float error;
+    };
+
+    /**
+    Треугольники каждой вершины: triangles[offsets[v], offsets[v + 1])
+    */
+    struct TriangleAdjacency
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+
+        void build(const std::vector<GLuint>& indices, size_t verticesCount)
+        {
+            offsets.assign(verticesCount + 1, 0);
+            for (GLuint index : indices) {
+                offsets[index + 1]++;
+            }
+            for (size_t v = 0; v < verticesCount; v++) {
+                offsets[v + 1] += offsets[v];
+            }
+
+            triangles.resize(indices.size());
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++) {
+                triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+
+        ///Есть ли треугольник, где за a по обходу идет b
+        bool hasEdge(const std::vector<GLuint>& indices, GLuint a, GLuint b) const
+        {
+            for (uint32_t i = offsets[a]; i < offsets[a + 1]; i++) {
+                const GLuint* triangle = &indices[3 * triangles[i]];
+                for (int k = 0; k < 3; k++) {
+                    if (triangle[k] == a && triangle[(k + 1) % 3] == b) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+    };
+
+    struct PositionHash
+    {
+        size_t operator()(const glm::vec3& p) const
+        {
+            uint32_t bits[3];
+            std::memcpy(bits, &p, sizeof(bits));
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+
+    /**
+    Состояние упрощения. Позиция вершины задается представителем positionIds[v]: квадрики хранятся по представителям,
+    а копии одной позиции связаны в кольцо wedges
+    */
+    class Simplifier
+    {
+    public:
+        Simplifier(const std::vector<GLuint>& indices, const std::vector<glm::vec3>& positions) :
+            _positions(positions)
+        {
+            // Вырожденные треугольники ничего не рисуют и мешают классификации ребер.
+            _indices.reserve(indices.size());
+            for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+                if (indices[i] != indices[i + 1] && indices[i] != indices[i + 2] && indices[i + 1] != indices[i + 2]) {
+                    _indices.insert(_indices.end(), indices.begin() + i, indices.begin() + i + 3);
+                }
+            }
+
+            buildPositionIds();
+            _adjacency.build(_indices, _positions.size());
+            classifyVertices();
+            buildQuadrics();
+        }
+
+        void run(size_t targetTrianglesCount, float maxError, SimplificationResult& result)
+        {
+            const double maxErrorSquared = static_cast<double>(maxError) * maxError;
+            double resultError = 0.0;
+
+            std::vector<Collapse> candidates;
+            std::vector<GLuint> collapseRemap(_positions.size());
+            std::vector<bool> locked(_positions.size());
+
+            while (_indices.size() / 3 > targetTrianglesCount) {
+                _adjacency.build(_indices, _positions.size());
+                collectCandidates(candidates);
+                std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+                // Внутреннее стягивание убирает 2 треугольника, граничное - 1.
+                const size_t trianglesCount = _indices.size() / 3;
+                const size_t goal = std::max<size_t>(1, (trianglesCount - targetTrianglesCount + 1) / 2);
+
+                for (size_t v = 0; v < collapseRemap.size(); v++) {
+                    collapseRemap[v] = static_cast<GLuint>(v);
+                }
+                std::fill(locked.begin(), locked.end(), false);
+
+                size_t collapsesCount = 0;
+                for (const Collapse& collapse : candidates) {
+                    if (collapsesCount >= goal || collapse.error > maxErrorSquared) {
+                        break;
+                    }
+                    if (tryCollapse(collapse, collapseRemap, locked)) {
+                        resultError = std::max(resultError, static_cast<double>(collapse.error));
+                        collapsesCount++;
+                    }
+                }
+
+                result.passesCount++;
+                result.collapsesCount += collapsesCount;
+                if (collapsesCount == 0) {
+                    break;
+                }
+
+                applyCollapses(collapseRemap);
+            }
+
+            result.indices = _indices;
+            result.error = static_cast<float>(std::sqrt(resultError));
+            result.lockedVerticesCount = std::count(_kinds.begin(), _kinds.end(), VertexKind::Locked);
+        }
+
+    protected:
+        void buildPositionIds()
+        {
+            _positionIds.resize(_positions.size());
+            _wedges.resize(_positions.size());
+
+            std::unordered_map<glm::vec3, GLuint, PositionHash> firstVertex;
+            firstVertex.reserve(_positions.size());
+            for (GLuint v = 0; v < _positions.size(); v++) {
+                GLuint id = firstVertex.insert(std::make_pair(_positions[v], v)).first->second;
+                _positionIds[v] = id;
+                if (id != v) {
+                    _wedges[v] = _wedges[id];
+                    _wedges[id] = v;
+                }
+                else {
+                    _wedges[v] = v;
+                }
+            }
+        }
+
+        /**
+        Открытое ребро a -> b - ребро треугольника без парного b -> a. На границе меша и на шве у вершины ровно одно
+        входящее и одно исходящее открытое ребро; больше - сложная топология, и вершина не двигается
+        */
+        void classifyVertices()
+        {
+            _openIn.assign(_positions.size(), NO_VERTEX);
+            _openOut.assign(_positions.size(), NO_VERTEX);
+
+            for (size_t i = 0; i < _indices.size(); i += 3) {
+                for (int k = 0; k < 3; k++) {
+                    GLuint a = _indices[i + k];
+                    GLuint b = _indices[i + (k + 1) % 3];
+                    if (!_adjacency.hasEdge(_indices, b, a)) {
+                        _openOut[a] = _openOut[a] == NO_VERTEX ? b : MANY_VERTICES;
+                        _openIn[b] = _openIn[b] == NO_VERTEX ? a : MANY_VERTICES;
+                    }
+                }
+            }
+
+            auto isSingle = [](GLuint v) { return v != NO_VERTEX && v != MANY_VERTICES; };
+
+            _kinds.assign(_positions.size(), VertexKind::Locked);
+            for (GLuint v = 0; v < _positions.size(); v++) {
+                const GLuint twin = _wedges[v];
+                if (twin == v) {
+                    if (_openIn[v] == NO_VERTEX && _openOut[v] == NO_VERTEX) {
+                        _kinds[v] = VertexKind::Manifold;
+                    }
+                    else if (isSingle(_openIn[v]) && isSingle(_openOut[v])) {
+                        _kinds[v] = VertexKind::Border;
+                    }
+                }
+                else if (_wedges[twin] == v && isSingle(_openIn[v]) && isSingle(_openOut[v]) && isSingle(_openIn[twin]) && isSingle(_openOut[twin])) {
+                    // Две стороны шва обходят его в противоположных направлениях.
+                    if (_positionIds[_openOut[v]] == _positionIds[_openIn[twin]] && _positionIds[_openIn[v]] == _positionIds[_openOut[twin]]) {
+                        _kinds[v] = VertexKind::Seam;
+                    }
+                }
+            }
+        }
+
+        void buildQuadrics()
+        {
+            _quadrics.assign(_positions.size(), Quadric());
+
+            for (size_t i = 0; i < _indices.size(); i += 3) {
+                const glm::dvec3 p[3] = { glm::dvec3(_positions[_indices[i]]), glm::dvec3(_positions[_indices[i + 1]]), glm::dvec3(_positions[_indices[i + 2]]) };
+
+                glm::dvec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+                double length = glm::length(normal);
+                if (length == 0.0) {
+                    continue;
+                }
+                normal /= length;
+
+                Quadric plane = Quadric::fromPlane(normal, -glm::dot(normal, p[0]), 0.5 * length);
+                for (int k = 0; k < 3; k++) {
+                    _quadrics[_positionIds[_indices[i + k]]].add(plane);
+                }
+
+                // Открытые ребра держит плоскость, проходящая через ребро перпендикулярно треугольнику.
+                for (int k = 0; k < 3; k++) {
+                    GLuint a = _indices[i + k];
+                    GLuint b = _indices[i + (k + 1) % 3];
+                    if (_openOut[a] == NO_VERTEX || _adjacency.hasEdge(_indices, b, a)) {
+                        continue;
+                    }
+
+                    glm::dvec3 edge = p[(k + 1) % 3] - p[k];
+                    double edgeLength = glm::length(edge);
+                    glm::dvec3 edgeNormal = glm::cross(edge, normal);
+                    double edgeNormalLength = glm::length(edgeNormal);
+                    if (edgeNormalLength == 0.0) {
+                        continue;
+                    }
+                    edgeNormal /= edgeNormalLength;
+
+                    Quadric border = Quadric::fromPlane(edgeNormal, -glm::dot(edgeNormal, p[k]), BORDER_WEIGHT * edgeLength * edgeLength);
+                    _quadrics[_positionIds[a]].add(border);
+                    _quadrics[_positionIds[b]].add(border);
+                }
+            }
+        }
+
+        bool canCollapse(GLuint from, GLuint to) const
+        {
+            switch (_kinds[from]) {
+            case VertexKind::Manifold:
+                return true;
+            case VertexKind::Border:
+            case VertexKind::Seam:
+                return _kinds[to] == _kinds[from] && (_openOut[from] == to || _openIn[from] == to);
+            default:
+                return false;
+            }
+        }
+
+        double collapseError(GLuint from, GLuint to) const
+        {
+            const Quadric& a = _quadrics[_positionIds[from]];
+            const Quadric& b = _quadrics[_positionIds[to]];
+            const double weight = a.weight + b.weight;
+            return weight > 0.0 ? (a.evaluate(_positions[to]) + b.evaluate(_positions[to])) / weight : 0.0;
+        }
+
+        void collectCandidates(std::vector<Collapse>& candidates) const
+        {
+            candidates.clear();
+            for (size_t i = 0; i < _indices.size(); i += 3) {
+                for (int k = 0; k < 3; k++) {
+                    GLuint a = _indices[i + k];
+                    GLuint b = _indices[i + (k + 1) % 3];
+
+                    // Внутреннее ребро встречается дважды, берем его один раз.
+                    if (a > b && _adjacency.hasEdge(_indices, b, a)) {
+                        continue;
+                    }
+
+                    double errorAB = canCollapse(a, b) ? collapseError(a, b) : -1.0;
+                    double errorBA = canCollapse(b, a) ? collapseError(b, a) : -1.0;
+                    if (errorAB >= 0.0 && (errorBA < 0.0 || errorAB <= errorBA)) {
+                        candidates.push_back(Collapse{ a, b, static_cast<float>(errorAB) });
+                    }
+                    else if (errorBA >= 0.0) {
+                        candidates.push_back(Collapse{ b, a, static_cast<float>(errorBA) });
+                    }
+                }
+            }
+        }
+
+        ///Все вершины треугольников вокруг from свободны, и ни один треугольник не перевернется
+        bool isCollapseValid(GLuint from, GLuint to, const std::vector<bool>& locked) const
+        {
+            for (uint32_t i = _adjacency.offsets[from]; i < _adjacency.offsets[from + 1]; i++) {
+                const GLuint* triangle = &_indices[3 * _adjacency.triangles[i]];
+
+                bool hasTarget = false;
+                for (int k = 0; k < 3; k++) {
+                    if (locked[triangle[k]]) {
+                        return false;
+                    }
+                    hasTarget = hasTarget || triangle[k] == to;
+                }
+                if (hasTarget) {
+                    continue; //треугольник исчезнет
+                }
+
+                glm::vec3 p[3];
+                glm::vec3 moved[3];
+                for (int k = 0; k < 3; k++) {
+                    p[k] = _positions[triangle[k]];
+                    moved[k] = triangle[k] == from ? _positions[to] : p[k];
+                }
+
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                if (glm::dot(before, after) <= 0.5f * glm::length(before) * glm::length(after)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void lockNeighbours(GLuint vertex, std::vector<bool>& locked) const
+        {
+            for (uint32_t i = _adjacency.offsets[vertex]; i < _adjacency.offsets[vertex + 1]; i++) {
+                const GLuint* triangle = &_indices[3 * _adjacency.triangles[i]];
+                for (int k = 0; k < 3; k++) {
+                    locked[triangle[k]] = true;
+                }
+            }
+        }
+
+        /**
+        Открытое ребро from -> to (или to -> from) исчезает: сосед from по границе теперь соединен с to
+        */
+        void relinkOpenEdges(GLuint from, GLuint to)
+        {
+            if (_openOut[from] == to) {
+                GLuint previous = _openIn[from];
+                _openOut[previous] = to;
+                _openIn[to] = previous;
+            }
+            else {
+                GLuint next = _openOut[from];
+                _openIn[next] = to;
+                _openOut[to] = next;
+            }
+        }
+
+        /**
+        В одном проходе стягивания не касаются общих треугольников, поэтому их можно применять независимо
+        */
+        bool tryCollapse(const Collapse& collapse, std::vector<GLuint>& collapseRemap, std::vector<bool>& locked)
+        {
+            const GLuint from = collapse.from;
+            const GLuint to = collapse.to;
+
+            if (!isCollapseValid(from, to, locked)) {
+                return false;
+            }
+
+            if (_kinds[from] == VertexKind::Seam) {
+                // Вторая сторона шва обходит его в обратном направлении.
+                const GLuint twinFrom = _wedges[from];
+                const GLuint twinTo = _openOut[from] == to ? _openIn[twinFrom] : _openOut[twinFrom];
+                if (_kinds[twinTo] != VertexKind::Seam || _positionIds[twinTo] != _positionIds[to] || !isCollapseValid(twinFrom, twinTo, locked)) {
+                    return false;
+                }
+
+                lockNeighbours(twinFrom, locked);
+                collapseRemap[twinFrom] = twinTo;
+                relinkOpenEdges(twinFrom, twinTo);
+            }
+            if (_kinds[from] != VertexKind::Manifold) {
+                relinkOpenEdges(from, to);
+            }
+
+            lockNeighbours(from, locked);
+            collapseRemap[from] = to;
+
+            _quadrics[_positionIds[to]].add(_quadrics[_positionIds[from]]);
+            return true;
+        }
+
+        void applyCollapses(const std::vector<GLuint>& collapseRemap)
+        {
+            size_t write = 0;
+            for (size_t i = 0; i < _indices.size(); i += 3) {
+                GLuint a = collapseRemap[_indices[i]];
+                GLuint b = collapseRemap[_indices[i + 1]];
+                GLuint c = collapseRemap[_indices[i + 2]];
+
+                // Сравниваем позиции: треугольник из двух копий одной точки тоже вырожден.
+                if (_positionIds[a] == _positionIds[b] || _positionIds[a] == _positionIds[c] || _positionIds[b] == _positionIds[c]) {
+                    continue;
+                }
+
+                _indices[write++] = a;
+                _indices[write++] = b;
+                _indices[write++] = c;
+            }
+            _indices.resize(write);
+        }
+
+        const std::vector<glm::vec3>& _positions;
+        std::vector<GLuint> _indices;
+
+        std::vector<GLuint> _positionIds;
+        std::vector<GLuint> _wedges;
+
+        std::vector<GLuint> _openIn;
+        std::vector<GLuint> _openOut;
+        std::vector<VertexKind> _kinds;
+
+        std::vector<Quadric> _quadrics;
+        TriangleAdjacency _adjacency;
+    };
+}
+
+SimplificationResult simplifyMesh(const std::vector<GLuint>& indices, const std::vector<glm::vec3>& positions,
+                                  size_t targetIndicesCount, float maxError)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    SimplificationResult result;
+    Simplifier simplifier(indices, positions);
+    simplifier.run(targetIndicesCount / 3, maxError, result);
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+std::ostream& operator<<(std::ostream& stream, const SimplificationResult& result)
+{
+    std::ios::fmtflags flags = stream.flags();
+    stream << result.indices.size() / 3 << " triangles, error " << result.error
+           << ", " << result.collapsesCount << " collapses in " << result.passesCount << " passes, "
+           << result.lockedVerticesCount << " locked vertices"
+           << std::fixed << std::setprecision(1) << " (" << result.seconds * 1000.0 << " ms)";
+    stream.flags(flags);
+    return stream;
+}
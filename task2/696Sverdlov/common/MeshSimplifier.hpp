@@ -0,0 +1,47 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <GL/glew.h>
+
+#include <iosfwd>
+#include <vector>
+
+/**
+Упрощение треугольного меша стягиванием ребер по квадрикам ошибки (Garland, Heckbert 1997).
+Вершина стягивается в одного из соседей, а не в новую точку, поэтому нормали и текстурные координаты
+оставшихся вершин не пересчитываются, и упрощенный меш использует подмножество исходных вершин.
+
+Вершины с одинаковыми позициями, но разными атрибутами (швы текстурных координат и границы нормалей)
+стягиваются только вдоль шва и только парами, поэтому шов не рвется. Вершины открытой границы
+стягиваются только вдоль границы. Вершины, где сходится больше двух копий позиции или несколько границ, не двигаются.
+*/
+
+struct SimplificationResult
+{
+    std::vector<GLuint> indices;
+
+    ///Оценка ошибки в единицах координат модели: корень из наибольшей ошибки квадрики среди стягиваний.
+    ///Это среднеквадратичное расстояние до плоскостей исходных треугольников, а не наибольшее отклонение: отдельные точки могут отклоняться сильнее
+    float error = 0.0f;
+
+    size_t collapsesCount = 0;
+    size_t passesCount = 0;
+
+    ///Вершины, которые не двигаются: сложные швы и вершины, где сходятся несколько границ
+    size_t lockedVerticesCount = 0;
+
+    double seconds = 0.0;
+};
+
+std::ostream& operator<<(std::ostream& stream, const SimplificationResult& result);
+
+/**
+Стягивает ребра, пока треугольников больше targetIndicesCount / 3 и ошибка стягивания не больше maxError
+\param indices треугольники исходного меша
+\param positions позиции вершин; вершины с совпадающими позициями считаются копиями одной точки
+\param maxError наибольшая допустимая ошибка стягивания в единицах координат модели (в том же смысле, что SimplificationResult::error)
+*/
+SimplificationResult simplifyMesh(const std::vector<GLuint>& indices, const std::vector<glm::vec3>& positions,
+                                  size_t targetIndicesCount, float maxError = 1e30f);
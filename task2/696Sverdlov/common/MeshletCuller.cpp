@@ -0,0 +1,65 @@
+#include "MeshletCuller.hpp"
+#include "Frustum.hpp"
+
+void MeshletCuller::draw(const Mesh& mesh, const CameraInfo& camera)
+{
+    const std::vector<Meshlet>& meshlets = mesh.meshlets();
+
+    _stats = Stats();
+    _stats.meshletsCount = meshlets.size();
+    _stats.trianglesCount = mesh.getTrianglesCount();
+
+    if (meshlets.empty() || !mesh.hasIndices()) {
+        _stats.drawnTrianglesCount = _stats.trianglesCount;
+        mesh.draw();
+        return;
+    }
+
+    // Позиции квантованных мешей деквантуются матрицей, а сферы и конусы кластеров заданы до квантования.
+    const glm::mat4 modelView = camera.viewMatrix * mesh.modelMatrix();
+    const Frustum frustum = Frustum::fromMatrix(camera.projMatrix * modelView);
+    const glm::vec3 cameraPosition = glm::vec3(glm::inverse(modelView)[3]);
+
+    _counts.clear();
+    _offsets.clear();
+
+    GLuint rangeEnd = 0;
+    for (const Meshlet& meshlet : meshlets) {
+        const glm::vec3 center(meshlet.boundingSphere);
+        const float radius = meshlet.boundingSphere.w;
+
+        if (!frustum.intersectsSphere(center, radius)) {
+            _stats.frustumCulledCount++;
+            continue;
+        }
+
+        if (coneCulling) {
+            glm::vec3 view = center - cameraPosition;
+            if (glm::dot(view, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(view) + radius) {
+                _stats.coneCulledCount++;
+                continue;
+            }
+        }
+
+        const GLsizei count = static_cast<GLsizei>(3 * meshlet.trianglesCount);
+        if (!_counts.empty() && rangeEnd == meshlet.firstIndex) {
+            _counts.back() += count;
+        }
+        else {
+            _counts.push_back(count);
+            _offsets.push_back(reinterpret_cast<const GLvoid*>(static_cast<size_t>(meshlet.firstIndex) * sizeof(GLuint)));
+        }
+        rangeEnd = meshlet.firstIndex + 3 * meshlet.trianglesCount;
+
+        _stats.drawnTrianglesCount += meshlet.trianglesCount;
+    }
+
+    _stats.rangesCount = _counts.size();
+    if (_counts.empty()) {
+        return;
+    }
+
+    glBindVertexArray(mesh.getVAO());
+    glMultiDrawElements(mesh.getPrimitiveType(), _counts.data(), GL_UNSIGNED_INT, _offsets.data(), static_cast<GLsizei>(_counts.size()));
+    glBindVertexArray(0);
+}
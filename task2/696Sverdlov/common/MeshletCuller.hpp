@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Camera.hpp"
+#include "Mesh.hpp"
+
+#include <vector>
+
+/**
+Отсечение кластеров меша (Mesh::meshlets) на процессоре перед отрисовкой.
+Кластер отбрасывается, если его сфера вне пирамиды видимости или если конус нормалей целиком обращен от камеры.
+Оставшиеся кластеры - диапазоны индексного буфера; соседние диапазоны сливаются и рисуются одним glMultiDrawElements.
+Проверки выполняются в локальной системе координат меша: плоскости берутся из projMatrix * viewMatrix * modelMatrix,
+положение камеры - из обратной матрицы, поэтому матрица модели может содержать и неравномерный масштаб.
+*/
+class MeshletCuller
+{
+public:
+    struct Stats {
+        size_t meshletsCount = 0;
+        size_t frustumCulledCount = 0;
+        size_t coneCulledCount = 0;
+
+        ///Количество диапазонов в glMultiDrawElements после слияния соседних кластеров
+        size_t rangesCount = 0;
+
+        size_t trianglesCount = 0;
+        size_t drawnTrianglesCount = 0;
+    };
+
+    /**
+    Отсекать кластеры по конусу нормалей. Выключается для мешей, которые видны с обеих сторон (без GL_CULL_FACE)
+    */
+    bool coneCulling = true;
+
+    /**
+    Рисует видимые кластеры меша. Меш без кластеров рисуется целиком
+    */
+    void draw(const Mesh& mesh, const CameraInfo& camera);
+
+    const Stats& getStats() const { return _stats; }
+
+protected:
+    std::vector<GLsizei> _counts;
+    std::vector<const GLvoid*> _offsets;
+
+    Stats _stats;
+};
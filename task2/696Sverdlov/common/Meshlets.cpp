@@ -0,0 +1,164 @@
+#include "Meshlets.hpp"
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+namespace
+{
+    /**
+    Ограничивающая сфера и конус нормалей треугольников кластера
+    */
+    void computeMeshletBounds(Meshlet& meshlet, const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices)
+    {
+        std::vector<glm::vec3> points;
+        points.reserve(3 * meshlet.trianglesCount);
+
+        glm::vec3 axis(0.0f);
+        std::vector<glm::vec3> normals;
+        normals.reserve(meshlet.trianglesCount);
+
+        for (GLuint t = 0; t < meshlet.trianglesCount; t++) {
+            const glm::vec3& a = positions[indices[meshlet.firstIndex + 3 * t]];
+            const glm::vec3& b = positions[indices[meshlet.firstIndex + 3 * t + 1]];
+            const glm::vec3& c = positions[indices[meshlet.firstIndex + 3 * t + 2]];
+            points.push_back(a);
+            points.push_back(b);
+            points.push_back(c);
+
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = glm::length(normal);
+            if (length > 0.0f) {
+                normals.push_back(normal / length);
+                axis += normals.back();
+            }
+        }
+
+        meshlet.boundingSphere = computeBoundingSphere({ &points });
+
+        float axisLength = glm::length(axis);
+        if (normals.empty() || axisLength == 0.0f) {
+            meshlet.coneCutoff = 1.0f;
+            return;
+        }
+        meshlet.coneAxis = axis / axisLength;
+
+        float minDot = 1.0f;
+        for (const glm::vec3& normal : normals) {
+            minDot = std::min(minDot, glm::dot(meshlet.coneAxis, normal));
+        }
+        meshlet.coneCutoff = minDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+    }
+}
+
+std::vector<Meshlet> buildMeshlets(const std::vector<glm::vec3>& positions, std::vector<GLuint>& indices, GLuint maxVertices, GLuint maxTriangles)
+{
+    assert(indices.size() % 3 == 0);
+    assert(maxVertices >= 3 && maxTriangles >= 1);
+
+    const size_t trianglesCount = indices.size() / 3;
+
+    // Треугольники каждой вершины в сжатом виде: adjacency[offsets[v], offsets[v + 1]).
+    std::vector<uint32_t> offsets(positions.size() + 1, 0);
+    for (GLuint index : indices) {
+        offsets[index + 1]++;
+    }
+    for (size_t v = 0; v < positions.size(); v++) {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<bool> used(trianglesCount, false);
+
+    // Номер кластера, в который уже входит вершина (+1, 0 - ни в какой): так не нужно очищать разметку между кластерами.
+    std::vector<uint32_t> vertexMeshlet(positions.size(), 0);
+
+    std::vector<GLuint> reordered;
+    reordered.reserve(indices.size());
+
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> candidates;
+    size_t seed = 0;
+
+    while (reordered.size() < indices.size()) {
+        while (used[seed]) {
+            seed++;
+        }
+
+        const uint32_t stamp = static_cast<uint32_t>(meshlets.size()) + 1;
+        Meshlet meshlet;
+        meshlet.firstIndex = static_cast<GLuint>(reordered.size());
+        candidates.clear();
+
+        auto newVertices = [&](size_t triangle) {
+            GLuint count = 0;
+            for (int k = 0; k < 3; k++) {
+                count += vertexMeshlet[indices[3 * triangle + k]] == stamp ? 0 : 1;
+            }
+            return count;
+        };
+
+        auto addTriangle = [&](size_t triangle) {
+            used[triangle] = true;
+            for (int k = 0; k < 3; k++) {
+                GLuint vertex = indices[3 * triangle + k];
+                reordered.push_back(vertex);
+                if (vertexMeshlet[vertex] != stamp) {
+                    vertexMeshlet[vertex] = stamp;
+                    meshlet.verticesCount++;
+                    for (uint32_t i = offsets[vertex]; i < offsets[vertex + 1]; i++) {
+                        if (!used[adjacency[i]]) {
+                            candidates.push_back(adjacency[i]);
+                        }
+                    }
+                }
+            }
+            meshlet.trianglesCount++;
+        };
+
+        addTriangle(seed);
+
+        while (meshlet.trianglesCount < maxTriangles) {
+            // Выбираем кандидата с наименьшим числом новых вершин, попутно выбрасывая уже взятые треугольники.
+            size_t best = trianglesCount;
+            GLuint bestNew = 4;
+            size_t kept = 0;
+            for (size_t i = 0; i < candidates.size(); i++) {
+                const uint32_t triangle = candidates[i];
+                if (used[triangle]) {
+                    continue;
+                }
+                candidates[kept++] = triangle;
+
+                GLuint count = newVertices(triangle);
+                if (count < bestNew && meshlet.verticesCount + count <= maxVertices) {
+                    best = triangle;
+                    bestNew = count;
+                }
+            }
+            candidates.resize(kept);
+
+            if (best == trianglesCount) {
+                break;
+            }
+            addTriangle(best);
+        }
+
+        meshlets.push_back(meshlet);
+    }
+
+    indices.swap(reordered);
+
+    for (Meshlet& meshlet : meshlets) {
+        computeMeshletBounds(meshlet, positions, indices);
+    }
+    return meshlets;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <GL/glew.h>
+
+#include <vector>
+
+/**
+Кластер (meshlet) - непрерывный диапазон индексного буфера меша из не более чем MAX_MESHLET_TRIANGLES треугольников,
+использующих не более MAX_MESHLET_VERTICES разных вершин. Для каждого кластера хранятся ограничивающая сфера
+и конус нормалей, по которым кластер целиком отсекается до растеризации (см. MeshletCuller).
+*/
+struct Meshlet
+{
+    GLuint firstIndex = 0;
+    GLuint trianglesCount = 0;
+    GLuint verticesCount = 0;
+
+    ///Центр (xyz) и радиус (w) в локальной системе координат меша
+    glm::vec4 boundingSphere = glm::vec4(0.0f);
+
+    ///Средняя нормаль треугольников кластера
+    glm::vec3 coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+
+    /**
+    Синус половины раствора конуса нормалей, расширенного до 90 градусов (sqrt(1 - min dot(coneAxis, n))).
+    Кластер целиком обращен от камеры, если dot(center - camera, coneAxis) >= coneCutoff * |center - camera| + radius.
+    1 - конус шире полусферы, кластер никогда не отсекается по нормалям
+    */
+    float coneCutoff = 1.0f;
+};
+
+const GLuint MAX_MESHLET_VERTICES = 64;
+const GLuint MAX_MESHLET_TRIANGLES = 124;
+
+/**
+Делит треугольники на кластеры и переставляет indices так, чтобы треугольники каждого кластера шли подряд.
+Кластер растет жадно: из треугольников, смежных с уже взятыми вершинами, берется тот, что добавляет меньше всего новых вершин,
+поэтому кластеры получаются связными и компактными. Вершинный буфер не меняется.
+\param positions позиции вершин в локальной системе координат (до квантования)
+*/
+std::vector<Meshlet> buildMeshlets(const std::vector<glm::vec3>& positions, std::vector<GLuint>& indices,
+                                   GLuint maxVertices = MAX_MESHLET_VERTICES, GLuint maxTriangles = MAX_MESHLET_TRIANGLES);
@@ -0,0 +1,150 @@
+#include "ParametricSurfaces.hpp"
+
+#include "SimdMath.hpp"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <vector>
+
+glm::vec3 kleinPosition(float u, float v, float aa, float scaler) {
+    double x = (aa + glm::cos(v * 0.5f) * glm::sin(u) - glm::sin(v * 0.5f) * glm::sin(2 * u)) * glm::cos(v);
+    double y = (aa + glm::cos(v * 0.5f) * glm::sin(u) - glm::sin(v * 0.5f) * glm::sin(2 * u)) * glm::sin(v);
+    double z = glm::sin(0.5f * v) * glm::sin(u) + glm::cos(0.5f * v) * glm::sin(2 * u);
+
+    return glm::vec3(x * scaler, y * scaler, z * scaler);
+}
+
+glm::vec3 moebiusPosition(float u, float v, float aa, float scaler) {
+    double x = aa * (glm::cos(v) + u * glm::cos(v * 0.5f) * glm::cos(v));
+    double y = aa * (glm::sin(v) + u * glm::cos(v * 0.5f) * glm::sin(v));
+    double z = aa * u * sin(v * 0.5f);
+    return glm::vec3(x * scaler, y * scaler, z * scaler);
+}
+
+namespace {
+    template <class L>
+    struct KleinKernel {
+        static void apply(const float* u, const float* v, float aa, float scaler, float* x, float* y, float* z) {
+            typedef typename L::F F;
+
+            F su, cu, sv, cv, shv, chv;
+            simd::sincos<L>(L::load(u), su, cu);
+            F vv = L::load(v);
+            simd::sincos<L>(vv, sv, cv);
+            simd::sincos<L>(L::mul(vv, L::set1(0.5f)), shv, chv);
+
+            F s2u = L::mul(L::set1(2.0f), L::mul(su, cu));
+
+            F radius = L::mul(L::add(L::set1(aa), L::sub(L::mul(chv, su), L::mul(shv, s2u))), L::set1(scaler));
+            L::store(x, L::mul(radius, cv));
+            L::store(y, L::mul(radius, sv));
+            L::store(z, L::mul(L::add(L::mul(shv, su), L::mul(chv, s2u)), L::set1(scaler)));
+        }
+    };
+
+    template <class L>
+    struct MoebiusKernel {
+        static void apply(const float* u, const float* v, float aa, float scaler, float* x, float* y, float* z) {
+            typedef typename L::F F;
+
+            F sv, cv, shv, chv;
+            F vv = L::load(v);
+            simd::sincos<L>(vv, sv, cv);
+            simd::sincos<L>(L::mul(vv, L::set1(0.5f)), shv, chv);
+
+            F uu = L::load(u);
+            F k = L::set1(aa * scaler);
+            F radius = L::mul(k, L::add(L::set1(1.0f), L::mul(uu, chv)));
+            L::store(x, L::mul(radius, cv));
+            L::store(y, L::mul(radius, sv));
+            L::store(z, L::mul(k, L::mul(uu, shv)));
+        }
+    };
+
+    /**
+    Обрабатывает массив полными векторами ширины WidestLanes, хвост - скалярно
+    */
+    template <template <class> class Kernel>
+    void evaluateBatch(const float* u, const float* v, size_t count, float aa, float scaler, float* x, float* y, float* z) {
+        const size_t width = simd::WidestLanes::width;
+
+        size_t i = 0;
+        for (; i + width <= count; i += width) {
+            Kernel<simd::WidestLanes>::apply(u + i, v + i, aa, scaler, x + i, y + i, z + i);
+        }
+        for (; i < count; ++i) {
+            Kernel<simd::ScalarLanes>::apply(u + i, v + i, aa, scaler, x + i, y + i, z + i);
+        }
+    }
+
+    float pointUlpDistance(const glm::vec3& a, const glm::vec3& reference) {
+        float magnitude = std::max(std::max(std::abs(reference.x), std::abs(reference.y)), std::abs(reference.z));
+        float difference = std::max(std::max(std::abs(a.x - reference.x), std::abs(a.y - reference.y)), std::abs(a.z - reference.z));
+        return difference / (std::nextafter(magnitude, INFINITY) - magnitude);
+    }
+}
+
+void kleinPositions(const float* u, const float* v, size_t count, float aa, float scaler, float* x, float* y, float* z) {
+    evaluateBatch<KleinKernel>(u, v, count, aa, scaler, x, y, z);
+}
+
+void moebiusPositions(const float* u, const float* v, size_t count, float aa, float scaler, float* x, float* y, float* z) {
+    evaluateBatch<MoebiusKernel>(u, v, count, aa, scaler, x, y, z);
+}
+
+bool SurfaceBatchAccuracy::withinBudget() const {
+    return sinUlp <= simd::SINCOS_ULP_BUDGET && cosUlp <= simd::SINCOS_ULP_BUDGET &&
+           kleinUlp <= SURFACE_BATCH_ULP_BUDGET && moebiusUlp <= SURFACE_BATCH_ULP_BUDGET;
+}
+
+SurfaceBatchAccuracy checkSurfaceBatchAccuracy(unsigned int samplesPerAxis) {
+    const float twoPi = 2.0f * glm::pi<float>();
+    const size_t count = static_cast<size_t>(samplesPerAxis) * samplesPerAxis;
+
+    std::vector<float> u(count), v(count), moebiusU(count);
+    for (unsigned int i = 0; i < samplesPerAxis; i++) {
+        for (unsigned int j = 0; j < samplesPerAxis; j++) {
+            u[i * samplesPerAxis + j] = twoPi * i / (samplesPerAxis - 1);
+            v[i * samplesPerAxis + j] = twoPi * j / (samplesPerAxis - 1);
+            moebiusU[i * samplesPerAxis + j] = -0.4f + 0.8f * i / (samplesPerAxis - 1);
+        }
+    }
+
+    SurfaceBatchAccuracy accuracy;
+
+    std::vector<float> s(count), c(count);
+    {
+        const size_t width = simd::WidestLanes::width;
+        size_t i = 0;
+        for (; i + width <= count; i += width) {
+            simd::WidestLanes::F vs, vc;
+            simd::sincos<simd::WidestLanes>(simd::WidestLanes::load(&u[i]), vs, vc);
+            simd::WidestLanes::store(&s[i], vs);
+            simd::WidestLanes::store(&c[i], vc);
+        }
+        for (; i < count; ++i) {
+            simd::sincos<simd::ScalarLanes>(u[i], s[i], c[i]);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        accuracy.sinUlp = std::max(accuracy.sinUlp, simd::ulpDistance(s[i], std::sin(static_cast<double>(u[i]))));
+        accuracy.cosUlp = std::max(accuracy.cosUlp, simd::ulpDistance(c[i], std::cos(static_cast<double>(u[i]))));
+    }
+
+    std::vector<float> x(count), y(count), z(count);
+
+    kleinPositions(u.data(), v.data(), count, 3.0f, 0.5f, x.data(), y.data(), z.data());
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 reference = kleinPosition(u[i], v[i], 3.0f, 0.5f);
+        accuracy.kleinUlp = std::max(accuracy.kleinUlp, pointUlpDistance(glm::vec3(x[i], y[i], z[i]), reference));
+    }
+
+    moebiusPositions(moebiusU.data(), v.data(), count, 3.0f, 0.5f, x.data(), y.data(), z.data());
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 reference = moebiusPosition(moebiusU[i], v[i], 3.0f, 0.5f);
+        accuracy.moebiusUlp = std::max(accuracy.moebiusUlp, pointUlpDistance(glm::vec3(x[i], y[i], z[i]), reference));
+    }
+
+    return accuracy;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// http://virtualmathmuseum.org/Surface/klein_bottle/klein_bottle.html
+//
+//  x = (aa + cos(v / 2) * sin(u) - sin(v / 2) * sin(2 * u)) * cos(v)
+//  y = (aa + cos(v / 2) * sin(u) - sin(v / 2) * sin(2 * u)) * sin(v)
+//  z = sin(v / 2) * sin(u) + cos(v / 2) * sin(2 * u)
+//
+//   0.0 < u < 2 * π,  0 < v < 2 * π,  aa = 3
+//
+glm::vec3 kleinPosition(float u, float v, float aa, float scaler = 0.2f);
+
+// http://virtualmathmuseum.org/Surface/moebius_strip/moebius_strip.html
+//
+//  x = aa * (cos(v) + u * cos(v / 2) * cos(v))
+//  y = aa * (sin(v) + u * cos(v / 2) * sin(v))
+//  z = aa * u * sin(v / 2)
+//
+//
+glm::vec3 moebiusPosition(float u, float v, float aa, float scaler = 0.2f);
+
+//=========== Поверхности-функторы для SurfaceTessellator::fillInSurface
+
+/**
+Бутылка Клейна (см. kleinPosition) с аналитическими частными производными по u и по v.
+Тип известен тессельятору на этапе компиляции, поэтому все вызовы встраиваются.
+Метод evaluate считает точку и обе производные сразу, переиспользуя общие синусы и косинусы.
+*/
+struct KleinSurface
+{
+    float aa;
+    float scaler;
+
+    KleinSurface(float aa_, float scaler_) : aa(aa_), scaler(scaler_) {}
+
+    glm::vec3 position(float u, float v) const
+    {
+        float r = radius(u, v);
+        return scaler * glm::vec3(r * glm::cos(v), r * glm::sin(v), height(u, v));
+    }
+
+    glm::vec3 du(float u, float v) const
+    {
+        float ch = glm::cos(0.5f * v), sh = glm::sin(0.5f * v);
+        float ru = ch * glm::cos(u) - 2.0f * sh * glm::cos(2.0f * u);
+        float zu = sh * glm::cos(u) + 2.0f * ch * glm::cos(2.0f * u);
+        return scaler * glm::vec3(ru * glm::cos(v), ru * glm::sin(v), zu);
+    }
+
+    glm::vec3 dv(float u, float v) const
+    {
+        float ch = glm::cos(0.5f * v), sh = glm::sin(0.5f * v);
+        float r = radius(u, v);
+        float rv = -0.5f * height(u, v);
+        float zv = 0.5f * (ch * glm::sin(u) - sh * glm::sin(2.0f * u));
+        return scaler * glm::vec3(rv * glm::cos(v) - r * glm::sin(v), rv * glm::sin(v) + r * glm::cos(v), zv);
+    }
+
+    void evaluate(float u, float v, glm::vec3& position, glm::vec3& du, glm::vec3& dv) const
+    {
+        float su = glm::sin(u), cu = glm::cos(u);
+        float s2u = glm::sin(2.0f * u), c2u = glm::cos(2.0f * u);
+        float sv = glm::sin(v), cv = glm::cos(v);
+        float sh = glm::sin(0.5f * v), ch = glm::cos(0.5f * v);
+
+        float r = aa + ch * su - sh * s2u;
+        float z = sh * su + ch * s2u;
+        float ru = ch * cu - 2.0f * sh * c2u;
+        float rv = -0.5f * z;
+
+        position = scaler * glm::vec3(r * cv, r * sv, z);
+        du = scaler * glm::vec3(ru * cv, ru * sv, sh * cu + 2.0f * ch * c2u);
+        dv = scaler * glm::vec3(rv * cv - r * sv, rv * sv + r * cv, 0.5f * (ch * su - sh * s2u));
+    }
+
+protected:
+    float radius(float u, float v) const { return aa + glm::cos(0.5f * v) * glm::sin(u) - glm::sin(0.5f * v) * glm::sin(2.0f * u); }
+    float height(float u, float v) const { return glm::sin(0.5f * v) * glm::sin(u) + glm::cos(0.5f * v) * glm::sin(2.0f * u); }
+};
+
+/**
+Лента Мебиуса (см. moebiusPosition) с аналитическими частными производными по u и по v
+*/
+struct MoebiusSurface
+{
+    float aa;
+    float scaler;
+
+    MoebiusSurface(float aa_, float scaler_) : aa(aa_), scaler(scaler_) {}
+
+    glm::vec3 position(float u, float v) const
+    {
+        float r = 1.0f + u * glm::cos(0.5f * v);
+        return aa * scaler * glm::vec3(r * glm::cos(v), r * glm::sin(v), u * glm::sin(0.5f * v));
+    }
+
+    glm::vec3 du(float /*u*/, float v) const
+    {
+        float ch = glm::cos(0.5f * v);
+        return aa * scaler * glm::vec3(ch * glm::cos(v), ch * glm::sin(v), glm::sin(0.5f * v));
+    }
+
+    glm::vec3 dv(float u, float v) const
+    {
+        float ch = glm::cos(0.5f * v), sh = glm::sin(0.5f * v);
+        float r = 1.0f + u * ch;
+        float rv = -0.5f * u * sh;
+        return aa * scaler * glm::vec3(rv * glm::cos(v) - r * glm::sin(v), rv * glm::sin(v) + r * glm::cos(v), 0.5f * u * ch);
+    }
+
+    void evaluate(float u, float v, glm::vec3& position, glm::vec3& du, glm::vec3& dv) const
+    {
+        float sv = glm::sin(v), cv = glm::cos(v);
+        float sh = glm::sin(0.5f * v), ch = glm::cos(0.5f * v);
+
+        float k = aa * scaler;
+        float r = 1.0f + u * ch;
+        float rv = -0.5f * u * sh;
+
+        position = k * glm::vec3(r * cv, r * sv, u * sh);
+        du = k * glm::vec3(ch * cv, ch * sv, sh);
+        dv = k * glm::vec3(rv * cv - r * sv, rv * sv + r * cv, 0.5f * u * ch);
+    }
+};
+
+//=========== Пакетные версии
+
+/**
+Вычисляет count точек бутылки Клейна по массивам параметров u и v.
+Результат записывается в формате SoA: отдельные массивы координат x, y и z.
+Синусы и косинусы считаются векторно (simd::sincos) без перехода в double.
+*/
+void kleinPositions(const float* u, const float* v, size_t count, float aa, float scaler, float* x, float* y, float* z);
+
+/**
+Пакетная версия moebiusPosition, см. kleinPositions
+*/
+void moebiusPositions(const float* u, const float* v, size_t count, float aa, float scaler, float* x, float* y, float* z);
+
+/**
+Допустимое отклонение пакетных функций от скалярных. Измеряется в ULP наибольшей по модулю координаты точки:
+вблизи нуля отдельная координата сравнивается с масштабом всей точки, а не с собственным (сколь угодно малым) ULP.
+*/
+const float SURFACE_BATCH_ULP_BUDGET = 8.0f;
+
+struct SurfaceBatchAccuracy
+{
+    float sinUlp = 0.0f;
+    float cosUlp = 0.0f;
+    float kleinUlp = 0.0f;
+    float moebiusUlp = 0.0f;
+
+    bool withinBudget() const;
+};
+
+/**
+Сравнивает пакетные функции со скалярными на сетке samplesPerAxis x samplesPerAxis
+*/
+SurfaceBatchAccuracy checkSurfaceBatchAccuracy(unsigned int samplesPerAxis);
@@ -0,0 +1,113 @@
+#include "ProgramBatch.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double secondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+}
+
+ProgramBatch::ProgramBatch(ProgramCache* cache) :
+    _cache(cache)
+{
+    if (isParallelSupported()) {
+        // Сколько потоков компиляции использовать, решает драйвер.
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+    }
+}
+
+bool ProgramBatch::isParallelSupported()
+{
+    return GLEW_ARB_parallel_shader_compile != 0;
+}
+
+ShaderProgramPtr ProgramBatch::add(const std::string& vertFilepath, const std::string& fragFilepath)
+{
+    std::vector<ShaderSource> sources(2);
+    sources[0].type = GL_VERTEX_SHADER;
+    sources[0].name = vertFilepath;
+    sources[1].type = GL_FRAGMENT_SHADER;
+    sources[1].name = fragFilepath;
+
+    for (ShaderSource& source : sources) {
+        if (!Shader::readFile(source.name, source.text)) {
+            ShaderError error;
+            error.program = vertFilepath + ", " + fragFilepath;
+            error.shader = source.name;
+            error.log = "Failed to load shader file";
+            _errors.push_back(error);
+
+            ShaderProgramPtr program = std::make_shared<ShaderProgram>();
+            _failed.push_back(program);
+            _stats.submitted++;
+            _stats.failed++;
+            return program;
+        }
+    }
+
+    return add(sources);
+}
+
+ShaderProgramPtr ProgramBatch::add(const std::vector<ShaderSource>& sources)
+{
+    Clock::time_point start = Clock::now();
+
+    const size_t cacheHits = _cache ? _cache->getStats().hits : 0;
+
+    ShaderProgramPtr program = std::make_shared<ShaderProgram>();
+    program->startBuild(sources, _cache);
+    _pending.push_back(program);
+
+    _stats.submitted++;
+    if (_cache && _cache->getStats().hits > cacheHits) {
+        _stats.fromCache++;
+    }
+    _stats.submitSeconds += secondsSince(start);
+    return program;
+}
+
+void ProgramBatch::finish(const ShaderProgramPtr& program)
+{
+    if (program->finishBuild(&_errors)) {
+        _ready.push_back(program);
+        _stats.ready++;
+    }
+    else {
+        _failed.push_back(program);
+        _stats.failed++;
+    }
+}
+
+size_t ProgramBatch::poll()
+{
+    Clock::time_point start = Clock::now();
+
+    // Готовые программы заканчиваются в порядке добавления, остальные остаются ждать следующего вызова.
+    auto stillPending = std::stable_partition(_pending.begin(), _pending.end(),
+                                              [](const ShaderProgramPtr& program) { return !program->isBuildComplete(); });
+    for (auto it = stillPending; it != _pending.end(); ++it) {
+        finish(*it);
+    }
+    _pending.erase(stillPending, _pending.end());
+
+    _stats.finishSeconds += secondsSince(start);
+    return _pending.size();
+}
+
+void ProgramBatch::wait()
+{
+    Clock::time_point start = Clock::now();
+
+    for (const ShaderProgramPtr& program : _pending) {
+        finish(program);
+    }
+    _pending.clear();
+
+    _stats.finishSeconds += secondsSince(start);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "ProgramCache.hpp"
+#include "ShaderProgram.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+Пакетная сборка шейдерных программ. add отправляет драйверу все шейдеры и линковку программы, не дожидаясь результата,
+поэтому с GL_ARB_parallel_shader_compile драйвер собирает программы пакета параллельно в своих потоках.
+poll забирает готовые программы без ожидания, wait дожидается всех. Ошибки не завершают приложение,
+а собираются в errors.
+Без расширения сборка тоже начинается для всех программ сразу, но первый же poll ждет их по очереди
+*/
+class ProgramBatch
+{
+public:
+    struct Stats {
+        size_t submitted = 0;
+
+        ///Программы, загруженные из кеша двоичных образов без компиляции
+        size_t fromCache = 0;
+
+        size_t ready = 0;
+        size_t failed = 0;
+
+        ///Время в add: чтение файлов и отправка команд драйверу
+        double submitSeconds = 0.0;
+
+        ///Время в poll и wait, в том числе ожидание драйвера
+        double finishSeconds = 0.0;
+    };
+
+    /**
+    \param cache кеш двоичных образов программ (может быть nullptr)
+    */
+    explicit ProgramBatch(ProgramCache* cache = nullptr);
+
+    /**
+    Начинает сборку программы из вершинного и фрагментного шейдеров. Программой можно пользоваться,
+    когда она попадет в ready. Если файл не читается, программа сразу попадает в failed
+    */
+    ShaderProgramPtr add(const std::string& vertFilepath, const std::string& fragFilepath);
+
+    /**
+    Начинает сборку программы из текстов стадий
+    */
+    ShaderProgramPtr add(const std::vector<ShaderSource>& sources);
+
+    /**
+    Заканчивает сборку программ, которые драйвер уже собрал. Возвращает количество программ, которые еще собираются
+    */
+    size_t poll();
+
+    /**
+    Дожидается сборки всех программ
+    */
+    void wait();
+
+    bool isDone() const { return _pending.empty(); }
+
+    const std::vector<ShaderProgramPtr>& ready() const { return _ready; }
+    const std::vector<ShaderProgramPtr>& failed() const { return _failed; }
+    const std::vector<ShaderError>& errors() const { return _errors; }
+
+    const Stats& getStats() const { return _stats; }
+
+    /**
+    Может ли драйвер собирать программы в фоне (GL_ARB_parallel_shader_compile)
+    */
+    static bool isParallelSupported();
+
+protected:
+    void finish(const ShaderProgramPtr& program);
+
+    ProgramCache* _cache;
+
+    std::vector<ShaderProgramPtr> _pending;
+    std::vector<ShaderProgramPtr> _ready;
+    std::vector<ShaderProgramPtr> _failed;
+    std::vector<ShaderError> _errors;
+
+    Stats _stats;
+};
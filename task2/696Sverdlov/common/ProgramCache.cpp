@@ -0,0 +1,182 @@
+#include "ProgramCache.hpp"
+#include "Hash.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    const char MAGIC[4] = { 'P', 'R', 'G', 'C' };
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t binaryFormat;
+        uint32_t binarySize;
+        uint64_t binaryHash; //защищает от обрезанных и испорченных файлов: драйвер не обязан их распознавать
+    };
+
+    void makeDirectory(const std::string& directory)
+    {
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+
+    std::string glString(GLenum name)
+    {
+        const GLubyte* value = glGetString(name);
+        return value ? reinterpret_cast<const char*>(value) : "";
+    }
+}
+
+ProgramCache::ProgramCache(const std::string& directory) :
+    _directory(directory)
+{
+    makeDirectory(_directory);
+
+    _driver = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION) + "\n" + glString(GL_SHADING_LANGUAGE_VERSION);
+
+    if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) {
+        GLint formatsCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatsCount);
+        _supported = formatsCount > 0;
+    }
+}
+
+uint64_t ProgramCache::makeKey(const std::vector<ShaderSource>& sources, const std::string& defines) const
+{
+    const uint32_t version = VERSION;
+    uint64_t key = fnv1a(&version, sizeof(version));
+    key = fnv1a(_driver.data(), _driver.size(), key);
+
+    // Длины входят в ключ, чтобы разные разбиения одного текста на стадии давали разные ключи.
+    const uint64_t definesLength = defines.size();
+    key = fnv1a(&definesLength, sizeof(definesLength), key);
+    key = fnv1a(defines.data(), defines.size(), key);
+
+    for (const ShaderSource& source : sources) {
+        const uint64_t header[2] = { source.type, source.text.size() };
+        key = fnv1a(header, sizeof(header), key);
+        key = fnv1a(source.text.data(), source.text.size(), key);
+    }
+    return key;
+}
+
+std::string ProgramCache::pathForKey(uint64_t key) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.program", static_cast<unsigned long long>(key));
+    return _directory + "/" + name;
+}
+
+void ProgramCache::prepareProgram(GLuint program) const
+{
+    if (_supported) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+}
+
+bool ProgramCache::load(GLuint program, uint64_t key)
+{
+    if (!_supported) {
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    const std::string path = pathForKey(key);
+    std::ifstream stream(path, std::ios::binary);
+
+    FileHeader header;
+    if (!stream.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.key != key) {
+        _stats.misses++;
+        return false;
+    }
+
+    std::vector<char> binary(header.binarySize);
+    if (!stream.read(binary.data(), binary.size()) || fnv1a(binary.data(), binary.size()) != header.binaryHash) {
+        _stats.misses++;
+        return false;
+    }
+    stream.close();
+
+    glProgramBinary(program, header.binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        // Образ устарел для этого драйвера: удаляем его, новый будет сохранен после компиляции.
+        _stats.rejected++;
+        std::remove(path.c_str());
+        return false;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    _stats.hits++;
+    _stats.loadSeconds += seconds;
+    return true;
+}
+
+bool ProgramCache::store(GLuint program, uint64_t key)
+{
+    if (!_supported) {
+        return false;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return false;
+    }
+
+    std::vector<char> binary(length);
+    GLenum binaryFormat = GL_NONE;
+    glGetProgramBinary(program, length, &length, &binaryFormat, binary.data());
+    binary.resize(length);
+
+    FileHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.key = key;
+    header.binaryFormat = binaryFormat;
+    header.binarySize = static_cast<uint32_t>(binary.size());
+    header.binaryHash = fnv1a(binary.data(), binary.size());
+
+    // Пишем во временный файл и переименовываем, чтобы прерванная запись не оставила поврежденный файл под ключом.
+    const std::string path = pathForKey(key);
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(binary.data(), binary.size());
+
+        if (!stream) {
+            std::cerr << "Failed to write program cache file " << temporaryPath << std::endl;
+            return false;
+        }
+    }
+
+    std::remove(path.c_str());
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write program cache file " << path << std::endl;
+        return false;
+    }
+
+    _stats.stores++;
+    return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+Текст одной стадии шейдерной программы
+*/
+struct ShaderSource
+{
+    GLenum type = GL_VERTEX_SHADER;
+
+    ///Имя для сообщений об ошибках (обычно путь к файлу); в ключ кеша не входит
+    std::string name;
+
+    std::string text;
+};
+
+/**
+Дисковый кеш двоичных образов слинкованных программ (glGetProgramBinary / glProgramBinary).
+Ключ - хеш текстов всех стадий, определений препроцессора и строк GL_VENDOR, GL_RENDERER, GL_VERSION,
+поэтому после правки шейдера или смены драйвера ключ другой и программа компилируется заново.
+Драйвер может отвергнуть образ и с тем же ключом (например после обновления без смены версии):
+тогда load возвращает false, файл удаляется, и программа собирается из текста.
+*/
+class ProgramCache
+{
+public:
+    ///Версия формата файла
+    static const uint32_t VERSION = 1;
+
+    struct Stats {
+        ///Программы, загруженные из образа
+        size_t hits = 0;
+
+        ///Программ не было в кеше (или файл поврежден)
+        size_t misses = 0;
+
+        ///Образы, которые отверг драйвер
+        size_t rejected = 0;
+
+        size_t stores = 0;
+
+        double loadSeconds = 0.0;
+    };
+
+    /**
+    Создается при активном контексте OpenGL: строки драйвера для ключа читаются в конструкторе
+    */
+    explicit ProgramCache(const std::string& directory);
+
+    /**
+    Поддерживает ли драйвер двоичные образы программ (OpenGL 4.1 или ARB_get_program_binary и хотя бы один формат).
+    Без поддержки load и store ничего не делают
+    */
+    bool isSupported() const { return _supported; }
+
+    /**
+    Ключ программы из стадий sources и строки определений препроцессора defines
+    */
+    uint64_t makeKey(const std::vector<ShaderSource>& sources, const std::string& defines = std::string()) const;
+
+    /**
+    Загружает образ в программу program. При успехе программа слинкована; при неудаче ее можно собирать обычным образом
+    */
+    bool load(GLuint program, uint64_t key);
+
+    /**
+    Сохраняет образ слинкованной программы. Перед линковкой программе нужно задать GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    (см. prepareProgram). Ошибки записи не фатальны
+    */
+    bool store(GLuint program, uint64_t key);
+
+    /**
+    Просит драйвер сохранить образ программы при следующей линковке
+    */
+    void prepareProgram(GLuint program) const;
+
+    const Stats& getStats() const { return _stats; }
+
+protected:
+    std::string pathForKey(uint64_t key) const;
+
+    std::string _directory;
+
+    ///Строки драйвера, входящие в каждый ключ
+    std::string _driver;
+
+    bool _supported = false;
+
+    Stats _stats;
+};
+
+typedef std::shared_ptr<ProgramCache> ProgramCachePtr;
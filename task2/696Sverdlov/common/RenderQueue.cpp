@@ -0,0 +1,247 @@
+#include "RenderQueue.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <unordered_set>
+
+namespace
+{
+    const int PASS_BITS = 4;
+    const int ID_BITS = 12;
+    const int DEPTH_BITS = 24;
+
+    const uint32_t ID_MASK = (1u << ID_BITS) - 1;
+
+    /**
+    Неотрицательные float упорядочены так же, как их битовые представления, поэтому старшие биты годятся для ключа
+    */
+    uint32_t quantizeDepth(float depth)
+    {
+        depth = std::max(depth, 0.0f);
+        uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        return bits >> (32 - DEPTH_BITS);
+    }
+}
+
+void RenderQueue::clear()
+{
+    _items.clear();
+    _keys.clear();
+    _materialIds.clear();
+    _programSetups.clear();
+}
+
+void RenderQueue::setProgramSetup(const ShaderProgramPtr& program, DrawFunction setup)
+{
+    _programSetups[program.get()] = std::move(setup);
+}
+
+uint64_t RenderQueue::makeKey(RenderPass pass, uint32_t program, uint32_t material, uint32_t vao, float depth)
+{
+    const uint64_t state = (static_cast<uint64_t>(program & ID_MASK) << (2 * ID_BITS)) |
+                           (static_cast<uint64_t>(material & ID_MASK) << ID_BITS) |
+                           static_cast<uint64_t>(vao & ID_MASK);
+    uint64_t key = static_cast<uint64_t>(pass) << (64 - PASS_BITS);
+
+    if (pass == RenderPass::Transparent) {
+        const uint64_t farToNear = ~quantizeDepth(depth) & ((1u << DEPTH_BITS) - 1);
+        key |= (farToNear << (3 * ID_BITS)) | state;
+    }
+    else {
+        key |= (state << DEPTH_BITS) | quantizeDepth(depth);
+    }
+    return key;
+}
+
+float RenderQueue::viewDepth(const glm::mat4& viewMatrix, const glm::vec3& position)
+{
+    return -(viewMatrix * glm::vec4(position, 1.0f)).z;
+}
+
+void RenderQueue::submit(RenderPass pass, const ShaderProgramPtr& program, const RenderMaterialPtr& material, GLuint vao, float depth, DrawFunction draw)
+{
+    uint32_t materialId = 0;
+    if (material) {
+        materialId = static_cast<uint32_t>(_materialIds.emplace(material.get(), static_cast<uint32_t>(_materialIds.size() + 1)).first->second);
+    }
+
+    _keys.emplace_back(makeKey(pass, program->id(), materialId, vao, depth), static_cast<uint32_t>(_items.size()));
+
+    Item item;
+    item.program = program.get();
+    item.material = material.get();
+    item.vao = vao;
+    item.pass = pass;
+    item.draw = std::move(draw);
+    _items.push_back(std::move(item));
+}
+
+void RenderQueue::sortKeys()
+{
+    _sortBuffer.resize(_keys.size());
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = {};
+        for (const auto& key : _keys) {
+            counts[(key.first >> shift) & 0xFF]++;
+        }
+
+        // Все ключи попадают в одну корзину: разряд не меняет порядок.
+        if (counts[(_keys.front().first >> shift) & 0xFF] == _keys.size()) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (size_t& count : counts) {
+            size_t next = offset + count;
+            count = offset;
+            offset = next;
+        }
+
+        for (const auto& key : _keys) {
+            _sortBuffer[counts[(key.first >> shift) & 0xFF]++] = key;
+        }
+        _keys.swap(_sortBuffer);
+    }
+}
+
+void RenderQueue::applyPass(RenderPass pass)
+{
+    glDepthMask(pass == RenderPass::Background ? GL_FALSE : GL_TRUE);
+
+    if (pass == RenderPass::Transparent) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+    else {
+        glDisable(GL_BLEND);
+    }
+}
+
+void RenderQueue::bindMaterial(const RenderMaterial& material)
+{
+    for (const RenderTexture& texture : material.textures) {
+        if (texture.unit >= _boundTextures.size()) {
+            _boundTextures.resize(texture.unit + 1, 0);
+            _boundSamplers.resize(texture.unit + 1, 0);
+        }
+
+        if (_boundTextures[texture.unit] != texture.texture) {
+            if (_activeUnit != texture.unit) {
+                glActiveTexture(GL_TEXTURE0 + texture.unit);
+                _activeUnit = texture.unit;
+            }
+            glBindTexture(texture.target, texture.texture);
+            _boundTextures[texture.unit] = texture.texture;
+            _stats.textureBinds++;
+        }
+        else {
+            _stats.redundantBindsSkipped++;
+        }
+
+        if (_boundSamplers[texture.unit] != texture.sampler) {
+            glBindSampler(texture.unit, texture.sampler);
+            _boundSamplers[texture.unit] = texture.sampler;
+            _stats.samplerBinds++;
+        }
+        else {
+            _stats.redundantBindsSkipped++;
+        }
+    }
+}
+
+void RenderQueue::resetState()
+{
+    for (GLuint unit = 0; unit < _boundSamplers.size(); unit++) {
+        if (_boundSamplers[unit] != 0) {
+            glBindSampler(unit, 0);
+        }
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glUseProgram(0);
+    glBindVertexArray(0);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+}
+
+void RenderQueue::execute()
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+
+    _stats = Stats();
+    _stats.itemsCount = _items.size();
+    if (_items.empty()) {
+        return;
+    }
+
+    sortKeys();
+
+    Clock::time_point sorted = Clock::now();
+    _stats.sortSeconds = std::chrono::duration<double>(sorted - start).count();
+
+    // Текстуры, привязанные до очереди, неизвестны, поэтому первая привязка на каждом блоке всегда выполняется.
+    _boundTextures.assign(_boundTextures.size(), ~0u);
+    _boundSamplers.assign(_boundSamplers.size(), ~0u);
+    _activeUnit = ~0u;
+
+    const ShaderProgram* currentProgram = nullptr;
+    GLuint currentVao = ~0u;
+    bool passApplied = false;
+    RenderPass currentPass = RenderPass::Background;
+    std::unordered_set<const ShaderProgram*> preparedPrograms;
+
+    for (const auto& key : _keys) {
+        const Item& item = _items[key.second];
+
+        if (!passApplied || item.pass != currentPass) {
+            applyPass(item.pass);
+            currentPass = item.pass;
+            passApplied = true;
+            _stats.passSwitches++;
+        }
+
+        if (item.program != currentProgram) {
+            item.program->use();
+            currentProgram = item.program;
+            _stats.programSwitches++;
+
+            if (preparedPrograms.insert(item.program).second) {
+                auto setup = _programSetups.find(item.program);
+                if (setup != _programSetups.end()) {
+                    setup->second();
+                }
+            }
+        }
+        else {
+            _stats.redundantBindsSkipped++;
+        }
+
+        if (item.material) {
+            bindMaterial(*item.material);
+        }
+
+        if (item.vao != 0) {
+            if (item.vao != currentVao) {
+                glBindVertexArray(item.vao);
+                currentVao = item.vao;
+                _stats.vaoSwitches++;
+            }
+            else {
+                _stats.redundantBindsSkipped++;
+            }
+        }
+
+        item.draw();
+
+        if (item.vao == 0) {
+            currentVao = ~0u;
+        }
+    }
+
+    resetState();
+
+    _stats.executeSeconds = std::chrono::duration<double>(Clock::now() - sorted).count();
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "ShaderProgram.hpp"
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/**
+Проход очереди рисования. Проходы выполняются по порядку, каждый со своим состоянием конвейера
+*/
+enum class RenderPass : uint8_t {
+    Background,  ///< без записи в буфер глубины (фон)
+    Opaque,      ///< непрозрачные объекты, от ближних к дальним
+    Transparent, ///< смешивание GL_SRC_ALPHA / GL_ONE_MINUS_SRC_ALPHA, от дальних к ближним
+};
+
+/**
+Текстура с сэмплером на текстурном блоке
+*/
+struct RenderTexture
+{
+    RenderTexture(GLuint unit_ = 0, GLenum target_ = GL_TEXTURE_2D, GLuint texture_ = 0, GLuint sampler_ = 0) :
+        unit(unit_),
+        target(target_),
+        texture(texture_),
+        sampler(sampler_)
+    {
+    }
+
+    GLuint unit;
+    GLenum target;
+    GLuint texture;
+    GLuint sampler;
+};
+
+/**
+Набор текстур, которые привязываются перед отрисовкой. Объекты с одним материалом рисуются подряд
+*/
+struct RenderMaterial
+{
+    std::vector<RenderTexture> textures;
+};
+
+typedef std::shared_ptr<RenderMaterial> RenderMaterialPtr;
+
+/**
+Очередь рисования кадра. Отрисовки добавляются в любом порядке с 64-битным ключом сортировки:
+    непрозрачные: проход (4 бита) | программа (12) | материал (12) | VAO (12) | глубина (24);
+    прозрачные:   проход (4 бита) | глубина от дальних к ближним (24) | программа (12) | материал (12) | VAO (12).
+execute сортирует ключи поразрядной сортировкой и выполняет отрисовки, пропуская привязки, которые уже действуют.
+Ключ только упорядочивает отрисовки: совпадение младших бит разных программ или VAO не ломает рисование,
+так как привязки сравниваются по настоящим идентификаторам.
+*/
+class RenderQueue
+{
+public:
+    struct Stats {
+        size_t itemsCount = 0;
+
+        size_t programSwitches = 0;
+        size_t textureBinds = 0;
+        size_t samplerBinds = 0;
+        size_t vaoSwitches = 0;
+        size_t passSwitches = 0;
+
+        ///Привязки, пропущенные потому, что нужное состояние уже установлено
+        size_t redundantBindsSkipped = 0;
+
+        double sortSeconds = 0.0;
+        double executeSeconds = 0.0;
+    };
+
+    /**
+    Рисует объект. Вызывается, когда программа, текстуры материала и VAO уже привязаны; задает юниформы объекта и запускает отрисовку.
+    Не должна менять программу и текстуры; VAO меняет только отрисовка с vao == 0
+    */
+    typedef std::function<void()> DrawFunction;
+
+    /**
+    Убирает все отрисовки и настройки программ прошлого кадра
+    */
+    void clear();
+
+    /**
+    Задает функцию, которая вызывается при первой привязке программы за кадр, например для юниформ камеры и света
+    */
+    void setProgramSetup(const ShaderProgramPtr& program, DrawFunction setup);
+
+    /**
+    Добавляет отрисовку. Программа и материал должны существовать до вызова execute
+    \param material может быть nullptr, тогда текстуры не меняются
+    \param vao VAO, который нужно привязать перед draw; 0 - draw привязывает свой VAO сама (например GeometryDrawList::draw)
+    \param depth расстояние до камеры вдоль направления взгляда (см. viewDepth)
+    */
+    void submit(RenderPass pass, const ShaderProgramPtr& program, const RenderMaterialPtr& material, GLuint vao, float depth, DrawFunction draw);
+
+    /**
+    Сортирует отрисовки и выполняет их. После выполнения программа, сэмплеры и VAO отвязаны, смешивание выключено
+    */
+    void execute();
+
+    size_t size() const { return _items.size(); }
+
+    const Stats& getStats() const { return _stats; }
+
+    /**
+    Глубина точки position (мировые координаты) в системе координат камеры с матрицей вида viewMatrix
+    */
+    static float viewDepth(const glm::mat4& viewMatrix, const glm::vec3& position);
+
+protected:
+    struct Item {
+        const ShaderProgram* program;
+        const RenderMaterial* material;
+        GLuint vao;
+        RenderPass pass;
+        DrawFunction draw;
+    };
+
+    static uint64_t makeKey(RenderPass pass, uint32_t program, uint32_t material, uint32_t vao, float depth);
+
+    ///Поразрядная сортировка _keys по 8 бит; разряды, одинаковые у всех ключей, пропускаются
+    void sortKeys();
+
+    void applyPass(RenderPass pass);
+    void bindMaterial(const RenderMaterial& material);
+    void resetState();
+
+    std::vector<Item> _items;
+
+    ///Ключи с номерами отрисовок: сортируются пары, а не сами отрисовки
+    std::vector<std::pair<uint64_t, uint32_t>> _keys;
+    std::vector<std::pair<uint64_t, uint32_t>> _sortBuffer;
+
+    ///Номера материалов в ключах текущего кадра в порядке первого появления
+    std::unordered_map<const RenderMaterial*, uint32_t> _materialIds;
+
+    std::unordered_map<const ShaderProgram*, DrawFunction> _programSetups;
+
+    ///Состояние OpenGL во время execute: текстуры и сэмплеры по номеру текстурного блока
+    std::vector<GLuint> _boundTextures;
+    std::vector<GLuint> _boundSamplers;
+    GLuint _activeUnit = 0;
+
+    Stats _stats;
+};
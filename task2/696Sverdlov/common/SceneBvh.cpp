@@ -0,0 +1,344 @@
+#include "SceneBvh.hpp"
+#include "SimdMath.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace
+{
+    ///Запас в конце массивов SoA: лист читает пачку целиком даже за своим последним объектом
+    const size_t SOA_PADDING = 8;
+
+    enum SoaComponent { CENTER_X, CENTER_Y, CENTER_Z, EXTENT_X, EXTENT_Y, EXTENT_Z };
+
+    float surfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        glm::vec3 d = boundsMax - boundsMin;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+}
+
+void SceneBvh::clear()
+{
+    _localMin.clear();
+    _localMax.clear();
+    _modelMatrices.clear();
+    _worldMin.clear();
+    _worldMax.clear();
+    _dirty.clear();
+    _nodes.clear();
+    _order.clear();
+    _slots.clear();
+    for (std::vector<float>& component : _soa) {
+        component.clear();
+    }
+
+    _needsRebuild = false;
+    _needsRefit = false;
+    _stats.objectsCount = 0;
+    _stats.nodesCount = 0;
+}
+
+size_t SceneBvh::add(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& modelMatrix)
+{
+    _localMin.push_back(boundsMin);
+    _localMax.push_back(boundsMax);
+    _modelMatrices.push_back(modelMatrix);
+    _worldMin.emplace_back();
+    _worldMax.emplace_back();
+    _dirty.push_back(false);
+
+    updateWorldBounds(_modelMatrices.size() - 1);
+
+    _needsRebuild = true;
+    return _modelMatrices.size() - 1;
+}
+
+void SceneBvh::setModelMatrix(size_t object, const glm::mat4& modelMatrix)
+{
+    if (_modelMatrices[object] == modelMatrix) {
+        return;
+    }
+
+    _modelMatrices[object] = modelMatrix;
+    updateWorldBounds(object);
+
+    _dirty[object] = true;
+    _needsRefit = true;
+}
+
+void SceneBvh::updateWorldBounds(size_t object)
+{
+    // Параллелепипед, ограничивающий преобразованный параллелепипед: полуразмеры умножаются на модули элементов матрицы.
+    const glm::mat4& m = _modelMatrices[object];
+    glm::vec3 center = glm::vec3(m * glm::vec4(0.5f * (_localMin[object] + _localMax[object]), 1.0f));
+    glm::vec3 extent = 0.5f * (_localMax[object] - _localMin[object]);
+
+    glm::vec3 worldExtent = glm::abs(glm::vec3(m[0])) * extent.x + glm::abs(glm::vec3(m[1])) * extent.y + glm::abs(glm::vec3(m[2])) * extent.z;
+
+    _worldMin[object] = center - worldExtent;
+    _worldMax[object] = center + worldExtent;
+}
+
+void SceneBvh::storeLeafBounds(uint32_t slot)
+{
+    const uint32_t object = _order[slot];
+    glm::vec3 center = 0.5f * (_worldMin[object] + _worldMax[object]);
+    glm::vec3 extent = 0.5f * (_worldMax[object] - _worldMin[object]);
+
+    _soa[CENTER_X][slot] = center.x;
+    _soa[CENTER_Y][slot] = center.y;
+    _soa[CENTER_Z][slot] = center.z;
+    _soa[EXTENT_X][slot] = extent.x;
+    _soa[EXTENT_Y][slot] = extent.y;
+    _soa[EXTENT_Z][slot] = extent.z;
+}
+
+void SceneBvh::update()
+{
+    if (_needsRebuild) {
+        rebuild();
+    }
+    else if (_needsRefit) {
+        refit();
+        if (treeCost() > REBUILD_COST_RATIO * _builtCost) {
+            rebuild();
+        }
+    }
+}
+
+void SceneBvh::rebuild()
+{
+    const uint32_t count = static_cast<uint32_t>(_modelMatrices.size());
+
+    _order.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        _order[i] = i;
+    }
+
+    _nodes.clear();
+    if (count > 0) {
+        _nodes.reserve(2 * (count / MAX_LEAF_SIZE + 1));
+        build(0, count);
+    }
+
+    _slots.resize(count);
+    for (std::vector<float>& component : _soa) {
+        component.assign(count + SOA_PADDING, 0.0f);
+    }
+    for (uint32_t slot = 0; slot < count; slot++) {
+        _slots[_order[slot]] = slot;
+        storeLeafBounds(slot);
+    }
+
+    std::fill(_dirty.begin(), _dirty.end(), false);
+    _needsRebuild = false;
+    _needsRefit = false;
+    _builtCost = treeCost();
+
+    _stats.objectsCount = count;
+    _stats.nodesCount = _nodes.size();
+    _stats.rebuildsCount++;
+}
+
+uint32_t SceneBvh::build(uint32_t firstObject, uint32_t objectsCount)
+{
+    const uint32_t index = static_cast<uint32_t>(_nodes.size());
+    _nodes.emplace_back();
+
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+    glm::vec3 centersMin = boundsMin;
+    glm::vec3 centersMax = boundsMax;
+    for (uint32_t i = firstObject; i < firstObject + objectsCount; i++) {
+        const uint32_t object = _order[i];
+        boundsMin = glm::min(boundsMin, _worldMin[object]);
+        boundsMax = glm::max(boundsMax, _worldMax[object]);
+
+        glm::vec3 center = _worldMin[object] + _worldMax[object];
+        centersMin = glm::min(centersMin, center);
+        centersMax = glm::max(centersMax, center);
+    }
+
+    uint32_t rightChild = 0;
+    if (objectsCount > MAX_LEAF_SIZE) {
+        glm::vec3 spread = centersMax - centersMin;
+        int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+
+        const uint32_t half = objectsCount / 2;
+        std::nth_element(_order.begin() + firstObject, _order.begin() + firstObject + half, _order.begin() + firstObject + objectsCount,
+                         [this, axis](uint32_t a, uint32_t b) {
+                             return _worldMin[a][axis] + _worldMax[a][axis] < _worldMin[b][axis] + _worldMax[b][axis];
+                         });
+
+        build(firstObject, half);
+        rightChild = build(firstObject + half, objectsCount - half);
+    }
+
+    Node& node = _nodes[index];
+    node.boundsMin = boundsMin;
+    node.boundsMax = boundsMax;
+    node.firstObject = firstObject;
+    node.objectsCount = objectsCount;
+    node.rightChild = rightChild;
+    return index;
+}
+
+void SceneBvh::refit()
+{
+    for (size_t object = 0; object < _dirty.size(); object++) {
+        if (_dirty[object]) {
+            storeLeafBounds(_slots[object]);
+            _dirty[object] = false;
+        }
+    }
+
+    // Потомки всегда идут после родителя, поэтому обратный порядок обходит дерево снизу вверх.
+    for (size_t i = _nodes.size(); i-- > 0;) {
+        Node& node = _nodes[i];
+        if (node.rightChild == 0) {
+            node.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+            node.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+            for (uint32_t slot = node.firstObject; slot < node.firstObject + node.objectsCount; slot++) {
+                node.boundsMin = glm::min(node.boundsMin, _worldMin[_order[slot]]);
+                node.boundsMax = glm::max(node.boundsMax, _worldMax[_order[slot]]);
+            }
+        }
+        else {
+            const Node& left = _nodes[i + 1];
+            const Node& right = _nodes[node.rightChild];
+            node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+            node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+        }
+    }
+
+    _needsRefit = false;
+    _stats.refitsCount++;
+}
+
+float SceneBvh::treeCost() const
+{
+    if (_nodes.empty()) {
+        return 0.0f;
+    }
+
+    // Оценка SAH без констант: сумма площадей узлов относительно площади корня.
+    const float rootArea = std::max(surfaceArea(_nodes[0].boundsMin, _nodes[0].boundsMax), std::numeric_limits<float>::min());
+
+    float cost = 0.0f;
+    for (const Node& node : _nodes) {
+        cost += surfaceArea(node.boundsMin, node.boundsMax) / rootArea;
+    }
+    return cost;
+}
+
+template <class Lanes>
+void SceneBvh::cullLeaf(const Node& node, const Frustum& frustum, uint32_t planeMask, std::vector<size_t>& visible)
+{
+    typedef typename Lanes::F F;
+
+    const uint32_t end = node.firstObject + node.objectsCount;
+    for (uint32_t first = node.firstObject; first < end; first += static_cast<uint32_t>(Lanes::width)) {
+        F cx = Lanes::load(&_soa[CENTER_X][first]);
+        F cy = Lanes::load(&_soa[CENTER_Y][first]);
+        F cz = Lanes::load(&_soa[CENTER_Z][first]);
+        F ex = Lanes::load(&_soa[EXTENT_X][first]);
+        F ey = Lanes::load(&_soa[EXTENT_Y][first]);
+        F ez = Lanes::load(&_soa[EXTENT_Z][first]);
+
+        // Параллелепипед снаружи плоскости, если dot(n, c) + w + dot(|n|, e) < 0.
+        uint32_t outside = 0;
+        for (int p = 0; p < 6; p++) {
+            if (!(planeMask & (1u << p))) {
+                continue;
+            }
+
+            const glm::vec4& plane = frustum.planes[p];
+            F distance = Lanes::add(Lanes::add(Lanes::mul(Lanes::set1(plane.x), cx), Lanes::mul(Lanes::set1(plane.y), cy)),
+                                    Lanes::add(Lanes::mul(Lanes::set1(plane.z), cz), Lanes::set1(plane.w)));
+            F radius = Lanes::add(Lanes::add(Lanes::mul(Lanes::set1(std::fabs(plane.x)), ex), Lanes::mul(Lanes::set1(std::fabs(plane.y)), ey)),
+                                  Lanes::mul(Lanes::set1(std::fabs(plane.z)), ez));
+            outside |= Lanes::negativeMask(Lanes::add(distance, radius));
+        }
+
+        const uint32_t lanes = std::min(static_cast<uint32_t>(Lanes::width), end - first);
+        for (uint32_t lane = 0; lane < lanes; lane++) {
+            if (!(outside & (1u << lane))) {
+                visible.push_back(_order[first + lane]);
+            }
+        }
+    }
+
+    _stats.objectsTested += node.objectsCount;
+}
+
+void SceneBvh::cull(const Frustum& frustum, std::vector<size_t>& visible)
+{
+    update();
+
+    visible.clear();
+    _stats.nodesVisited = 0;
+    _stats.objectsTested = 0;
+
+    if (!_nodes.empty()) {
+        struct Entry {
+            uint32_t node;
+            uint32_t planeMask; //плоскости, относительно которых положение узла еще не известно
+        };
+
+        Entry stack[64];
+        size_t stackSize = 0;
+        stack[stackSize++] = Entry{ 0, 0x3f };
+
+        while (stackSize > 0) {
+            const Entry entry = stack[--stackSize];
+            const Node& node = _nodes[entry.node];
+            _stats.nodesVisited++;
+
+            glm::vec3 center = 0.5f * (node.boundsMin + node.boundsMax);
+            glm::vec3 extent = 0.5f * (node.boundsMax - node.boundsMin);
+
+            uint32_t planeMask = entry.planeMask;
+            bool outside = false;
+            for (int p = 0; p < 6 && !outside; p++) {
+                if (!(planeMask & (1u << p))) {
+                    continue;
+                }
+
+                const glm::vec4& plane = frustum.planes[p];
+                float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+                float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+                if (distance + radius < 0.0f) {
+                    outside = true;
+                }
+                else if (distance - radius >= 0.0f) {
+                    planeMask &= ~(1u << p);
+                }
+            }
+
+            if (outside) {
+                continue;
+            }
+
+            if (planeMask == 0) {
+                // Узел целиком внутри: его объекты лежат подряд и проверять их не нужно.
+                for (uint32_t slot = node.firstObject; slot < node.firstObject + node.objectsCount; slot++) {
+                    visible.push_back(_order[slot]);
+                }
+            }
+            else if (node.rightChild == 0) {
+                cullLeaf<simd::WidestLanes>(node, frustum, planeMask, visible);
+            }
+            else {
+                // Глубина сбалансированного по медиане дерева - log2 от числа листьев, 64 уровней хватает с запасом.
+                assert(stackSize + 2 <= sizeof(stack) / sizeof(stack[0]));
+                stack[stackSize++] = Entry{ node.rightChild, planeMask };
+                stack[stackSize++] = Entry{ entry.node + 1, planeMask };
+            }
+        }
+    }
+
+    _stats.visibleCount = visible.size();
+    _stats.culledCount = _modelMatrices.size() - visible.size();
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Frustum.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/**
+Иерархия ограничивающих параллелепипедов (BVH) над экземплярами мешей сцены для отсечения по пирамиде видимости на процессоре.
+Объект - локальный параллелепипед меша (Mesh::boundsMin/boundsMax) и матрица модели; в дереве хранятся параллелепипеды в мировой системе координат.
+
+Дерево строится сверху вниз делением по медиане центров вдоль самой длинной оси и хранится в массиве в прямом порядке обхода,
+поэтому объекты любого поддерева лежат подряд. При изменении матриц дерево не перестраивается, а только пересчитывает
+параллелепипеды снизу вверх (refit); если после этого суммарная площадь узлов выросла больше чем в REBUILD_COST_RATIO раз
+относительно построения, дерево строится заново.
+
+При обходе узел, целиком лежащий внутри плоскости, снимает ее с проверки для своих потомков, а узел внутри всех плоскостей
+принимается целиком без проверки объектов. Объекты листьев проверяются пачками по ширине SIMD-дорожек (см. SimdMath.hpp).
+*/
+class SceneBvh
+{
+public:
+    struct Stats {
+        size_t objectsCount = 0;
+        size_t nodesCount = 0;
+
+        ///Результаты последнего cull
+        size_t visibleCount = 0;
+        size_t culledCount = 0;
+        size_t nodesVisited = 0;
+        size_t objectsTested = 0;
+
+        size_t rebuildsCount = 0;
+        size_t refitsCount = 0;
+    };
+
+    static const uint32_t MAX_LEAF_SIZE = 8;
+    static constexpr float REBUILD_COST_RATIO = 1.5f;
+
+    void clear();
+
+    /**
+    Добавляет объект
+    \return номер объекта для setModelMatrix и в результатах cull (номера идут подряд с 0)
+    */
+    size_t add(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& modelMatrix);
+
+    /**
+    Меняет матрицу модели объекта. Дерево обновится при следующем cull
+    */
+    void setModelMatrix(size_t object, const glm::mat4& modelMatrix);
+
+    /**
+    Перестраивает дерево после добавления объектов или обновляет его после изменения матриц
+    */
+    void update();
+
+    /**
+    Находит объекты, параллелепипеды которых пересекают пирамиду (консервативно)
+    \param visible номера видимых объектов (массив очищается)
+    */
+    void cull(const Frustum& frustum, std::vector<size_t>& visible);
+
+    size_t size() const { return _modelMatrices.size(); }
+
+    const Stats& getStats() const { return _stats; }
+
+protected:
+    struct Node {
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+
+        ///Объекты поддерева: _order[firstObject, firstObject + objectsCount)
+        uint32_t firstObject;
+        uint32_t objectsCount;
+
+        ///Номер правого потомка (левый всегда следует сразу за узлом), 0 у листа
+        uint32_t rightChild;
+    };
+
+    void rebuild();
+    void refit();
+    uint32_t build(uint32_t firstObject, uint32_t objectsCount);
+    void updateWorldBounds(size_t object);
+    void storeLeafBounds(uint32_t slot);
+    float treeCost() const;
+
+    template <class Lanes>
+    void cullLeaf(const Node& node, const Frustum& frustum, uint32_t planeMask, std::vector<size_t>& visible);
+
+    std::vector<glm::vec3> _localMin;
+    std::vector<glm::vec3> _localMax;
+    std::vector<glm::mat4> _modelMatrices;
+
+    ///Параллелепипеды в мировой системе координат по номерам объектов
+    std::vector<glm::vec3> _worldMin;
+    std::vector<glm::vec3> _worldMax;
+    std::vector<bool> _dirty;
+
+    std::vector<Node> _nodes;
+
+    ///Номера объектов в порядке дерева и обратная перестановка
+    std::vector<uint32_t> _order;
+    std::vector<uint32_t> _slots;
+
+    ///Центры и полуразмеры в порядке дерева, по одному массиву на компоненту (с запасом в ширину дорожек для чтения хвостов)
+    std::vector<float> _soa[6];
+
+    bool _needsRebuild = false;
+    bool _needsRefit = false;
+    float _builtCost = 0.0f;
+
+    Stats _stats;
+};
@@ -0,0 +1,257 @@
+#include "SceneImport.hpp"
+#include "ThreadPool.hpp"
+
+#include <assimp/cimport.h>
+#include <assimp/scene.h>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <utility>
+
+namespace
+{
+    glm::vec3 toVec3(const aiColor4D& color)
+    {
+        return glm::vec3(color.r, color.g, color.b);
+    }
+
+    ///aiMatrix4x4 хранится по строкам, glm - по столбцам
+    glm::mat4 toMat4(const aiMatrix4x4& m)
+    {
+        return glm::transpose(glm::make_mat4(&m.a1));
+    }
+
+    std::string texturePath(const aiMaterial& material, aiTextureType type, const std::string& directory)
+    {
+        aiString path;
+        if (aiGetMaterialTextureCount(&material, type) == 0 || aiGetMaterialTexture(&material, type, 0, &path) != AI_SUCCESS) {
+            return std::string();
+        }
+
+        std::string result = path.C_Str();
+        if (result.empty() || result[0] == '*' || result[0] == '/' || result.find(':') != std::string::npos) {
+            return result;
+        }
+        return directory + result;
+    }
+
+    SceneMaterial readMaterial(const aiMaterial& material, const std::string& directory)
+    {
+        SceneMaterial result;
+
+        aiString name;
+        if (aiGetMaterialString(&material, AI_MATKEY_NAME, &name) == AI_SUCCESS) {
+            result.name = name.C_Str();
+        }
+
+        aiColor4D color;
+        if (aiGetMaterialColor(&material, AI_MATKEY_COLOR_DIFFUSE, &color) == AI_SUCCESS) {
+            result.diffuseColor = toVec3(color);
+        }
+        if (aiGetMaterialColor(&material, AI_MATKEY_COLOR_SPECULAR, &color) == AI_SUCCESS) {
+            result.specularColor = toVec3(color);
+        }
+        if (aiGetMaterialColor(&material, AI_MATKEY_COLOR_EMISSIVE, &color) == AI_SUCCESS) {
+            result.emissiveColor = toVec3(color);
+        }
+
+        ai_real value;
+        if (aiGetMaterialFloatArray(&material, AI_MATKEY_SHININESS, &value, nullptr) == AI_SUCCESS) {
+            result.shininess = static_cast<float>(value);
+        }
+        if (aiGetMaterialFloatArray(&material, AI_MATKEY_OPACITY, &value, nullptr) == AI_SUCCESS) {
+            result.opacity = static_cast<float>(value);
+        }
+
+        result.diffuseTexture = texturePath(material, aiTextureType_DIFFUSE, directory);
+        result.specularTexture = texturePath(material, aiTextureType_SPECULAR, directory);
+
+        // Экспортеры OBJ кладут карту нормалей в слот высот (map_bump).
+        result.normalTexture = texturePath(material, aiTextureType_NORMALS, directory);
+        if (result.normalTexture.empty()) {
+            result.normalTexture = texturePath(material, aiTextureType_HEIGHT, directory);
+        }
+        return result;
+    }
+
+    ///Обход в глубину: родитель попадает в nodes раньше потомков
+    void readNodes(const aiNode& root, std::vector<SceneNode>& nodes)
+    {
+        std::vector<std::pair<const aiNode*, int>> stack = { { &root, -1 } };
+        while (!stack.empty()) {
+            const aiNode* source = stack.back().first;
+            const int parent = stack.back().second;
+            stack.pop_back();
+
+            SceneNode node;
+            node.name = source->mName.C_Str();
+            node.parent = parent;
+            node.localTransform = toMat4(source->mTransformation);
+            node.worldTransform = parent >= 0 ? nodes[parent].worldTransform * node.localTransform : node.localTransform;
+            node.meshes.assign(source->mMeshes, source->mMeshes + source->mNumMeshes);
+
+            const int index = static_cast<int>(nodes.size());
+            nodes.push_back(std::move(node));
+
+            for (unsigned int i = source->mNumChildren; i > 0; i--) {
+                stack.emplace_back(source->mChildren[i - 1], index);
+            }
+        }
+    }
+}
+
+void ImportedScene::addToDrawList(GeometryDrawList& drawList, GLuint firstInstance) const
+{
+    for (size_t i = 0; i < instances.size(); i++) {
+        drawList.add(meshes[instances[i].meshIndex].range, firstInstance + static_cast<GLuint>(i));
+    }
+}
+
+ImportedScenePtr loadScene(const std::string& filename, const SceneImportSettings& settings, ThreadPool* pool)
+{
+    typedef std::chrono::steady_clock Clock;
+    auto seconds = [](Clock::time_point from) { return std::chrono::duration<double>(Clock::now() - from).count(); };
+
+    Clock::time_point start = Clock::now();
+
+    const aiScene* assimpScene = importAssimpFile(filename, settings.importFlags);
+    if (!assimpScene)
+    {
+        return nullptr;
+    }
+
+    const double importSeconds = seconds(start);
+    start = Clock::now();
+
+    const size_t separator = filename.find_last_of("/\\");
+    const std::string directory = separator == std::string::npos ? std::string() : filename.substr(0, separator + 1);
+
+    ImportedScenePtr scene = std::make_shared<ImportedScene>();
+
+    for (unsigned int i = 0; i < assimpScene->mNumMaterials; i++) {
+        scene->materials.push_back(readMaterial(*assimpScene->mMaterials[i], directory));
+    }
+
+    if (assimpScene->mRootNode) {
+        readNodes(*assimpScene->mRootNode, scene->nodes);
+    }
+
+    // Атрибуты читаются из сцены Assimp последовательно, а дорогая подготовка (оптимизация индексов, кластеры, упаковка)
+    // идет по мешам параллельно.
+    struct Source {
+        bool valid = false;
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::vec3> normals;
+        std::vector<glm::vec2> texcoords;
+        std::vector<GLuint> indices;
+    };
+
+    const size_t meshesCount = assimpScene->mNumMeshes;
+    std::vector<Source> sources(meshesCount);
+    scene->meshes.resize(meshesCount);
+    for (size_t i = 0; i < meshesCount; i++) {
+        const aiMesh& assimpMesh = *assimpScene->mMeshes[i];
+        Source& source = sources[i];
+        source.valid = readAIMesh(assimpMesh, source.vertices, source.normals, source.texcoords, source.indices) && !source.indices.empty();
+
+        scene->meshes[i].name = assimpMesh.mName.C_Str();
+        scene->meshes[i].materialIndex = assimpMesh.mMaterialIndex;
+    }
+
+    aiReleaseImport(assimpScene);
+
+    std::vector<MeshData> prepared(meshesCount);
+    auto prepare = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            Source& source = sources[i];
+            if (source.valid) {
+                prepared[i] = prepareIndexedMesh(std::move(source.vertices), std::move(source.normals), std::move(source.texcoords),
+                                                 std::move(source.indices), settings.format, "Mesh " + scene->meshes[i].name + " of " + filename);
+            }
+        }
+    };
+    if (pool) {
+        pool->parallelFor(meshesCount, prepare);
+    }
+    else {
+        prepare(0, meshesCount);
+    }
+
+    const double prepareSeconds = seconds(start);
+    start = Clock::now();
+
+    // Все меши упакованы в один формат, поэтому раскладку берем у первого, а арену создаем сразу нужного размера.
+    const MeshData* first = nullptr;
+    GLuint verticesCount = 0;
+    GLuint indicesCount = 0;
+    for (size_t i = 0; i < meshesCount; i++) {
+        if (sources[i].valid) {
+            first = first ? first : &prepared[i];
+            verticesCount += prepared[i].vertexCount;
+            indicesCount += static_cast<GLuint>(prepared[i].indices.size());
+        }
+    }
+
+    if (!first) {
+        std::cerr << "No supported meshes in file " << filename << std::endl;
+        return nullptr;
+    }
+
+    scene->arena = std::make_shared<GeometryArena>(first->attributes, first->attributes.front().stride, verticesCount, indicesCount);
+
+    for (size_t i = 0; i < meshesCount; i++) {
+        if (!sources[i].valid) {
+            continue;
+        }
+
+        const MeshData& data = prepared[i];
+        SceneMesh& mesh = scene->meshes[i];
+        mesh.range = scene->arena->add(data.vertexData.data(), data.vertexCount, data.indices.data(), static_cast<GLuint>(data.indices.size()));
+        mesh.dequantizationMatrix = data.dequantizationMatrix;
+        mesh.boundsMin = data.boundsMin;
+        mesh.boundsMax = data.boundsMax;
+        mesh.boundingSphere = data.boundingSphere;
+        mesh.meshlets = data.meshlets;
+    }
+
+    scene->boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    scene->boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+    for (unsigned int nodeIndex = 0; nodeIndex < scene->nodes.size(); nodeIndex++) {
+        const SceneNode& node = scene->nodes[nodeIndex];
+        for (unsigned int meshIndex : node.meshes) {
+            if (meshIndex >= meshesCount || !sources[meshIndex].valid) {
+                continue;
+            }
+
+            SceneInstance instance;
+            instance.meshIndex = meshIndex;
+            instance.nodeIndex = nodeIndex;
+            instance.modelMatrix = node.worldTransform;
+            scene->instances.push_back(instance);
+
+            const SceneMesh& mesh = scene->meshes[meshIndex];
+            for (int corner = 0; corner < 8; corner++) {
+                glm::vec3 local((corner & 1) ? mesh.boundsMax.x : mesh.boundsMin.x,
+                                (corner & 2) ? mesh.boundsMax.y : mesh.boundsMin.y,
+                                (corner & 4) ? mesh.boundsMax.z : mesh.boundsMin.z);
+                glm::vec3 world = glm::vec3(node.worldTransform * glm::vec4(local, 1.0f));
+                scene->boundsMin = glm::min(scene->boundsMin, world);
+                scene->boundsMax = glm::max(scene->boundsMax, world);
+            }
+        }
+    }
+    if (scene->instances.empty()) {
+        scene->boundsMin = scene->boundsMax = glm::vec3(0.0f);
+    }
+
+    std::cout << "Scene " << filename << " is loaded: " << meshesCount << " meshes, " << scene->nodes.size() << " nodes, "
+              << scene->instances.size() << " instances, " << scene->materials.size() << " materials, "
+              << verticesCount << " vertices, " << indicesCount / 3 << " triangles; import " << importSeconds * 1000.0
+              << " ms, prepare " << prepareSeconds * 1000.0 << " ms, upload " << seconds(start) * 1000.0 << " ms\n";
+
+    return scene;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "GeometryArena.hpp"
+#include "Mesh.hpp"
+
+#include <assimp/postprocess.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+/**
+Параметры импорта сцены (см. loadScene)
+*/
+struct SceneImportSettings
+{
+    /**
+    Флаги постобработки Assimp (aiPostProcessSteps). Треугольники читаются только при aiProcess_Triangulate,
+    а aiProcess_PreTransformVertices схлопывает иерархию узлов в один корень
+    */
+    unsigned int importFlags = aiProcessPreset_TargetRealtime_MaxQuality;
+
+    VertexFormat format = VertexFormat::Float;
+};
+
+/**
+Материал сцены: основные цвета и ссылки на текстуры. Сами текстуры не загружаются (см. loadTexture)
+*/
+struct SceneMaterial
+{
+    std::string name;
+
+    glm::vec3 diffuseColor = glm::vec3(1.0f);
+    glm::vec3 specularColor = glm::vec3(0.0f);
+    glm::vec3 emissiveColor = glm::vec3(0.0f);
+    float shininess = 0.0f;
+    float opacity = 1.0f;
+
+    /**
+    Пути к текстурам с учетом каталога файла сцены. Пустая строка - текстуры нет.
+    Текстуры, встроенные в файл, имеют вид "*N" и остаются как есть
+    */
+    std::string diffuseTexture;
+    std::string specularTexture;
+    std::string normalTexture;
+};
+
+/**
+Меш сцены внутри общей арены
+*/
+struct SceneMesh
+{
+    std::string name;
+
+    ///Пустой диапазон - меш не поддерживается (см. readAIMesh) и не рисуется
+    GeometryRange range;
+
+    unsigned int materialIndex = 0;
+
+    ///Позиции нужно умножать на modelMatrix * dequantizationMatrix (см. Mesh::dequantizationMatrix)
+    glm::mat4 dequantizationMatrix = glm::mat4(1.0f);
+
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    glm::vec4 boundingSphere = glm::vec4(0.0f);
+
+    ///Кластеры меша; Meshlet::firstIndex отсчитывается от range.firstIndex
+    std::vector<Meshlet> meshlets;
+};
+
+/**
+Узел иерархии сцены
+*/
+struct SceneNode
+{
+    std::string name;
+
+    ///Номер родителя в ImportedScene::nodes, -1 у корня
+    int parent = -1;
+
+    glm::mat4 localTransform = glm::mat4(1.0f);
+
+    ///Произведение преобразований от корня до узла
+    glm::mat4 worldTransform = glm::mat4(1.0f);
+
+    ///Номера мешей в ImportedScene::meshes
+    std::vector<unsigned int> meshes;
+};
+
+/**
+Меш, размещенный в узле: одна отрисовка сцены
+*/
+struct SceneInstance
+{
+    unsigned int meshIndex = 0;
+    unsigned int nodeIndex = 0;
+
+    ///Мировое преобразование узла (без матрицы деквантования меша)
+    glm::mat4 modelMatrix = glm::mat4(1.0f);
+};
+
+/**
+Сцена, импортированная из файла за один проход: все меши лежат в общих буферах одной арены
+*/
+struct ImportedScene
+{
+    GeometryArenaPtr arena;
+
+    ///Номера совпадают с номерами мешей в файле (aiScene::mMeshes)
+    std::vector<SceneMesh> meshes;
+    std::vector<SceneMaterial> materials;
+
+    ///Родитель всегда идет раньше потомков
+    std::vector<SceneNode> nodes;
+
+    ///Пары (узел, меш) в порядке nodes, без неподдерживаемых мешей
+    std::vector<SceneInstance> instances;
+
+    ///Ограничивающий параллелепипед всех экземпляров в мировой системе координат
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+
+    /**
+    Добавляет в список по одной отрисовке на экземпляр; экземпляр i получает baseInstance = firstInstance + i,
+    поэтому его данные кладутся в атрибуты экземпляров арены с тем же номером
+    */
+    void addToDrawList(GeometryDrawList& drawList, GLuint firstInstance = 0) const;
+};
+
+typedef std::shared_ptr<ImportedScene> ImportedScenePtr;
+
+/**
+Импортирует файл Assimp один раз и загружает все его меши в одну арену вместе с иерархией узлов и материалами.
+Меши готовятся так же, как в loadFromFile (см. prepareIndexedMesh); если задан pool, то параллельно.
+Все меши одного формата, поэтому недостающие текстурные координаты заполняются нулями
+\return nullptr, если файл не удалось прочитать или в нем нет поддерживаемых мешей
+*/
+ImportedScenePtr loadScene(const std::string& filename, const SceneImportSettings& settings = SceneImportSettings(), ThreadPool* pool = nullptr);
@@ -1,91 +1,321 @@
 #include "ShaderProgram.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <fstream>
 
 #include "Common.h"
+#include "UniformBlocks.hpp"
 
-void Shader::createFromFile(const std::string& filepath)
+bool Shader::readFile(const std::string& filepath, std::string& text)
 {
     //Читаем текст шейдера из файла
     std::ifstream shaderFile(filepath.c_str());
     if (shaderFile.fail())
     {
-        std::cerr << "Failed to load shader file " << filepath << std::endl;
-        exit(1);
+        return false;
     }
-    std::string shaderFileContent((std::istreambuf_iterator<char>(shaderFile)), (std::istreambuf_iterator<char>()));
+    text.assign((std::istreambuf_iterator<char>(shaderFile)), (std::istreambuf_iterator<char>()));
     shaderFile.close();
 
-    createFromString(filepath, shaderFileContent);
+    return true;
 }
 
-void Shader::createFromString(const std::string &name, const std::string& text)
+bool Shader::createFromFile(const std::string& filepath)
 {
+    std::string text;
+    if (!readFile(filepath, text))
+    {
+        ShaderError error;
+        error.shader = filepath;
+        error.log = "Failed to load shader file";
+        std::cerr << error << std::endl;
+        return false;
+    }
+
+    return createFromString(filepath, text);
+}
+
+bool Shader::createFromString(const std::string &name, const std::string& text)
+{
+    compile(name, text);
+
+    //Проверяем ошибки компиляции
+    ShaderError error;
+    if (!compiled(&error.log))
+    {
+        error.shader = name;
+        std::cerr << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Shader::compile(const std::string &name, const std::string& text)
+{
+    _name = name;
+
     const char* shaderText = text.c_str();
 
     glShaderSource(_id, 1, &shaderText, NULL);
 
     glCompileShader(_id);
+}
 
-    //Проверяем ошибки компиляции
+bool Shader::compiled(std::string* log) const
+{
     int status = -1;
     glGetShaderiv(_id, GL_COMPILE_STATUS, &status);
-    if (status != GL_TRUE)
+    if (status == GL_TRUE)
     {
-        GLint errorLength;
-        glGetShaderiv(_id, GL_INFO_LOG_LENGTH, &errorLength);
+        return true;
+    }
 
-        std::vector<char> errorMessage;
-        errorMessage.resize(errorLength);
+    if (log)
+    {
+        GLint errorLength = 0;
+        glGetShaderiv(_id, GL_INFO_LOG_LENGTH, &errorLength);
 
+        std::vector<char> errorMessage(std::max(errorLength, 1), '\0');
         glGetShaderInfoLog(_id, errorLength, 0, errorMessage.data());
 
-        std::cerr << "Failed to compile the shader `" << name << "`:\n" << errorMessage.data() << std::endl;
-
-        exit(1);
+        *log = errorMessage.data();
     }
+    return false;
 }
 
 //===================================================================
 
-void ShaderProgram::createProgram(const std::string &vertFilepath, const std::string &geomFilePath,
-        const std::string &fragFilepath) {
-    ShaderPtr vs = std::make_shared<Shader>(GL_VERTEX_SHADER);
-    vs->createFromFile(vertFilepath);
-    attachShader(vs);
+std::ostream& operator<<(std::ostream& stream, const ShaderError& error)
+{
+    if (error.shader.empty()) {
+        return stream << "Failed to link the program `" << error.program << "`:\n" << error.log;
+    }
+    if (error.program.empty()) {
+        return stream << "Failed to build the shader `" << error.shader << "`:\n" << error.log;
+    }
+    return stream << "Failed to build the shader `" << error.shader << "` of the program `" << error.program << "`:\n" << error.log;
+}
+
+std::string ShaderFeatures::defines() const
+{
+    std::string result;
+    for (size_t i = 0; i < names.size(); i++) {
+        if (mask & (1u << i)) {
+            result += "#define " + names[i] + "\n";
+        }
+    }
+    return result;
+}
+
+std::string ShaderFeatures::describe() const
+{
+    std::string result;
+    for (size_t i = 0; i < names.size(); i++) {
+        if (mask & (1u << i)) {
+            result += (result.empty() ? "" : " ") + names[i];
+        }
+    }
+    return result;
+}
+
+namespace
+{
+    /**
+    Вставляет определения после строки #version (она должна остаться первой директивой).
+    #line возвращает следующей строке ее номер в файле, чтобы сообщения компилятора указывали на нужные строки
+    */
+    std::string injectDefines(const std::string& text, const std::string& defines)
+    {
+        if (defines.empty()) {
+            return text;
+        }
+
+        size_t version = text.find("#version");
+        if (version == std::string::npos) {
+            return defines + "#line 1\n" + text;
+        }
+
+        size_t lineEnd = text.find('\n', version);
+        if (lineEnd == std::string::npos) {
+            return text + "\n" + defines;
+        }
+
+        const size_t nextLine = std::count(text.begin(), text.begin() + lineEnd, '\n') + 2;
+        return text.substr(0, lineEnd + 1) + defines + "#line " + std::to_string(nextLine) + "\n" + text.substr(lineEnd + 1);
+    }
+
+    std::string programLog(GLuint program)
+    {
+        GLint errorLength = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &errorLength);
+
+        std::vector<char> errorMessage(std::max(errorLength, 1), '\0');
+        glGetProgramInfoLog(program, errorLength, 0, errorMessage.data());
+
+        return errorMessage.data();
+    }
+}
+
+bool ShaderProgram::createProgram(const std::string &vertFilepath, const std::string &geomFilePath,
+        const std::string &fragFilepath, ProgramCache *cache) {
+    std::vector<ShaderSource> sources;
+    if (!readSources({ { GL_VERTEX_SHADER, vertFilepath }, { GL_GEOMETRY_SHADER, geomFilePath }, { GL_FRAGMENT_SHADER, fragFilepath } }, sources)) {
+        return false;
+    }
+    return createProgram(sources, cache);
+}
+
+bool ShaderProgram::createProgramCompute(const std::string& computeFilePath, ProgramCache *cache) {
+    std::vector<ShaderSource> sources;
+    if (!readSources({ { GL_COMPUTE_SHADER, computeFilePath } }, sources)) {
+        return false;
+    }
+    return createProgram(sources, cache);
+}
+
+bool ShaderProgram::createProgram(const std::string& vertFilepath, const std::string& fragFilepath, ProgramCache *cache)
+{
+    std::vector<ShaderSource> sources;
+    if (!readSources({ { GL_VERTEX_SHADER, vertFilepath }, { GL_FRAGMENT_SHADER, fragFilepath } }, sources)) {
+        return false;
+    }
+    return createProgram(sources, cache);
+}
+
+bool ShaderProgram::createProgram(const std::vector<ShaderSource>& sources, ProgramCache *cache, const ShaderFeatures &features)
+{
+    startBuild(sources, cache, features);
+
+    std::vector<ShaderError> errors;
+    if (!finishBuild(&errors))
+    {
+        for (const ShaderError& error : errors) {
+            std::cerr << error << std::endl;
+        }
+        return false;
+    }
+    return true;
+}
+
+bool ShaderProgram::readSources(const std::vector<std::pair<GLenum, std::string>>& files, std::vector<ShaderSource>& sources)
+{
+    _name.clear();
+    for (const auto& file : files) {
+        _name += (_name.empty() ? "" : ", ") + file.second;
+    }
+
+    sources.resize(files.size());
+    bool loaded = true;
+    for (size_t i = 0; i < files.size(); i++) {
+        sources[i].type = files[i].first;
+        sources[i].name = files[i].second;
+        if (!Shader::readFile(sources[i].name, sources[i].text)) {
+            ShaderError error;
+            error.program = _name;
+            error.shader = sources[i].name;
+            error.log = "Failed to load shader file";
+            std::cerr << error << std::endl;
+            loaded = false;
+        }
+    }
+
+    if (!loaded) {
+        _buildState = BuildState::Failed;
+    }
+    return loaded;
+}
+
+void ShaderProgram::startBuild(const std::vector<ShaderSource>& sources, ProgramCache *cache, const ShaderFeatures &features)
+{
+    _name.clear();
+    for (const ShaderSource& source : sources) {
+        _name += (_name.empty() ? "" : ", ") + source.name;
+    }
+
+    const std::string defines = features.defines();
+    _features = features.mask;
+    if (!defines.empty()) {
+        _name += " [" + features.describe() + "]";
+    }
 
-    ShaderPtr gs = std::make_shared<Shader>(GL_GEOMETRY_SHADER);
-    gs->createFromFile(geomFilePath);
-    attachShader(gs);
+    _buildCache = nullptr;
+    if (cache) {
+        _buildKey = cache->makeKey(sources, defines);
+        if (cache->load(_programId, _buildKey)) {
+            initializeLinked();
+            _buildState = BuildState::Linked;
+            return;
+        }
+        cache->prepareProgram(_programId);
+        _buildCache = cache;
+    }
 
-    ShaderPtr fs = std::make_shared<Shader>(GL_FRAGMENT_SHADER);
-    fs->createFromFile(fragFilepath);
-    attachShader(fs);
+    // Статусы компиляции не запрашиваются до линковки: запрос заставил бы ждать каждый шейдер по очереди.
+    // Если шейдер не скомпилировался, не слинкуется и программа, и ошибки шейдеров собираются в finishBuild.
+    for (const ShaderSource& source : sources) {
+        ShaderPtr shader = std::make_shared<Shader>(source.type);
+        shader->compile(source.name, injectDefines(source.text, defines));
+        attachShader(shader);
+    }
 
-    linkProgram();
+    glLinkProgram(_programId);
+    _buildState = BuildState::Linking;
 }
 
-void ShaderProgram::createProgramCompute(const std::string& computeFilePath) {
-    ShaderPtr cs = std::make_shared<Shader>(GL_COMPUTE_SHADER);
-    cs->createFromFile(computeFilePath);
-    attachShader(cs);
+bool ShaderProgram::isBuildComplete() const
+{
+    if (_buildState != BuildState::Linking || !GLEW_ARB_parallel_shader_compile) {
+        return true;
+    }
 
-    linkProgram();
+    GLint completed = GL_FALSE;
+    glGetProgramiv(_programId, GL_COMPLETION_STATUS_ARB, &completed);
+    return completed == GL_TRUE;
 }
 
-void ShaderProgram::createProgram(const std::string& vertFilepath, const std::string& fragFilepath)
+bool ShaderProgram::finishBuild(std::vector<ShaderError> *errors)
 {
-    ShaderPtr vs = std::make_shared<Shader>(GL_VERTEX_SHADER);
-    vs->createFromFile(vertFilepath);
-    attachShader(vs);
+    if (_buildState != BuildState::Linking) {
+        return _buildState != BuildState::Failed;
+    }
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(_programId, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        _buildState = BuildState::Failed;
+        _buildCache = nullptr;
+
+        if (errors) {
+            const size_t errorsCount = errors->size();
+            for (const ShaderPtr& shader : _shaders) {
+                ShaderError error;
+                if (!shader->compiled(&error.log)) {
+                    error.program = describe();
+                    error.shader = shader->name();
+                    errors->push_back(error);
+                }
+            }
+
+            if (errors->size() == errorsCount) {
+                ShaderError error;
+                error.program = describe();
+                error.log = programLog(_programId);
+                errors->push_back(error);
+            }
+        }
+        return false;
+    }
 
-    ShaderPtr fs = std::make_shared<Shader>(GL_FRAGMENT_SHADER);
-    fs->createFromFile(fragFilepath);
-    attachShader(fs);
+    _buildState = BuildState::Linked;
+    initializeLinked();
 
-    linkProgram();
+    if (_buildCache) {
+        _buildCache->store(_programId, _buildKey);
+        _buildCache = nullptr;
+    }
+    return true;
 }
 
 void ShaderProgram::attachShader(const ShaderPtr& shader)
@@ -95,7 +325,7 @@ void ShaderProgram::attachShader(const ShaderPtr& shader)
     _shaders.push_back(shader);
 }
 
-void ShaderProgram::linkProgram()
+bool ShaderProgram::linkProgram()
 {
     glLinkProgram(_programId);
 
@@ -104,16 +334,171 @@ void ShaderProgram::linkProgram()
     glGetProgramiv(_programId, GL_LINK_STATUS, &status);
     if (status != GL_TRUE)
     {
-        GLint errorLength;
-        glGetProgramiv(_programId, GL_INFO_LOG_LENGTH, &errorLength);
+        _buildState = BuildState::Failed;
+
+        ShaderError error;
+        error.program = describe();
+        error.log = programLog(_programId);
+        std::cerr << error << std::endl;
+        return false;
+    }
+
+    _buildState = BuildState::Linked;
+    initializeLinked();
+    return true;
+}
+
+void ShaderProgram::initializeLinked()
+{
+    buildUniformTable();
+
+    bindUniformBlock("CameraBlock", CAMERA_BLOCK_BINDING);
+    bindUniformBlock("LightsBlock", LIGHTS_BLOCK_BINDING);
+    bindUniformBlock("ObjectBlock", OBJECT_BLOCK_BINDING);
+}
+
+void ShaderProgram::bindUniformBlock(const std::string& blockName, GLuint binding)
+{
+    GLuint blockIndex = glGetUniformBlockIndex(_programId, blockName.c_str());
+    if (blockIndex != GL_INVALID_INDEX) {
+        glUniformBlockBinding(_programId, blockIndex, binding);
+    }
+}
+
+namespace
+{
+    /**
+    Переменные типа int задаются и для bool, и для сэмплеров (номер текстурного блока)
+    */
+    bool uniformTypeMatches(GLenum type, GLenum expectedType)
+    {
+        if (type == expectedType) {
+            return true;
+        }
+        if (expectedType != GL_INT) {
+            return false;
+        }
+
+        switch (type) {
+        case GL_BOOL:
+        case GL_SAMPLER_1D:
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_3D:
+        case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_1D_SHADOW:
+        case GL_SAMPLER_2D_SHADOW:
+        case GL_SAMPLER_1D_ARRAY:
+        case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_2D_ARRAY_SHADOW:
+        case GL_SAMPLER_CUBE_SHADOW:
+        case GL_SAMPLER_BUFFER:
+        case GL_SAMPLER_2D_RECT:
+        case GL_SAMPLER_2D_MULTISAMPLE:
+        case GL_INT_SAMPLER_2D:
+        case GL_INT_SAMPLER_BUFFER:
+        case GL_UNSIGNED_INT_SAMPLER_2D:
+        case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+            return true;
+        default:
+            return false;
+        }
+    }
+}
+
+void ShaderProgram::buildUniformTable()
+{
+    _uniforms.clear();
+    _uniformIndices.clear();
+    _extraLocations.clear();
+    _reportedUniforms.clear();
+
+    if (USE_INTERFACE_QUERY) {
+        GLint count = 0;
+        glGetProgramInterfaceiv(_programId, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+
+        const GLenum properties[] = { GL_NAME_LENGTH, GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE };
+        std::vector<char> name;
+        for (GLint i = 0; i < count; i++) {
+            GLint values[4];
+            glGetProgramResourceiv(_programId, GL_UNIFORM, i, 4, properties, 4, nullptr, values);
+
+            // У переменных юниформ-блоков нет места.
+            if (values[2] < 0) {
+                continue;
+            }
 
-        std::vector<char> errorMessage;
-        errorMessage.resize(errorLength);
+            name.resize(values[0]);
+            glGetProgramResourceName(_programId, GL_UNIFORM, i, values[0], nullptr, name.data());
 
-        glGetProgramInfoLog(_programId, errorLength, 0, errorMessage.data());
+            UniformInfo info;
+            info.name = name.data();
+            info.type = values[1];
+            info.location = values[2];
+            info.arraySize = values[3];
+            _uniforms.push_back(info);
+        }
+    }
+    else {
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(_programId, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(_programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        std::vector<char> name(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++) {
+            GLint size = 0;
+            GLenum type = GL_NONE;
+            glGetActiveUniform(_programId, i, maxLength, nullptr, &size, &type, name.data());
+
+            GLint location = glGetUniformLocation(_programId, name.data());
+            if (location < 0) {
+                continue;
+            }
+
+            UniformInfo info;
+            info.name = name.data();
+            info.type = type;
+            info.location = location;
+            info.arraySize = size;
+            _uniforms.push_back(info);
+        }
+    }
+
+    const std::string arraySuffix = "[0]";
+    for (size_t i = 0; i < _uniforms.size(); i++) {
+        const std::string& name = _uniforms[i].name;
+        _uniformIndices[name] = i;
+
+        if (name.size() > arraySuffix.size() && name.compare(name.size() - arraySuffix.size(), arraySuffix.size(), arraySuffix) == 0) {
+            _uniformIndices[name.substr(0, name.size() - arraySuffix.size())] = i;
+        }
+    }
+}
+
+GLint ShaderProgram::findUniform(const std::string& name, GLenum expectedType) const
+{
+    auto found = _uniformIndices.find(name);
+    if (found != _uniformIndices.end()) {
+        const UniformInfo& info = _uniforms[found->second];
+        if (!uniformTypeMatches(info.type, expectedType) && _reportedUniforms.insert(name).second) {
+            std::cerr << "Uniform " << name << " in program " << describe() << " has type 0x" << std::hex << info.type
+                      << ", but is set as 0x" << expectedType << std::dec << std::endl;
+        }
+        return info.location;
+    }
 
-        std::cerr << "Failed to link the program:\n" << errorMessage.data() << std::endl;
+    auto extra = _extraLocations.find(name);
+    if (extra == _extraLocations.end()) {
+        extra = _extraLocations.emplace(name, glGetUniformLocation(_programId, name.c_str())).first;
+    }
 
-        exit(1);
+    if (extra->second < 0 && _reportedUniforms.insert(name).second) {
+        std::cerr << "Uniform " << name << " is not active in program " << describe() << std::endl;
     }
+    return extra->second;
+}
+
+std::string ShaderProgram::describe() const
+{
+    return _name.empty() ? "#" + std::to_string(_programId) : _name;
 }
@@ -7,11 +7,16 @@
 
 #include <GL/glew.h>
 
+#include <ostream>
 #include <string>
 #include <vector>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 #include "Common.h"
+#include "ProgramCache.hpp"
 
 /**
 Класс для создания и работы с отдельным шейдером
@@ -31,30 +36,120 @@ public:
     }
 
     /**
-    Читает текст шейдера из файла
+    Читает текст шейдера из файла и компилирует его. При ошибке сообщает о ней и возвращает false
     */
-    void createFromFile(const std::string& filepath);
+    bool createFromFile(const std::string& filepath);
 
     /**
-    Использует текст шейдера из строковой переменной
+    Читает текст файла. Возвращает false, если файл не читается
     */
-    void createFromString(const std::string &name, const std::string& text);
+    static bool readFile(const std::string& filepath, std::string& text);
+
+    /**
+    Использует текст шейдера из строковой переменной. При ошибке компиляции сообщает о ней и возвращает false
+    */
+    bool createFromString(const std::string &name, const std::string& text);
+
+    /**
+    Отправляет текст на компиляцию, не дожидаясь ее окончания. Результат проверяется через compiled
+    */
+    void compile(const std::string &name, const std::string& text);
+
+    /**
+    Успешно ли скомпилирован шейдер. Ждет окончания компиляции; при ошибке кладет журнал компилятора в log
+    */
+    bool compiled(std::string* log = nullptr) const;
 
     /**
     Возвращает идентификатор шейдера
     */
     GLuint id() const { return _id; }
 
+    ///Имя для сообщений об ошибках (путь к файлу или имя, переданное в createFromString)
+    const std::string& name() const { return _name; }
+
 protected:
     Shader(const Shader&) = delete;
     void operator=(const Shader&) = delete;
 
     GLuint _id;
     GLenum _shaderType;
+    std::string _name;
 };
 
 typedef std::shared_ptr<Shader> ShaderPtr;
 
+/**
+Дескриптор юниформ-переменной с типом значения T (см. ShaderProgram::uniform).
+Место переменной определяется один раз, после чего значение задается без поиска по имени и без запросов к драйверу
+*/
+template <class T>
+struct Uniform
+{
+    GLint location = -1;
+
+    ///false, если переменной нет в программе (в том числе если компилятор убрал ее как неиспользуемую)
+    bool valid() const { return location >= 0; }
+};
+
+///Тип переменной GLSL, соответствующий типу значения (для int подходят также bool и сэмплеры)
+template <class T> struct UniformType;
+template <> struct UniformType<int> { static const GLenum value = GL_INT; };
+template <> struct UniformType<float> { static const GLenum value = GL_FLOAT; };
+template <> struct UniformType<glm::ivec2> { static const GLenum value = GL_INT_VEC2; };
+template <> struct UniformType<glm::vec2> { static const GLenum value = GL_FLOAT_VEC2; };
+template <> struct UniformType<glm::vec3> { static const GLenum value = GL_FLOAT_VEC3; };
+template <> struct UniformType<glm::vec4> { static const GLenum value = GL_FLOAT_VEC4; };
+template <> struct UniformType<glm::mat3> { static const GLenum value = GL_FLOAT_MAT3; };
+template <> struct UniformType<glm::mat4> { static const GLenum value = GL_FLOAT_MAT4; };
+
+/**
+Активная юниформ-переменная программы
+*/
+struct UniformInfo
+{
+    ///Имя, как его возвращает драйвер (у массивов с суффиксом "[0]")
+    std::string name;
+    GLenum type = GL_NONE;
+    GLint location = -1;
+    GLint arraySize = 1;
+};
+
+/**
+Ошибка сборки шейдерной программы
+*/
+struct ShaderError
+{
+    ///Имя программы (пути к файлам ее шейдеров); пусто для шейдера вне программы
+    std::string program;
+
+    ///Шейдер, который не скомпилировался или не прочитался; пусто для ошибок линковки
+    std::string shader;
+
+    ///Журнал компилятора или линковщика
+    std::string log;
+};
+
+std::ostream& operator<<(std::ostream& stream, const ShaderError& error);
+
+/**
+Признаки варианта программы. Для каждого установленного бита i маски в каждую стадию сразу после #version
+вставляется "#define names[i]", и шейдер выбирает ветви через #ifdef во время компиляции, а не во время работы
+*/
+struct ShaderFeatures
+{
+    uint32_t mask = 0;
+
+    ///Имена определений по номерам бит
+    std::vector<std::string> names;
+
+    ///Строки #define для установленных бит
+    std::string defines() const;
+
+    ///Имена установленных бит через пробел (для сообщений)
+    std::string describe() const;
+};
+
 /**
 Класс для работы с шейдерной программой
 */
@@ -64,32 +159,58 @@ public:
             _programId(glCreateProgram()) {
     }
 
-    ShaderProgram(const std::string &vertFilepath, const std::string &fragFilepath) :
+    ShaderProgram(const std::string &vertFilepath, const std::string &fragFilepath, ProgramCache *cache = nullptr) :
             _programId(glCreateProgram()) {
-        createProgram(vertFilepath, fragFilepath);
+        createProgram(vertFilepath, fragFilepath, cache);
     }
 
 
-    ShaderProgram(const std::string &vertFilepath, const std::string &geomFilePath, const std::string &fragFilepath) :
+    ShaderProgram(const std::string &vertFilepath, const std::string &geomFilePath, const std::string &fragFilepath, ProgramCache *cache = nullptr) :
             _programId(glCreateProgram()) {
-        createProgram(vertFilepath, geomFilePath, fragFilepath);
+        createProgram(vertFilepath, geomFilePath, fragFilepath, cache);
     }
 
     ~ShaderProgram() {
         glDeleteProgram(_programId);
     }
 
-    void createProgramCompute(const std::string& computeFilePath);
+    bool createProgramCompute(const std::string& computeFilePath, ProgramCache *cache = nullptr);
 
     /**
     Создает шейдерную программу из нескольких шейдеров: вершинного и фрагментного
+    \param cache кеш двоичных образов программ; nullptr - всегда компилировать из текста
     */
-    void createProgram(const std::string &vertFilepath, const std::string &fragFilepath);
+    bool createProgram(const std::string &vertFilepath, const std::string &fragFilepath, ProgramCache *cache = nullptr);
 
     /**
     Создает шейдерную программу из нескольких шейдеров: вершинного и фрагментного
     */
-    void createProgram(const std::string &vertFilepath, const std::string &geomFilePath, const std::string &fragFilepath);
+    bool createProgram(const std::string &vertFilepath, const std::string &geomFilePath, const std::string &fragFilepath, ProgramCache *cache = nullptr);
+
+    /**
+    Создает шейдерную программу из текстов стадий. Если в кеше есть образ с ключом из этих текстов и строк драйвера,
+    программа загружается из него без компиляции; иначе компилируется, и образ сохраняется в кеш.
+    Ждет окончания сборки; при ошибке сообщает о ней и возвращает false. Собралась ли программа, можно узнать и через isLinked
+    */
+    bool createProgram(const std::vector<ShaderSource> &sources, ProgramCache *cache = nullptr, const ShaderFeatures &features = ShaderFeatures());
+
+    /**
+    Начинает сборку программы из текстов стадий: загружает образ из кеша или отправляет шейдеры на компиляцию
+    и программу на линковку, не дожидаясь результата. Сборку заканчивает finishBuild (см. также ProgramBatch)
+    */
+    void startBuild(const std::vector<ShaderSource> &sources, ProgramCache *cache = nullptr, const ShaderFeatures &features = ShaderFeatures());
+
+    /**
+    Закончил ли драйвер сборку, начатую startBuild. Без GL_ARB_parallel_shader_compile узнать это без ожидания нельзя,
+    поэтому тогда всегда возвращает true
+    */
+    bool isBuildComplete() const;
+
+    /**
+    Заканчивает сборку (если нужно, ждет ее) и готовит программу к работе. При ошибке возвращает false и добавляет
+    в errors по ошибке на каждый нескомпилированный шейдер или одну ошибку линковки
+    */
+    bool finishBuild(std::vector<ShaderError> *errors = nullptr);
 
     /**
     Добавляет шейдер к программе
@@ -97,9 +218,21 @@ public:
     void attachShader(const ShaderPtr &shader);
 
     /**
-    Линкует программу
+    Линкует программу, строит таблицу ее юниформ-переменных и привязывает общие юниформ-блоки (см. UniformBlocks.hpp).
+    При ошибке сообщает о ней и возвращает false
+    */
+    bool linkProgram();
+
+    /**
+    Собрана ли программа. false, пока сборка не закончена, и после любой ошибки (файл не прочитался, шейдер не скомпилировался,
+    программа не слинковалась): такой программой рисовать нельзя
     */
-    void linkProgram();
+    bool isLinked() const { return _buildState == BuildState::Linked; }
+
+    /**
+    Привязывает юниформ-блок blockName к точке binding. Блоки, которых нет в программе, пропускаются
+    */
+    void bindUniformBlock(const std::string &blockName, GLuint binding);
 
     /**
     Возвращает идентификатор программы
@@ -120,68 +253,145 @@ public:
 
     //----------------------------------------------------------
 
-    void setIntUniform(const std::string &name, const int &value) const {
-        GLint uniformLoc = glGetUniformLocation(_programId, name.c_str());
+    /**
+    Дескриптор юниформ-переменной name с типом значения T. Место берется из таблицы, построенной при линковке.
+    Неизвестное имя или несовпадение типа сообщается один раз, дескриптор тогда невалиден (или указывает на переменную другого типа)
+    */
+    template <class T>
+    Uniform<T> uniform(const std::string &name) const {
+        Uniform<T> result;
+        result.location = findUniform(name, UniformType<T>::value);
+        return result;
+    }
+
+    /**
+    Активные юниформ-переменные программы вне юниформ-блоков
+    */
+    const std::vector<UniformInfo>& uniforms() const { return _uniforms; }
+
+    /**
+    Есть ли активная переменная name. Переменные, которые вариант программы не использует, компилятор убирает
+    */
+    bool hasUniform(const std::string &name) const { return _uniformIndices.count(name) > 0; }
+
+    ///Маска признаков, с которыми собрана программа (см. ShaderFeatures)
+    uint32_t features() const { return _features; }
+
+    void set(const Uniform<int> &uniform, int value) const {
         if (USE_DSA)
-            glProgramUniform1i(_programId, uniformLoc, value);
+            glProgramUniform1i(_programId, uniform.location, value);
         else {
             assertActive();
-            glUniform1i(uniformLoc, value);
+            glUniform1i(uniform.location, value);
         }
     }
 
-    void setFloatUniform(const std::string &name, const float &value) const {
-        GLint uniformLoc = glGetUniformLocation(_programId, name.c_str());
+    void set(const Uniform<float> &uniform, float value) const {
         if (USE_DSA)
-            glProgramUniform1f(_programId, uniformLoc, value);
+            glProgramUniform1f(_programId, uniform.location, value);
         else {
             assertActive();
-            glUniform1f(uniformLoc, value);
+            glUniform1f(uniform.location, value);
         }
     }
 
-    void setVec2Uniform(const std::string &name, const glm::vec2 &vec) const {
-        GLint uniformLoc = glGetUniformLocation(_programId, name.c_str());
+    void set(const Uniform<glm::ivec2> &uniform, const glm::ivec2 &vec) const {
         if (USE_DSA)
-            glProgramUniform2fv(_programId, uniformLoc, 1, glm::value_ptr(vec));
+            glProgramUniform2iv(_programId, uniform.location, 1, glm::value_ptr(vec));
         else {
             assertActive();
-            glUniform2fv(uniformLoc, 1, glm::value_ptr(vec));
+            glUniform2iv(uniform.location, 1, glm::value_ptr(vec));
         }
     }
 
-    void setVec3Uniform(const std::string &name, const glm::vec3 &vec) const {
-        GLint uniformLoc = glGetUniformLocation(_programId, name.c_str());
+    void set(const Uniform<glm::vec2> &uniform, const glm::vec2 &vec) const {
         if (USE_DSA)
-            glProgramUniform3fv(_programId, uniformLoc, 1, glm::value_ptr(vec));
+            glProgramUniform2fv(_programId, uniform.location, 1, glm::value_ptr(vec));
         else {
             assertActive();
-            glUniform3fv(uniformLoc, 1, glm::value_ptr(vec));
+            glUniform2fv(uniform.location, 1, glm::value_ptr(vec));
         }
     }
 
-    void setVec4Uniform(const std::string &name, const glm::vec4 &vec) const {
-        GLint uniformLoc = glGetUniformLocation(_programId, name.c_str());
+    void set(const Uniform<glm::vec3> &uniform, const glm::vec3 &vec) const {
         if (USE_DSA)
-            glProgramUniform4fv(_programId, uniformLoc, 1, glm::value_ptr(vec));
+            glProgramUniform3fv(_programId, uniform.location, 1, glm::value_ptr(vec));
         else {
             assertActive();
-            glUniform4fv(uniformLoc, 1, glm::value_ptr(vec));
+            glUniform3fv(uniform.location, 1, glm::value_ptr(vec));
         }
     }
 
-    void setMat3Uniform(const std::string &name, const glm::mat3 &mat) const {
-        GLint uniformLoc = glGetUniformLocation(_programId, name.c_str());
+    void set(const Uniform<glm::vec4> &uniform, const glm::vec4 &vec) const {
+        if (USE_DSA)
+            glProgramUniform4fv(_programId, uniform.location, 1, glm::value_ptr(vec));
+        else {
+            assertActive();
+            glUniform4fv(uniform.location, 1, glm::value_ptr(vec));
+        }
+    }
+
+    void set(const Uniform<glm::vec4> &uniform, const glm::vec4* values, size_t count) const {
         if (USE_DSA)
-            glProgramUniformMatrix3fv(_programId, uniformLoc, 1, GL_FALSE, glm::value_ptr(mat));
+            glProgramUniform4fv(_programId, uniform.location, static_cast<GLsizei>(count), reinterpret_cast<const GLfloat *>(values));
         else {
             assertActive();
-            glUniformMatrix3fv(uniformLoc, 1, GL_FALSE, glm::value_ptr(mat));
+            glUniform4fv(uniform.location, static_cast<GLsizei>(count), reinterpret_cast<const GLfloat *>(values));
         }
     }
 
+    void set(const Uniform<glm::mat3> &uniform, const glm::mat3 &mat) const {
+        if (USE_DSA)
+            glProgramUniformMatrix3fv(_programId, uniform.location, 1, GL_FALSE, glm::value_ptr(mat));
+        else {
+            assertActive();
+            glUniformMatrix3fv(uniform.location, 1, GL_FALSE, glm::value_ptr(mat));
+        }
+    }
+
+    void set(const Uniform<glm::mat4> &uniform, const glm::mat4 &mat) const {
+        if (USE_DSA)
+            glProgramUniformMatrix4fv(_programId, uniform.location, 1, GL_FALSE, glm::value_ptr(mat));
+        else {
+            assertActive();
+            glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(mat));
+        }
+    }
+
+    //----------------------------------------------------------
+    //Задание значений по имени: поиск в таблице программы без запросов к драйверу.
+    //Для переменных, которые задаются для каждой отрисовки, лучше один раз получить дескриптор через uniform()
+
+    void setIntUniform(const std::string &name, const int &value) const {
+        set(uniform<int>(name), value);
+    }
+
+    void setFloatUniform(const std::string &name, const float &value) const {
+        set(uniform<float>(name), value);
+    }
+
+    void setIVec2Uniform(const std::string &name, const glm::ivec2 &vec) const {
+        set(uniform<glm::ivec2>(name), vec);
+    }
+
+    void setVec2Uniform(const std::string &name, const glm::vec2 &vec) const {
+        set(uniform<glm::vec2>(name), vec);
+    }
+
+    void setVec3Uniform(const std::string &name, const glm::vec3 &vec) const {
+        set(uniform<glm::vec3>(name), vec);
+    }
+
+    void setVec4Uniform(const std::string &name, const glm::vec4 &vec) const {
+        set(uniform<glm::vec4>(name), vec);
+    }
+
+    void setMat3Uniform(const std::string &name, const glm::mat3 &mat) const {
+        set(uniform<glm::mat3>(name), mat);
+    }
+
     void setMat3Uniforms(const std::string &name, const std::vector<glm::mat3> &matrices) {
-        GLint uniformLoc = glGetUniformLocation(_programId, name.c_str());
+        GLint uniformLoc = findUniform(name, GL_FLOAT_MAT3);
         if (USE_DSA) {
             glProgramUniformMatrix3fv(_programId, uniformLoc, matrices.size(), GL_FALSE, reinterpret_cast<const GLfloat *>(matrices.data()));
         }
@@ -192,17 +402,11 @@ public:
     }
 
     void setMat4Uniform(const std::string &name, const glm::mat4 &mat) const {
-        GLint uniformLoc = glGetUniformLocation(_programId, name.c_str());
-        if (USE_DSA)
-            glProgramUniformMatrix4fv(_programId, uniformLoc, 1, GL_FALSE, glm::value_ptr(mat));
-        else {
-            assertActive();
-            glUniformMatrix4fv(uniformLoc, 1, GL_FALSE, glm::value_ptr(mat));
-        }
+        set(uniform<glm::mat4>(name), mat);
     }
 
     void setMat4Uniforms(const std::string &name, const std::vector<glm::mat4> &matrices) {
-        GLint uniformLoc = glGetUniformLocation(_programId, name.c_str());
+        GLint uniformLoc = findUniform(name, GL_FLOAT_MAT4);
         if (USE_DSA) {
             glProgramUniformMatrix4fv(_programId, uniformLoc, matrices.size(), GL_FALSE, reinterpret_cast<const GLfloat *>(matrices.data()));
         }
@@ -213,7 +417,7 @@ public:
     }
 
     void setVec3Uniforms(const std::string &name, const std::vector<glm::vec3> &positions) const {
-        GLint uniformLoc = glGetUniformLocation(_programId, name.c_str());
+        GLint uniformLoc = findUniform(name, GL_FLOAT_VEC3);
         if (USE_DSA)
             glProgramUniform3fv(_programId, uniformLoc, static_cast<GLsizei>(positions.size()), reinterpret_cast<const GLfloat *>(positions.data()));
         else {
@@ -222,13 +426,71 @@ public:
         }
     }
 
+    void setVec4Uniforms(const std::string &name, const glm::vec4* values, size_t count) const {
+        set(uniform<glm::vec4>(name), values, count);
+    }
+
 protected:
     ShaderProgram(const ShaderProgram &) = delete;
     void operator=(const ShaderProgram &) = delete;
 
+    /**
+    Читает тексты стадий из файлов (тип стадии, путь). Если файл не читается, сообщает об этом, помечает сборку неудавшейся
+    и возвращает false
+    */
+    bool readSources(const std::vector<std::pair<GLenum, std::string>> &files, std::vector<ShaderSource> &sources);
+
+    /**
+    Строит таблицу юниформ-переменных и привязывает общие юниформ-блоки. Вызывается после линковки
+    и после загрузки образа: привязки блоков в образ не входят
+    */
+    void initializeLinked();
+
+    /**
+    Заполняет таблицу юниформ-переменных после успешной линковки
+    */
+    void buildUniformTable();
+
+    /**
+    Место переменной name из таблицы. Имена вне таблицы (например элементы массивов "values[3]") запрашиваются у драйвера
+    один раз и запоминаются. О неизвестном имени и о типе, отличном от expectedType, сообщается один раз
+    */
+    GLint findUniform(const std::string &name, GLenum expectedType) const;
+
+    ///Пути к файлам шейдеров для сообщений об ошибках
+    std::string describe() const;
+
     GLuint _programId;
 
     std::vector<ShaderPtr> _shaders;
+
+    enum class BuildState {
+        None,     ///< сборка не начиналась
+        Linking,  ///< линковка отправлена драйверу
+        Linked,
+        Failed,
+    };
+    BuildState _buildState = BuildState::None;
+
+    uint32_t _features = 0;
+
+    ///Кеш, в который нужно сохранить образ после линковки, и ключ программы в нем
+    ProgramCache *_buildCache = nullptr;
+    uint64_t _buildKey = 0;
+
+    ///Файлы шейдеров, из которых создана программа (пусто, если шейдеры добавлены через attachShader)
+    std::string _name;
+
+    std::vector<UniformInfo> _uniforms;
+
+    ///Номера в _uniforms по имени; у массивов есть и имя без "[0]"
+    std::unordered_map<std::string, size_t> _uniformIndices;
+
+    ///Места переменных вне таблицы, уже запрошенные у драйвера (-1 - переменной нет)
+    mutable std::unordered_map<std::string, GLint> _extraLocations;
+
+    ///Имена, о которых уже сообщено
+    mutable std::unordered_set<std::string> _reportedUniforms;
 };
 
 typedef std::shared_ptr<ShaderProgram> ShaderProgramPtr;
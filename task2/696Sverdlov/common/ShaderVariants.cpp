@@ -0,0 +1,119 @@
+#include "ShaderVariants.hpp"
+
+#include <chrono>
+#include <iostream>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double secondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+}
+
+ShaderVariants::ShaderVariants(const std::string& vertFilepath, const std::string& fragFilepath, const std::vector<std::string>& featureNames,
+                               ProgramCache* cache) :
+    _sources(2),
+    _featureNames(featureNames),
+    _cache(cache)
+{
+    _sources[0].type = GL_VERTEX_SHADER;
+    _sources[0].name = vertFilepath;
+    _sources[1].type = GL_FRAGMENT_SHADER;
+    _sources[1].name = fragFilepath;
+
+    for (ShaderSource& source : _sources) {
+        if (!Shader::readFile(source.name, source.text)) {
+            ShaderError error;
+            error.program = vertFilepath + ", " + fragFilepath;
+            error.shader = source.name;
+            error.log = "Failed to load shader file";
+            _errors.push_back(error);
+            std::cerr << error << std::endl;
+
+            _sourcesLoaded = false;
+        }
+    }
+}
+
+void ShaderVariants::prepare(uint32_t features)
+{
+    if (_variants.count(features) > 0) {
+        return;
+    }
+
+    Variant& variant = _variants[features];
+
+    // Без текстов стадий вариант сразу считается несобранным (ошибка уже сообщена в конструкторе).
+    if (!_sourcesLoaded) {
+        variant.finished = true;
+        _stats.failedCount++;
+        return;
+    }
+
+    Clock::time_point start = Clock::now();
+
+    ShaderFeatures shaderFeatures;
+    shaderFeatures.mask = features;
+    shaderFeatures.names = _featureNames;
+
+    const size_t cacheHits = _cache ? _cache->getStats().hits : 0;
+
+    variant.program = std::make_shared<ShaderProgram>();
+    variant.program->startBuild(_sources, _cache, shaderFeatures);
+
+    if (_cache && _cache->getStats().hits > cacheHits) {
+        _stats.fromCache++;
+    }
+    _stats.buildSeconds += secondsSince(start);
+}
+
+ShaderProgramPtr ShaderVariants::get(uint32_t features)
+{
+    auto found = _variants.find(features);
+    if (found == _variants.end()) {
+        prepare(features);
+        found = _variants.find(features);
+    }
+
+    Variant& variant = found->second;
+    if (!variant.finished) {
+        Clock::time_point start = Clock::now();
+
+        variant.finished = true;
+
+        const size_t errorsCount = _errors.size();
+        if (variant.program->finishBuild(&_errors)) {
+            _stats.variantsCount++;
+        }
+        else {
+            variant.program.reset();
+            _stats.failedCount++;
+
+            for (size_t i = errorsCount; i < _errors.size(); i++) {
+                std::cerr << _errors[i] << std::endl;
+            }
+        }
+
+        _stats.buildSeconds += secondsSince(start);
+    }
+    return variant.program;
+}
+
+size_t ShaderVariants::buildAll()
+{
+    const uint32_t masksCount = 1u << _featureNames.size();
+    for (uint32_t features = 0; features < masksCount; features++) {
+        prepare(features);
+    }
+
+    size_t failedCount = 0;
+    for (uint32_t features = 0; features < masksCount; features++) {
+        if (!get(features)) {
+            failedCount++;
+        }
+    }
+    return failedCount;
+}
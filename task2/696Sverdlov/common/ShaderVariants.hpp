@@ -0,0 +1,81 @@
+#pragma once
+
+#include "ProgramCache.hpp"
+#include "ShaderProgram.hpp"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+Варианты одной шейдерной программы с разными наборами признаков (см. ShaderFeatures).
+Тексты стадий читаются один раз. Вариант собирается при первом обращении и дальше берется из таблицы по маске,
+поэтому выбирать вариант можно при каждой отрисовке. Вариант, который точно понадобится, можно начать собирать заранее
+через prepare: драйвер собирает его в фоне, а get только забирает результат
+*/
+class ShaderVariants
+{
+public:
+    struct Stats {
+        ///Собранные варианты, в том числе загруженные из кеша
+        size_t variantsCount = 0;
+
+        ///Варианты, загруженные из кеша двоичных образов без компиляции
+        size_t fromCache = 0;
+
+        size_t failedCount = 0;
+
+        ///Время сборки вариантов на процессоре: отправка драйверу и ожидание результата
+        double buildSeconds = 0.0;
+    };
+
+    /**
+    \param featureNames имена определений по номерам бит маски
+    \param cache кеш двоичных образов программ (может быть nullptr)
+    */
+    ShaderVariants(const std::string& vertFilepath, const std::string& fragFilepath, const std::vector<std::string>& featureNames,
+                   ProgramCache* cache = nullptr);
+
+    /**
+    Начинает сборку варианта, если его еще нет, и сразу возвращается
+    */
+    void prepare(uint32_t features);
+
+    /**
+    Вариант с признаками features. При первом обращении дожидается сборки.
+    Если вариант не собрался, сообщает об ошибках один раз и возвращает nullptr
+    */
+    ShaderProgramPtr get(uint32_t features);
+
+    /**
+    Собирает все варианты (по одному на каждую маску из featureNames.size() бит) и возвращает количество несобравшихся.
+    Сборка начинается для всех вариантов сразу, поэтому драйвер может собирать их параллельно. Для проверки шейдеров
+    */
+    size_t buildAll();
+
+    const std::vector<ShaderError>& errors() const { return _errors; }
+
+    const Stats& getStats() const { return _stats; }
+
+protected:
+    struct Variant {
+        ShaderProgramPtr program;
+        bool finished = false;
+    };
+
+    std::vector<ShaderSource> _sources;
+    std::vector<std::string> _featureNames;
+    ProgramCache* _cache;
+
+    ///false, если какой-то файл не прочитался
+    bool _sourcesLoaded = true;
+
+    std::unordered_map<uint32_t, Variant> _variants;
+
+    std::vector<ShaderError> _errors;
+
+    Stats _stats;
+};
+
+typedef std::shared_ptr<ShaderVariants> ShaderVariantsPtr;
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_MATH_SSE2
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_MATH_AVX2
+#endif
+
+/**
+Векторные ядра для пакетных вычислений над массивами float.
+Каждый набор "дорожек" (lanes) реализует одинаковый минимальный набор операций,
+поэтому алгоритмы пишутся один раз шаблоном и инстанцируются для скаляра, SSE2 или AVX2.
+*/
+namespace simd {
+
+/**
+Скалярный вариант: используется на платформах без SSE2 и для хвостов массивов
+*/
+struct ScalarLanes
+{
+    typedef float F;
+    typedef int32_t I;
+
+    static const size_t width = 1;
+
+    static F set1(float a) { return a; }
+    static F load(const float* p) { return *p; }
+    static void store(float* p, F a) { *p = a; }
+
+    static F add(F a, F b) { return a + b; }
+    static F sub(F a, F b) { return a - b; }
+    static F mul(F a, F b) { return a * b; }
+
+    ///Бит i результата равен 1, если дорожка i отрицательна
+    static uint32_t negativeMask(F a) { return a < 0.0f ? 1u : 0u; }
+
+    ///Округление к ближайшему целому (как _mm_cvtps_epi32 в режиме округления по умолчанию)
+    static I roundToInt(F a) { return static_cast<I>(std::nearbyint(a)); }
+    static F toFloat(I a) { return static_cast<F>(a); }
+
+    static I andInt(I a, int32_t b) { return a & b; }
+    static I addInt(I a, int32_t b) { return a + b; }
+
+    ///Выбирает ifOne там, где cond == 1, и ifZero там, где cond == 0
+    static F select(I cond, F ifOne, F ifZero) { return cond ? ifOne : ifZero; }
+
+    ///Меняет знак там, где signBit == 2 (бит 1 номера квадранта)
+    static F flipSign(F a, I signBit)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &a, sizeof(bits));
+        bits ^= static_cast<uint32_t>(signBit) << 30;
+        std::memcpy(&a, &bits, sizeof(bits));
+        return a;
+    }
+};
+
+#ifdef SIMD_MATH_SSE2
+struct Sse2Lanes
+{
+    typedef __m128 F;
+    typedef __m128i I;
+
+    static const size_t width = 4;
+
+    static F set1(float a) { return _mm_set1_ps(a); }
+    static F load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, F a) { _mm_storeu_ps(p, a); }
+
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+
+    static uint32_t negativeMask(F a) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(a, _mm_setzero_ps()))); }
+
+    static I roundToInt(F a) { return _mm_cvtps_epi32(a); }
+    static F toFloat(I a) { return _mm_cvtepi32_ps(a); }
+
+    static I andInt(I a, int32_t b) { return _mm_and_si128(a, _mm_set1_epi32(b)); }
+    static I addInt(I a, int32_t b) { return _mm_add_epi32(a, _mm_set1_epi32(b)); }
+
+    static F select(I cond, F ifOne, F ifZero)
+    {
+        F mask = _mm_castsi128_ps(_mm_cmpeq_epi32(cond, _mm_set1_epi32(1)));
+        return _mm_or_ps(_mm_and_ps(mask, ifOne), _mm_andnot_ps(mask, ifZero));
+    }
+
+    static F flipSign(F a, I signBit) { return _mm_xor_ps(a, _mm_castsi128_ps(_mm_slli_epi32(signBit, 30))); }
+};
+#endif
+
+#ifdef SIMD_MATH_AVX2
+struct Avx2Lanes
+{
+    typedef __m256 F;
+    typedef __m256i I;
+
+    static const size_t width = 8;
+
+    static F set1(float a) { return _mm256_set1_ps(a); }
+    static F load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, F a) { _mm256_storeu_ps(p, a); }
+
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+
+    static uint32_t negativeMask(F a) { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_LT_OQ))); }
+
+    static I roundToInt(F a) { return _mm256_cvtps_epi32(a); }
+    static F toFloat(I a) { return _mm256_cvtepi32_ps(a); }
+
+    static I andInt(I a, int32_t b) { return _mm256_and_si256(a, _mm256_set1_epi32(b)); }
+    static I addInt(I a, int32_t b) { return _mm256_add_epi32(a, _mm256_set1_epi32(b)); }
+
+    static F select(I cond, F ifOne, F ifZero)
+    {
+        return _mm256_blendv_ps(ifZero, ifOne, _mm256_castsi256_ps(_mm256_cmpeq_epi32(cond, _mm256_set1_epi32(1))));
+    }
+
+    static F flipSign(F a, I signBit) { return _mm256_xor_ps(a, _mm256_castsi256_ps(_mm256_slli_epi32(signBit, 30))); }
+};
+#endif
+
+///Самый широкий набор дорожек, доступный при текущих флагах компиляции
+#if defined(SIMD_MATH_AVX2)
+typedef Avx2Lanes WidestLanes;
+#elif defined(SIMD_MATH_SSE2)
+typedef Sse2Lanes WidestLanes;
+#else
+typedef ScalarLanes WidestLanes;
+#endif
+
+/**
+Одновременно вычисляет sin(x) и cos(x) (полиномы Cephes sinf/cosf).
+Аргумент приводится к [-pi/4, pi/4] вычитанием ближайшего кратного pi/2 (схема Коди-Уэйта): константа pi/2 разбита на 4 части,
+первые три содержат не более 12 значащих бит, поэтому их произведения на номер квадранта точны при |x| <= 4096.
+Это держит точность в пределах SINCOS_ULP_BUDGET ULP и вблизи нулей sin и cos.
+*/
+template <class L>
+inline void sincos(typename L::F x, typename L::F& s, typename L::F& c)
+{
+    typedef typename L::F F;
+    typedef typename L::I I;
+
+    I quadrant = L::roundToInt(L::mul(x, L::set1(0.636619772367581343f)));
+    F j = L::toFloat(quadrant);
+
+    F r = L::sub(x, L::mul(j, L::set1(1.5703125f)));
+    r = L::sub(r, L::mul(j, L::set1(4.837512969970703125e-4f)));
+    r = L::sub(r, L::mul(j, L::set1(7.549533620476722717285156250e-8f)));
+    r = L::sub(r, L::mul(j, L::set1(2.563344068257089602e-12f)));
+
+    F r2 = L::mul(r, r);
+
+    F sinPoly = L::add(L::mul(L::set1(-1.9515295891e-4f), r2), L::set1(8.3321608736e-3f));
+    sinPoly = L::add(L::mul(sinPoly, r2), L::set1(-1.6666654611e-1f));
+    sinPoly = L::add(L::mul(L::mul(sinPoly, r2), r), r);
+
+    F cosPoly = L::add(L::mul(L::set1(2.443315711809948e-5f), r2), L::set1(-1.388731625493765e-3f));
+    cosPoly = L::add(L::mul(cosPoly, r2), L::set1(4.166664568298827e-2f));
+    cosPoly = L::add(L::sub(L::mul(L::mul(cosPoly, r2), r2), L::mul(L::set1(0.5f), r2)), L::set1(1.0f));
+
+    I swap = L::andInt(quadrant, 1);
+    s = L::flipSign(L::select(swap, cosPoly, sinPoly), L::andInt(quadrant, 2));
+    c = L::flipSign(L::select(swap, sinPoly, cosPoly), L::andInt(L::addInt(quadrant, 1), 2));
+}
+
+///Допустимая ошибка simd::sincos относительно std::sin / std::cos в double
+const float SINCOS_ULP_BUDGET = 2.0f;
+
+/**
+Расстояние между a и точным значением reference в единицах ULP числа reference (приведенного к float)
+*/
+inline float ulpDistance(float a, double reference)
+{
+    float magnitude = std::fabs(static_cast<float>(reference));
+    float ulp = std::nextafter(magnitude, INFINITY) - magnitude;
+    return static_cast<float>(std::fabs(a - reference) / ulp);
+}
+
+}
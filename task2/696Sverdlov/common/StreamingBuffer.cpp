@@ -0,0 +1,146 @@
+#include "StreamingBuffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+
+StreamingBuffer::StreamingBuffer(GLenum target, GLsizeiptr frameSize, unsigned int framesInFlight) :
+    _buffer(std::make_shared<DataBuffer>(target)),
+    _frameSize(frameSize),
+    _defaultAlignment(16),
+    _framesInFlight(framesInFlight),
+    _fences(framesInFlight, nullptr)
+{
+    assert(framesInFlight > 0);
+
+    if (target == GL_UNIFORM_BUFFER) {
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        _defaultAlignment = std::max<GLsizeiptr>(_defaultAlignment, alignment);
+    }
+
+    // Регионы кадров тоже выравниваем, чтобы выравнивание смещений внутри региона было выравниванием в буфере.
+    _frameSize = (_frameSize + _defaultAlignment - 1) / _defaultAlignment * _defaultAlignment;
+    const GLsizeiptr totalSize = _frameSize * _framesInFlight;
+
+    if (USE_DSA) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        _buffer->initStorage(totalSize, nullptr, flags);
+        _mapped = static_cast<uint8_t*>(glMapNamedBufferRange(_buffer->id(), 0, totalSize, flags));
+        _persistent = _mapped != nullptr;
+    }
+
+    if (!_persistent) {
+        if (USE_DSA) {
+            std::cerr << "Failed to map streaming buffer persistently, falling back to glBufferSubData\n";
+            _buffer = std::make_shared<DataBuffer>(target); //хранилище, созданное glNamedBufferStorage, нельзя пересоздать
+        }
+        _buffer->setData(totalSize, nullptr, GL_STREAM_DRAW);
+        _shadow.resize(totalSize);
+        _mapped = _shadow.data();
+    }
+
+    _head = _flushed = 0;
+}
+
+StreamingBuffer::~StreamingBuffer()
+{
+    for (GLsync fence : _fences) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+
+    if (_persistent) {
+        glUnmapNamedBuffer(_buffer->id());
+    }
+}
+
+void StreamingBuffer::beginFrame()
+{
+    _frame = (_frame + 1) % _framesInFlight;
+    _head = _flushed = _frame * _frameSize;
+
+    _stats.bytesLastFrame = _stats.bytesThisFrame;
+    _stats.bytesThisFrame = 0;
+    _stats.fenceWaitSeconds = 0.0;
+
+    GLsync& fence = _fences[_frame];
+    if (!fence) {
+        return;
+    }
+
+    // Проверяем без ожидания: обычно видеокарта давно закончила кадр, и ждать не нужно.
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        auto start = std::chrono::steady_clock::now();
+
+        _stats.fenceStallsCount++;
+        do {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        } while (status == GL_TIMEOUT_EXPIRED);
+
+        _stats.fenceWaitSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        _stats.totalFenceWaitSeconds += _stats.fenceWaitSeconds;
+    }
+
+    if (status == GL_WAIT_FAILED) {
+        std::cerr << "glClientWaitSync failed for streaming buffer\n";
+    }
+
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+StreamingBuffer::Allocation StreamingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment)
+{
+    if (alignment == 0) {
+        alignment = _defaultAlignment;
+    }
+
+    const GLintptr offset = (_head + alignment - 1) / alignment * alignment;
+    const GLintptr frameEnd = (_frame + 1) * _frameSize;
+
+    Allocation allocation;
+    if (offset + size > frameEnd) {
+        // Писать в следующий регион нельзя: его может читать видеокарта.
+        _stats.overflowsCount++;
+        return allocation;
+    }
+
+    allocation.data = _mapped + offset;
+    allocation.offset = offset;
+    allocation.size = size;
+
+    _head = offset + size;
+    _stats.bytesThisFrame += size;
+
+    return allocation;
+}
+
+void StreamingBuffer::flush()
+{
+    if (_persistent || _head == _flushed) {
+        return;
+    }
+
+    _buffer->bind();
+    glBufferSubData(_buffer->target(), _flushed, _head - _flushed, _shadow.data() + _flushed);
+    _buffer->unbind();
+
+    _flushed = _head;
+}
+
+void StreamingBuffer::endFrame()
+{
+    flush();
+
+    assert(!_fences[_frame]);
+    _fences[_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void StreamingBuffer::bindRange(GLuint index, const Allocation& allocation) const
+{
+    glBindBufferRange(_buffer->target(), index, _buffer->id(), allocation.offset, allocation.size);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/**
+Кольцевой буфер для данных, которые меняются каждый кадр (матрицы экземпляров, палитры костей, юниформ-блоки).
+Буфер делится на framesInFlight регионов по frameSize байт; кадр пишет только в свой регион,
+а перед повторным использованием региона ждет fence, поставленный в конце кадра, который его заполнял.
+Поэтому запись никогда не пересекается с чтением видеокартой, и не нужны ни orphaning, ни неявная синхронизация драйвера.
+
+При наличии glNamedBufferStorage (OpenGL 4.5) буфер постоянно отображен в память (GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT),
+и allocate возвращает указатель прямо в видеопамять. Иначе данные пишутся в копию в оперативной памяти
+и копируются в буфер через glBufferSubData в flush.
+*/
+class StreamingBuffer
+{
+public:
+    struct Allocation {
+        ///Куда писать данные (nullptr, если регион кадра переполнен)
+        void* data = nullptr;
+
+        ///Смещение данных от начала буфера
+        GLintptr offset = 0;
+
+        GLsizeiptr size = 0;
+    };
+
+    struct Stats {
+        ///Записано байт за текущий и за предыдущий кадр
+        size_t bytesThisFrame = 0;
+        size_t bytesLastFrame = 0;
+
+        ///Время ожидания fence в начале текущего кадра и суммарно
+        double fenceWaitSeconds = 0.0;
+        double totalFenceWaitSeconds = 0.0;
+
+        ///Сколько раз регион кадра еще читался видеокартой и пришлось ждать
+        size_t fenceStallsCount = 0;
+
+        ///Сколько выделений не поместилось в регион кадра
+        size_t overflowsCount = 0;
+    };
+
+    /**
+    \param target тип буфера (GL_UNIFORM_BUFFER, GL_ARRAY_BUFFER и другие)
+    \param frameSize сколько байт может быть записано за один кадр
+    \param framesInFlight сколько кадров видеокарта может отставать от процессора
+    */
+    StreamingBuffer(GLenum target, GLsizeiptr frameSize, unsigned int framesInFlight = 3);
+    ~StreamingBuffer();
+
+    /**
+    Начинает кадр: переходит к следующему региону и ждет, пока видеокарта закончит читать его
+    */
+    void beginFrame();
+
+    /**
+    Выделяет size байт в регионе текущего кадра. Смещение выравнивается по alignment
+    (0 - по GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT для юниформ-буферов и 16 байт для остальных)
+    */
+    Allocation allocate(GLsizeiptr size, GLsizeiptr alignment = 0);
+
+    /**
+    Делает записанные данные видимыми для видеокарты. Нужно вызывать перед командами рисования, читающими данные.
+    При постоянном отображении ничего не делает
+    */
+    void flush();
+
+    /**
+    Заканчивает кадр: ставит fence после всех команд, читающих регион кадра
+    */
+    void endFrame();
+
+    /**
+    Привязывает выделенный диапазон к точке привязки index (для GL_UNIFORM_BUFFER и GL_SHADER_STORAGE_BUFFER)
+    */
+    void bindRange(GLuint index, const Allocation& allocation) const;
+
+    const DataBufferPtr& buffer() const { return _buffer; }
+
+    bool isPersistent() const { return _persistent; }
+
+    const Stats& getStats() const { return _stats; }
+
+protected:
+    StreamingBuffer(const StreamingBuffer&) = delete;
+    void operator=(const StreamingBuffer&) = delete;
+
+    DataBufferPtr _buffer;
+
+    GLsizeiptr _frameSize;
+    GLsizeiptr _defaultAlignment;
+    unsigned int _framesInFlight;
+
+    bool _persistent = false;
+    uint8_t* _mapped = nullptr;
+
+    ///Копия буфера в оперативной памяти, если постоянное отображение недоступно
+    std::vector<uint8_t> _shadow;
+
+    std::vector<GLsync> _fences;
+    unsigned int _frame = 0;
+
+    ///Смещение свободного места и начало еще не скопированных данных
+    GLintptr _head = 0;
+    GLintptr _flushed = 0;
+
+    Stats _stats;
+};
+
+typedef std::shared_ptr<StreamingBuffer> StreamingBufferPtr;
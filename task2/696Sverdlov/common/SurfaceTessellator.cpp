@@ -0,0 +1,147 @@
+#include "SurfaceTessellator.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+SurfaceTessellator::SurfaceTessellator(unsigned int ucnt, unsigned int vcnt, unsigned int threadsCount) :
+    _ucnt(ucnt),
+    _vcnt(vcnt)
+{
+    if (threadsCount != 1) {
+        _pool = std::make_shared<ThreadPool>(threadsCount);
+    }
+}
+
+void SurfaceTessellator::forEachRowBand(size_t rowsCount, const ThreadPool::RangeBody& body)
+{
+    if (_pool) {
+        _pool->parallelFor(rowsCount, body, 8);
+    }
+    else {
+        body(0, rowsCount);
+    }
+}
+
+void SurfaceTessellator::fillInTopology(std::vector<glm::vec2>& texcoords, std::vector<GLuint>& indices)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    const unsigned int ucnt = _ucnt;
+    const unsigned int vcnt = _vcnt;
+    const GLuint rowSize = vcnt + 1;
+
+    texcoords.resize(verticesCount());
+    indices.resize(indicesCount());
+
+    glm::vec2* texcoordsOut = texcoords.data();
+    GLuint* indicesOut = indices.data();
+
+    forEachRowBand(ucnt + 1, [=](size_t begin, size_t end) {
+        for (size_t ustep = begin; ustep < end; ++ustep) {
+            for (unsigned int vstep = 0; vstep <= vcnt; ++vstep) {
+                texcoordsOut[ustep * rowSize + vstep] = glm::vec2((float)ustep / ucnt, (float)vstep / vcnt);
+            }
+
+            if (ustep == ucnt) {
+                continue;
+            }
+
+            GLuint* cellIndices = indicesOut + ustep * 6 * vcnt;
+            for (unsigned int vstep = 0; vstep < vcnt; ++vstep) {
+                GLuint aa = static_cast<GLuint>(ustep * rowSize + vstep);
+                GLuint ab = aa + 1;
+                GLuint ba = aa + rowSize;
+                GLuint bb = ba + 1;
+
+                // upper-left triangle
+                *cellIndices++ = aa;
+                *cellIndices++ = ab;
+                *cellIndices++ = ba;
+
+                // lower-right triangle
+                *cellIndices++ = bb;
+                *cellIndices++ = ba;
+                *cellIndices++ = ab;
+            }
+        }
+    });
+
+    _stats.indicesCount += indices.size();
+    _stats.seconds += secondsSince(start);
+}
+
+void SurfaceTessellator::fillInSurface(std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, const SurfaceFillinParams& params)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    const unsigned int ucnt = _ucnt;
+    const unsigned int vcnt = _vcnt;
+    const size_t rowSize = vcnt + 1;
+
+    const float udelta = (params.umax - params.umin) / ucnt;
+    const float vdelta = (params.vmax - params.vmin) / vcnt;
+
+    vertices.resize(verticesCount());
+    normals.resize(verticesCount());
+
+    glm::vec3* verticesOut = vertices.data();
+    glm::vec3* normalsOut = normals.data();
+    const SurfaceFillinParams* surface = &params;
+
+    if (params.batchF) {
+        // Параметр v одинаков для всех строк, u постоянен вдоль строки.
+        std::vector<float> vRow(rowSize);
+        for (size_t vstep = 0; vstep < rowSize; ++vstep) {
+            vRow[vstep] = params.vmin + vstep * vdelta;
+        }
+        const float* vRowData = vRow.data();
+
+        forEachRowBand(ucnt + 1, [=](size_t begin, size_t end) {
+            std::vector<float> u(rowSize), x(rowSize), y(rowSize), z(rowSize);
+            for (size_t ustep = begin; ustep < end; ++ustep) {
+                std::fill(u.begin(), u.end(), surface->umin + ustep * udelta);
+                surface->batchF(u.data(), vRowData, rowSize, surface->aa, 0.5f, x.data(), y.data(), z.data());
+
+                glm::vec3* row = verticesOut + ustep * rowSize;
+                for (size_t vstep = 0; vstep < rowSize; ++vstep) {
+                    row[vstep] = glm::vec3(x[vstep], y[vstep], z[vstep]);
+                }
+            }
+        });
+    }
+    else {
+        forEachRowBand(ucnt + 1, [=](size_t begin, size_t end) {
+            for (size_t ustep = begin; ustep < end; ++ustep) {
+                float u = surface->umin + ustep * udelta;
+                for (unsigned int vstep = 0; vstep <= vcnt; ++vstep) {
+                    float v = surface->vmin + vstep * vdelta;
+                    verticesOut[ustep * rowSize + vstep] = surface->f(u, v, surface->aa, 0.5f);
+                }
+            }
+        });
+    }
+
+    // Нормали зависят от соседних строк, поэтому считаются вторым проходом, когда все позиции готовы.
+    forEachRowBand(ucnt + 1, [=](size_t begin, size_t end) {
+        for (size_t ustep = begin; ustep < end; ++ustep) {
+            size_t uprev = ustep > 0 ? ustep - 1 : ustep;
+            size_t unext = ustep < ucnt ? ustep + 1 : ustep;
+
+            for (size_t vstep = 0; vstep <= vcnt; ++vstep) {
+                size_t vprev = vstep > 0 ? vstep - 1 : vstep;
+                size_t vnext = vstep < vcnt ? vstep + 1 : vstep;
+
+                glm::vec3 du = verticesOut[unext * rowSize + vstep] - verticesOut[uprev * rowSize + vstep];
+                glm::vec3 dv = verticesOut[ustep * rowSize + vnext] - verticesOut[ustep * rowSize + vprev];
+
+                glm::vec3 normal = glm::cross(du, dv);
+                float length = glm::length(normal);
+                normalsOut[ustep * rowSize + vstep] = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+            }
+        }
+    });
+
+    _stats.surfacesCount++;
+    _stats.verticesCount += vertices.size();
+    _stats.seconds += secondsSince(start);
+}
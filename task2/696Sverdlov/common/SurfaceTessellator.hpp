@@ -0,0 +1,162 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <GL/glew.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+/**
+Пакетное вычисление count точек поверхности в формате SoA (см. kleinPositions)
+*/
+typedef void (*SurfaceBatchFunction)(const float* u, const float* v, size_t count, float aa, float scaler, float* x, float* y, float* z);
+
+/**
+Параметрическая поверхность f(u, v) и область определения параметров
+*/
+struct SurfaceFillinParams {
+    std::function<glm::vec3(float u, float v, float aa, float scaler)> f;
+
+    ///Пакетная версия f. Если задана, узлы сетки вычисляются построчно через нее
+    SurfaceBatchFunction batchF;
+
+    float aa;
+    float umin;
+    float umax;
+    float vmin;
+    float vmax;
+};
+
+/**
+Область определения параметров поверхности
+*/
+struct SurfaceDomain {
+    float umin;
+    float umax;
+    float vmin;
+    float vmax;
+};
+
+inline SurfaceDomain surfaceDomain(const SurfaceFillinParams& params)
+{
+    return SurfaceDomain{ params.umin, params.umax, params.vmin, params.vmax };
+}
+
+/**
+Строит индексированную сетку (ucnt + 1) x (vcnt + 1) узлов для параметрических поверхностей.
+Строки сетки (по u) разбиваются на полосы и обрабатываются пулом потоков; выходные массивы выделяются заранее,
+каждый узел пишется ровно одним потоком одной и той же скалярной функцией, поэтому результат
+побитово совпадает с однопоточным (threadsCount = 1) и не зависит от количества потоков.
+*/
+class SurfaceTessellator
+{
+public:
+    struct Stats {
+        size_t surfacesCount = 0;
+        size_t verticesCount = 0;
+        size_t indicesCount = 0;
+        double seconds = 0.0;
+    };
+
+    /**
+    \param ucnt, vcnt количество ячеек сетки по u и по v
+    \param threadsCount количество потоков. Если 1, то сетка строится в вызывающем потоке, если 0 - по числу ядер
+    */
+    SurfaceTessellator(unsigned int ucnt, unsigned int vcnt, unsigned int threadsCount = 0);
+
+    /**
+    Заполняет общую для всех поверхностей топологию сетки: текстурные координаты узлов
+    и индексы двух треугольников на каждую ячейку (u, v)
+    */
+    void fillInTopology(std::vector<glm::vec2>& texcoords, std::vector<GLuint>& indices);
+
+    /**
+    Вычисляет каждую точку сетки (u, v) ровно один раз.
+    Нормаль в узле считается по центральным разностям соседних узлов (на краях сетки - по односторонним).
+    */
+    void fillInSurface(std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, const SurfaceFillinParams& params);
+
+    /**
+    Вычисляет узлы сетки для поверхности, известной на этапе компиляции.
+    Surface должен предоставлять методы position(u, v), du(u, v), dv(u, v) (частные производные)
+    и evaluate(u, v, position, du, dv), вычисляющий все три сразу.
+    Нормаль - нормированное векторное произведение du x dv, поэтому позиции и гладкие нормали считаются за один проход.
+    */
+    template <class Surface>
+    void fillInSurface(std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, const Surface& surface, const SurfaceDomain& domain);
+
+    size_t verticesCount() const { return static_cast<size_t>(_ucnt + 1) * (_vcnt + 1); }
+    size_t indicesCount() const { return static_cast<size_t>(6) * _ucnt * _vcnt; }
+
+    unsigned int threadsCount() const { return _pool ? _pool->threadsCount() : 1; }
+
+    const Stats& getStats() const { return _stats; }
+    void clearStats() { _stats = Stats(); }
+
+protected:
+    /**
+    Выполняет body над полосами строк [begin, end) из rowsCount строк - в пуле или в текущем потоке
+    */
+    void forEachRowBand(size_t rowsCount, const ThreadPool::RangeBody& body);
+
+    static double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    unsigned int _ucnt;
+    unsigned int _vcnt;
+
+    ThreadPoolPtr _pool;
+
+    Stats _stats;
+};
+
+template <class Surface>
+void SurfaceTessellator::fillInSurface(std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, const Surface& surface, const SurfaceDomain& domain)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    const unsigned int vcnt = _vcnt;
+    const size_t rowSize = vcnt + 1;
+
+    const float udelta = (domain.umax - domain.umin) / _ucnt;
+    const float vdelta = (domain.vmax - domain.vmin) / vcnt;
+    const float umin = domain.umin;
+    const float vmin = domain.vmin;
+
+    vertices.resize(verticesCount());
+    normals.resize(verticesCount());
+
+    glm::vec3* verticesOut = vertices.data();
+    glm::vec3* normalsOut = normals.data();
+    const Surface* f = &surface;
+
+    forEachRowBand(_ucnt + 1, [=](size_t begin, size_t end) {
+        for (size_t ustep = begin; ustep < end; ++ustep) {
+            float u = umin + ustep * udelta;
+            for (size_t vstep = 0; vstep <= vcnt; ++vstep) {
+                float v = vmin + vstep * vdelta;
+
+                glm::vec3 position, du, dv;
+                f->evaluate(u, v, position, du, dv);
+
+                glm::vec3 normal = glm::cross(du, dv);
+                float length = glm::length(normal);
+
+                verticesOut[ustep * rowSize + vstep] = position;
+                normalsOut[ustep * rowSize + vstep] = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+            }
+        }
+    });
+
+    _stats.surfacesCount++;
+    _stats.verticesCount += vertices.size();
+    _stats.seconds += secondsSince(start);
+}
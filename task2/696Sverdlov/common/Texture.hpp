@@ -133,6 +133,8 @@ public:
 
     GLuint texture() const { return _tex; }
 
+    GLenum target() const { return _target; }
+
     GLenum getInternalFormat() {
         GLint internalFormat;
         if (USE_DSA) {
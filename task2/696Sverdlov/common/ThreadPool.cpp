@@ -0,0 +1,95 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threadsCount)
+{
+    if (threadsCount == 0) {
+        threadsCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (unsigned int i = 0; i < threadsCount; i++) {
+        _workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _hasTasks.notify_all();
+
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const RangeBody& body, size_t minBandSize)
+{
+    if (count == 0) {
+        return;
+    }
+
+    // Несколько полос на поток, чтобы неравномерная стоимость строк выравнивалась между потоками.
+    size_t bandsCount = std::min<size_t>(threadsCount() * 4, (count + minBandSize - 1) / std::max<size_t>(minBandSize, 1));
+    bandsCount = std::max<size_t>(bandsCount, 1);
+
+    if (bandsCount == 1) {
+        body(0, count);
+        return;
+    }
+
+    const size_t bandSize = (count + bandsCount - 1) / bandsCount;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (size_t begin = 0; begin < count; begin += bandSize) {
+            size_t end = std::min(begin + bandSize, count);
+            _tasks.push([&body, begin, end]() { body(begin, end); });
+            _unfinishedTasks++;
+        }
+    }
+    _hasTasks.notify_all();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _tasksDone.wait(lock, [this]() { return _unfinishedTasks == 0; });
+}
+
+void ThreadPool::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push(std::move(task));
+        _unfinishedTasks++;
+    }
+    _hasTasks.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _hasTasks.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+            if (_stopping && _tasks.empty()) {
+                return;
+            }
+            task = std::move(_tasks.front());
+            _tasks.pop();
+        }
+
+        task();
+
+        bool allDone;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            allDone = --_unfinishedTasks == 0;
+        }
+        if (allDone) {
+            _tasksDone.notify_all();
+        }
+    }
+}
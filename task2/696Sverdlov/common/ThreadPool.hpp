@@ -0,0 +1,60 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+Простой пул потоков для разбиения циклов на полосы (используется при генерации геометрии)
+и для фоновых задач (см. MeshLoader)
+*/
+class ThreadPool
+{
+public:
+    typedef std::function<void(size_t begin, size_t end)> RangeBody;
+
+    /**
+    \param threadsCount количество рабочих потоков. Если 0, то берется std::thread::hardware_concurrency()
+    */
+    explicit ThreadPool(unsigned int threadsCount = 0);
+
+    ~ThreadPool();
+
+    /**
+    Разбивает диапазон [0, count) на непрерывные полосы и выполняет body над каждой полосой в рабочих потоках.
+    Блокирует вызывающий поток до завершения всех полос.
+    \param minBandSize минимальное количество элементов в одной полосе
+    */
+    void parallelFor(size_t count, const RangeBody& body, size_t minBandSize = 1);
+
+    /**
+    Ставит задачу в очередь и сразу возвращается. parallelFor ждет и такие задачи,
+    поэтому долгие фоновые задачи лучше отдавать отдельному пулу
+    */
+    void post(std::function<void()> task);
+
+    unsigned int threadsCount() const { return static_cast<unsigned int>(_workers.size()); }
+
+protected:
+    ThreadPool(const ThreadPool&) = delete;
+    void operator=(const ThreadPool&) = delete;
+
+    void workerLoop();
+
+    std::vector<std::thread> _workers;
+
+    std::mutex _mutex;
+    std::condition_variable _hasTasks;
+    std::condition_variable _tasksDone;
+
+    std::queue<std::function<void()>> _tasks;
+    size_t _unfinishedTasks = 0;
+    bool _stopping = false;
+};
+
+typedef std::shared_ptr<ThreadPool> ThreadPoolPtr;
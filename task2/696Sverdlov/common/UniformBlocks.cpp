@@ -0,0 +1,71 @@
+#include "UniformBlocks.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+CameraBlock makeCameraBlock(const CameraInfo& camera)
+{
+    CameraBlock block;
+    block.viewMatrix = camera.viewMatrix;
+    block.projectionMatrix = camera.projMatrix;
+    block.cameraPosition = glm::inverse(camera.viewMatrix)[3];
+    return block;
+}
+
+LightBlock makeLightBlock(const LightInfo& light, const glm::mat4& viewMatrix)
+{
+    LightBlock block;
+    block.pos = viewMatrix * glm::vec4(light.position, 1.0f);
+    block.La = glm::vec4(light.ambient, 0.0f);
+    block.Ld = glm::vec4(light.diffuse, 0.0f);
+    block.Ls = glm::vec4(light.specular, 0.0f);
+    return block;
+}
+
+FrameUniforms::FrameUniforms(size_t maxObjectsPerFrame) :
+    _maxObjectsPerFrame(maxObjectsPerFrame)
+{
+    // Каждое выделение выравнивается по GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, который не больше 256 байт.
+    const GLsizeiptr slot = 256;
+    auto slots = [slot](size_t size) { return static_cast<GLsizeiptr>((size + slot - 1) / slot + 1) * slot; };
+
+    _stream = std::make_shared<StreamingBuffer>(GL_UNIFORM_BUFFER,
+                                                slots(sizeof(CameraBlock)) + slots(sizeof(LightsBlock)) + maxObjectsPerFrame * slots(sizeof(ObjectBlock)));
+}
+
+StreamingBuffer::Allocation FrameUniforms::write(const void* data, GLsizeiptr size)
+{
+    StreamingBuffer::Allocation allocation = _stream->allocate(size);
+    if (!allocation.data) {
+        return StreamingBuffer::Allocation();
+    }
+
+    std::memcpy(allocation.data, data, size);
+    return allocation;
+}
+
+void FrameUniforms::beginFrame(const CameraBlock& camera, const LightsBlock& lights)
+{
+    _stream->beginFrame();
+
+    _stream->bindRange(CAMERA_BLOCK_BINDING, write(&camera, sizeof(camera)));
+    _stream->bindRange(LIGHTS_BLOCK_BINDING, write(&lights, sizeof(lights)));
+}
+
+StreamingBuffer::Allocation FrameUniforms::addObject(const ObjectBlock& object)
+{
+    StreamingBuffer::Allocation allocation = write(&object, sizeof(object));
+    if (allocation.size == 0 && !_overflowReported) {
+        std::cerr << "More than " << _maxObjectsPerFrame << " object blocks in a frame, the remaining draws are skipped\n";
+        _overflowReported = true;
+    }
+    return allocation;
+}
+
+void FrameUniforms::bindObject(const StreamingBuffer::Allocation& object) const
+{
+    assert(object.size > 0);
+    _stream->bindRange(OBJECT_BLOCK_BINDING, object);
+}
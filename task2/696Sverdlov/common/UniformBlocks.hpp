@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Camera.hpp"
+#include "LightInfo.hpp"
+#include "StreamingBuffer.hpp"
+
+#include <cstddef>
+#include <memory>
+
+/**
+Общие юниформ-блоки std140. Структуры повторяют объявления блоков в шейдерах побайтно:
+vec3 и столбцы mat3 выровнены по 16 байт, поэтому хранятся как vec4.
+ShaderProgram::linkProgram привязывает блоки с именами CameraBlock, LightsBlock и ObjectBlock к точкам ниже,
+поэтому блок, привязанный один раз за кадр, видят все программы.
+*/
+
+const GLuint CAMERA_BLOCK_BINDING = 0;
+const GLuint LIGHTS_BLOCK_BINDING = 1;
+const GLuint OBJECT_BLOCK_BINDING = 2;
+
+const int MAX_LIGHTS = 4;
+
+struct CameraBlock
+{
+    glm::mat4 viewMatrix;
+    glm::mat4 projectionMatrix;
+
+    ///Положение камеры в мировой системе координат (w не используется)
+    glm::vec4 cameraPosition;
+};
+
+CameraBlock makeCameraBlock(const CameraInfo& camera);
+
+struct LightBlock
+{
+    ///Положение в системе координат камеры
+    glm::vec4 pos;
+    glm::vec4 La;
+    glm::vec4 Ld;
+    glm::vec4 Ls;
+};
+
+LightBlock makeLightBlock(const LightInfo& light, const glm::mat4& viewMatrix);
+
+struct LightsBlock
+{
+    LightBlock lights[MAX_LIGHTS];
+    GLint lightsCount = 0;
+    GLint padding[3] = {};
+};
+
+/**
+Данные одной отрисовки. Каждая программа читает только нужные ей поля
+*/
+struct ObjectBlock
+{
+    glm::mat4 modelMatrix = glm::mat4(1.0f);
+
+    ///Столбцы mat3 преобразования нормалей в систему координат камеры
+    glm::vec4 normalToCameraMatrix[3] = { glm::vec4(1.0f, 0.0f, 0.0f, 0.0f), glm::vec4(0.0f, 1.0f, 0.0f, 0.0f), glm::vec4(0.0f, 0.0f, 1.0f, 0.0f) };
+
+    glm::vec4 color = glm::vec4(1.0f);
+
+    float morphismAlpha = 0.0f;
+    float alphaScaler = 1.0f;
+    float padding[2] = {};
+
+    void setNormalToCameraMatrix(const glm::mat3& m)
+    {
+        for (int c = 0; c < 3; c++) {
+            normalToCameraMatrix[c] = glm::vec4(m[c], 0.0f);
+        }
+    }
+};
+
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock must match the std140 layout");
+static_assert(sizeof(LightsBlock) == MAX_LIGHTS * 64 + 16, "LightsBlock must match the std140 layout");
+static_assert(sizeof(ObjectBlock) == 144, "ObjectBlock must match the std140 layout");
+
+//Смещения полей, которые сообщает GL_UNIFORM_OFFSET для блоков в шейдерах
+static_assert(offsetof(CameraBlock, projectionMatrix) == 64 && offsetof(CameraBlock, cameraPosition) == 128,
+              "CameraBlock must match the std140 layout");
+static_assert(sizeof(LightBlock) == 64 && offsetof(LightBlock, La) == 16 && offsetof(LightBlock, Ld) == 32 && offsetof(LightBlock, Ls) == 48,
+              "LightBlock must match the std140 layout of LightInfo");
+static_assert(offsetof(LightsBlock, lightsCount) == MAX_LIGHTS * 64, "LightsBlock must match the std140 layout");
+static_assert(offsetof(ObjectBlock, normalToCameraMatrix) == 64 && offsetof(ObjectBlock, color) == 112 &&
+              offsetof(ObjectBlock, morphismAlpha) == 128 && offsetof(ObjectBlock, alphaScaler) == 132,
+              "ObjectBlock must match the std140 layout");
+
+/**
+Юниформ-блоки кадра в кольцевом буфере (см. StreamingBuffer).
+Блоки камеры и света пишутся и привязываются один раз за кадр. Блоки объектов пишутся в тот же регион по одному на отрисовку
+и привязываются перед ней через glBindBufferRange; без постоянного отображения весь кадр копируется одним glBufferSubData в flush
+*/
+class FrameUniforms
+{
+public:
+    explicit FrameUniforms(size_t maxObjectsPerFrame);
+
+    /**
+    Начинает кадр и привязывает блоки камеры и света к CAMERA_BLOCK_BINDING и LIGHTS_BLOCK_BINDING
+    */
+    void beginFrame(const CameraBlock& camera, const LightsBlock& lights);
+
+    /**
+    Записывает блок объекта. Если регион кадра переполнен (больше maxObjectsPerFrame блоков), возвращает пустое выделение (size == 0)
+    и сообщает о переполнении в первый раз; отрисовку с таким блоком нужно пропустить, иначе она возьмет блок предыдущего объекта
+    */
+    StreamingBuffer::Allocation addObject(const ObjectBlock& object);
+
+    /**
+    Привязывает блок объекта к OBJECT_BLOCK_BINDING. object - непустое выделение из addObject
+    */
+    void bindObject(const StreamingBuffer::Allocation& object) const;
+
+    /**
+    Делает записанные блоки видимыми для видеокарты. Вызывается после записи всех блоков и до первой отрисовки
+    */
+    void flush() { _stream->flush(); }
+
+    void endFrame() { _stream->endFrame(); }
+
+    const StreamingBuffer& stream() const { return *_stream; }
+
+protected:
+    StreamingBuffer::Allocation write(const void* data, GLsizeiptr size);
+
+    StreamingBufferPtr _stream;
+
+    size_t _maxObjectsPerFrame;
+    bool _overflowReported = false;
+};
+
+typedef std::shared_ptr<FrameUniforms> FrameUniformsPtr;
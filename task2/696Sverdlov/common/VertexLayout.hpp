@@ -0,0 +1,246 @@
+#pragma once
+
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/**
+Формат одного вершинного атрибута в терминах glVertexAttribPointer
+*/
+template <class T>
+struct AttributeFormat;
+
+template <>
+struct AttributeFormat<float>
+{
+    static const GLint size = 1;
+    static const GLenum type = GL_FLOAT;
+    static const GLboolean normalized = GL_FALSE;
+};
+
+template <>
+struct AttributeFormat<glm::vec2>
+{
+    static const GLint size = 2;
+    static const GLenum type = GL_FLOAT;
+    static const GLboolean normalized = GL_FALSE;
+};
+
+template <>
+struct AttributeFormat<glm::vec3>
+{
+    static const GLint size = 3;
+    static const GLenum type = GL_FLOAT;
+    static const GLboolean normalized = GL_FALSE;
+};
+
+template <>
+struct AttributeFormat<glm::vec4>
+{
+    static const GLint size = 4;
+    static const GLenum type = GL_FLOAT;
+    static const GLboolean normalized = GL_FALSE;
+};
+
+///Позиция, квантованная в 16-битные snorm (4-я компонента - выравнивание), см. VertexQuantization.hpp
+struct PackedPosition
+{
+    int16_t xyzw[4];
+};
+
+template <>
+struct AttributeFormat<PackedPosition>
+{
+    static const GLint size = 4;
+    static const GLenum type = GL_SHORT;
+    static const GLboolean normalized = GL_TRUE;
+};
+
+///Единичный вектор в формате 10:10:10:2
+struct PackedNormal
+{
+    uint32_t bits;
+};
+
+template <>
+struct AttributeFormat<PackedNormal>
+{
+    static const GLint size = 4;
+    static const GLenum type = GL_INT_2_10_10_10_REV;
+    static const GLboolean normalized = GL_TRUE;
+};
+
+///Два числа в половинной точности
+struct PackedTexcoord
+{
+    uint32_t bits;
+};
+
+template <>
+struct AttributeFormat<PackedTexcoord>
+{
+    static const GLint size = 2;
+    static const GLenum type = GL_HALF_FLOAT;
+    static const GLboolean normalized = GL_FALSE;
+};
+
+/**
+Раскладка вершины Vertex: специализация перечисляет атрибуты, вызывая visitor(номер атрибута, указатель на поле), например
+
+template <> struct VertexLayout<MeshVertex> {
+    template <class Visitor> static void visit(Visitor& visitor) {
+        visitor(0, &MeshVertex::position);
+        visitor(1, &MeshVertex::normal);
+    }
+};
+
+Тип каждого поля должен иметь специализацию AttributeFormat.
+*/
+template <class Vertex>
+struct VertexLayout;
+
+/**
+Вершина стандартных мешей: атрибуты 0, 1 и 2, как в шейдерах семинаров
+*/
+struct MeshVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texcoord;
+};
+
+template <>
+struct VertexLayout<MeshVertex>
+{
+    template <class Visitor>
+    static void visit(Visitor& visitor)
+    {
+        visitor(0, &MeshVertex::position);
+        visitor(1, &MeshVertex::normal);
+        visitor(2, &MeshVertex::texcoord);
+    }
+};
+
+/**
+Та же вершина в сжатом формате: 16 байт вместо 32
+*/
+struct QuantizedMeshVertex
+{
+    PackedPosition position;
+    PackedNormal normal;
+    PackedTexcoord texcoord;
+};
+
+template <>
+struct VertexLayout<QuantizedMeshVertex>
+{
+    template <class Visitor>
+    static void visit(Visitor& visitor)
+    {
+        visitor(0, &QuantizedMeshVertex::position);
+        visitor(1, &QuantizedMeshVertex::normal);
+        visitor(2, &QuantizedMeshVertex::texcoord);
+    }
+};
+
+namespace detail {
+
+template <class Vertex, class T>
+GLuint memberOffset(T Vertex::* member)
+{
+    static const Vertex sample = Vertex();
+    return static_cast<GLuint>(reinterpret_cast<const char*>(&(sample.*member)) - reinterpret_cast<const char*>(&sample));
+}
+
+template <class Vertex>
+struct InterleavedAttributeSetter
+{
+    Mesh& mesh;
+    const DataBufferPtr& buffer;
+
+    template <class T>
+    void operator()(GLuint index, T Vertex::* member) const
+    {
+        typedef AttributeFormat<T> Format;
+        mesh.setAttribute(index, Format::size, Format::type, Format::normalized, sizeof(Vertex), memberOffset(member), buffer);
+    }
+};
+
+template <class Vertex>
+struct AttributeDescriber
+{
+    std::vector<VertexAttributeState>& attributes;
+
+    template <class T>
+    void operator()(GLuint index, T Vertex::* member) const
+    {
+        typedef AttributeFormat<T> Format;
+
+        VertexAttributeState attribute;
+        attribute.index = index;
+        attribute.size = Format::size;
+        attribute.type = Format::type;
+        attribute.normalized = Format::normalized;
+        attribute.stride = sizeof(Vertex);
+        attribute.offset = memberOffset(member);
+        attributes.push_back(attribute);
+    }
+};
+
+template <class Vertex>
+struct SeparateAttributeSetter
+{
+    Mesh& mesh;
+    const std::vector<Vertex>& vertices;
+
+    template <class T>
+    void operator()(GLuint index, T Vertex::* member) const
+    {
+        std::vector<T> stream(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            stream[i] = vertices[i].*member;
+        }
+
+        DataBufferPtr buffer = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
+        buffer->setData(stream.size() * sizeof(T), stream.data());
+
+        typedef AttributeFormat<T> Format;
+        mesh.setAttribute(index, Format::size, Format::type, Format::normalized, 0, 0, buffer);
+    }
+};
+
+}
+
+/**
+Атрибуты чередующейся раскладки VertexLayout<Vertex> (поле buffer не заполняется)
+*/
+template <class Vertex>
+std::vector<VertexAttributeState> describeVertexLayout()
+{
+    std::vector<VertexAttributeState> attributes;
+    detail::AttributeDescriber<Vertex> describer{ attributes };
+    VertexLayout<Vertex>::visit(describer);
+    return attributes;
+}
+
+/**
+Загружает вершины в видеопамять и настраивает все атрибуты меша по раскладке VertexLayout<Vertex>.
+При VertexStreams::Interleaved создается один буфер с шагом sizeof(Vertex),
+при VertexStreams::Separate - отдельный плотный буфер на каждый атрибут (для сравнения производительности)
+*/
+template <class Vertex>
+void setVertexBuffer(Mesh& mesh, const std::vector<Vertex>& vertices, VertexStreams streams = VertexStreams::Interleaved)
+{
+    if (streams == VertexStreams::Interleaved) {
+        DataBufferPtr buffer = std::make_shared<DataBuffer>(GL_ARRAY_BUFFER);
+        buffer->setData(vertices.size() * sizeof(Vertex), vertices.data());
+
+        detail::InterleavedAttributeSetter<Vertex> setter{ mesh, buffer };
+        VertexLayout<Vertex>::visit(setter);
+    }
+    else {
+        detail::SeparateAttributeSetter<Vertex> setter{ mesh, vertices };
+        VertexLayout<Vertex>::visit(setter);
+    }
+}
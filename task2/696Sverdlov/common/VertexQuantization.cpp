@@ -0,0 +1,95 @@
+#include "VertexQuantization.hpp"
+
+#include <glm/packing.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+glm::mat4 PositionQuantization::dequantizationMatrix() const
+{
+    return glm::scale(glm::translate(glm::mat4(1.0f), center), halfExtent);
+}
+
+PositionQuantization PositionQuantization::fit(const std::vector<const std::vector<glm::vec3>*>& positionSets)
+{
+    glm::vec3 minCorner(std::numeric_limits<float>::max());
+    glm::vec3 maxCorner(-std::numeric_limits<float>::max());
+    for (const std::vector<glm::vec3>* positions : positionSets) {
+        for (const glm::vec3& p : *positions) {
+            minCorner = glm::min(minCorner, p);
+            maxCorner = glm::max(maxCorner, p);
+        }
+    }
+
+    PositionQuantization quantization;
+    if (minCorner.x > maxCorner.x) {
+        return quantization; //нет ни одной вершины
+    }
+
+    quantization.center = 0.5f * (minCorner + maxCorner);
+    quantization.halfExtent = 0.5f * (maxCorner - minCorner);
+    for (int i = 0; i < 3; i++) {
+        // Плоский по оси меш (например, плоскость земли): масштаб не должен быть нулевым, иначе матрица вырождена.
+        if (quantization.halfExtent[i] <= 0.0f) {
+            quantization.halfExtent[i] = 1.0f;
+        }
+    }
+    return quantization;
+}
+
+std::ostream& operator<<(std::ostream& stream, const VertexQuantizationReport& report)
+{
+    return stream << "quantized vertex attributes: " << report.quantizedBytes << " bytes instead of " << report.floatBytes
+                  << " (saved " << report.savedBytes() << "), max error: position " << report.maxPositionError
+                  << ", normal " << report.maxNormalError << " deg, texcoord " << report.maxTexcoordError;
+}
+
+PackedPosition quantizePosition(const glm::vec3& position, const PositionQuantization& quantization, VertexQuantizationReport& report)
+{
+    glm::vec3 q = glm::clamp((position - quantization.center) / quantization.halfExtent, -1.0f, 1.0f);
+
+    PackedPosition packed;
+    glm::vec3 unpacked;
+    for (int k = 0; k < 3; k++) {
+        packed.xyzw[k] = static_cast<int16_t>(std::lround(q[k] * 32767.0f));
+        unpacked[k] = packed.xyzw[k] / 32767.0f;
+    }
+    packed.xyzw[3] = 0;
+
+    glm::vec3 restored = quantization.center + quantization.halfExtent * unpacked;
+    report.maxPositionError = std::max(report.maxPositionError, glm::length(restored - position));
+    report.floatBytes += sizeof(glm::vec3);
+    report.quantizedBytes += sizeof(PackedPosition);
+
+    return packed;
+}
+
+PackedNormal packNormal(const glm::vec3& normal, VertexQuantizationReport& report)
+{
+    PackedNormal packed;
+    packed.bits = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+
+    glm::vec3 unpacked = glm::vec3(glm::unpackSnorm3x10_1x2(packed.bits));
+    float cosine = glm::dot(glm::normalize(unpacked), glm::normalize(normal));
+    report.maxNormalError = std::max(report.maxNormalError, glm::degrees(std::acos(glm::clamp(cosine, -1.0f, 1.0f))));
+    report.floatBytes += sizeof(glm::vec3);
+    report.quantizedBytes += sizeof(PackedNormal);
+
+    return packed;
+}
+
+PackedTexcoord packTexcoord(const glm::vec2& texcoord, VertexQuantizationReport& report)
+{
+    PackedTexcoord packed;
+    packed.bits = glm::packHalf2x16(texcoord);
+
+    glm::vec2 unpacked = glm::unpackHalf2x16(packed.bits);
+    report.maxTexcoordError = std::max(report.maxTexcoordError, glm::length(unpacked - texcoord));
+    report.floatBytes += sizeof(glm::vec2);
+    report.quantizedBytes += sizeof(PackedTexcoord);
+
+    return packed;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "VertexLayout.hpp"
+
+#include <iosfwd>
+#include <vector>
+
+/**
+Сжатый формат вершинных атрибутов (VertexFormat::Quantized):
+- позиции - 16-битные snorm (GL_SHORT, normalized) внутри ограничивающего параллелепипеда меша,
+  обратное преобразование хранится в Mesh::dequantizationMatrix;
+- нормали - GL_INT_2_10_10_10_REV (normalized), 4 байта вместо 12;
+- текстурные координаты - GL_HALF_FLOAT, 4 байта вместо 8.
+Ошибки считаются по правилу распаковки snorm из OpenGL 4.2+: f = max(c / (2^(b-1) - 1), -1).
+*/
+
+/**
+Общее для всех наборов позиций меша преобразование: p = center + halfExtent * q, q в [-1, 1]
+*/
+struct PositionQuantization
+{
+    glm::vec3 center = glm::vec3(0.0f);
+    glm::vec3 halfExtent = glm::vec3(1.0f);
+
+    glm::mat4 dequantizationMatrix() const;
+
+    /**
+    Ограничивающий параллелепипед всех наборов позиций (например, обеих целей морфинга)
+    */
+    static PositionQuantization fit(const std::vector<const std::vector<glm::vec3>*>& positionSets);
+};
+
+/**
+Функции упаковки атрибутов. Каждая учитывает размер и ошибку упакованного значения в report
+*/
+PackedPosition quantizePosition(const glm::vec3& position, const PositionQuantization& quantization, VertexQuantizationReport& report);
+PackedNormal packNormal(const glm::vec3& normal, VertexQuantizationReport& report);
+PackedTexcoord packTexcoord(const glm::vec2& texcoord, VertexQuantizationReport& report);